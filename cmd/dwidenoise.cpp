@@ -63,7 +63,12 @@ void usage ()
     +   Argument ("window").type_sequence_int ()
 
     + Option ("noise", "the output noise map.")
-    +   Argument ("level").type_image_out();
+    +   Argument ("level").type_image_out()
+
+    + Option ("incremental", "update the covariance matrix incrementally as the window slides along "
+                             "each row of the image, rather than recomputing it from scratch for every "
+                             "voxel. This is substantially faster for large windows, but the output "
+                             "will differ from the default mode within numerical precision.");
 
   COPYRIGHT = "Copyright (c) 2016 New York University, University of Antwerp, and the MRtrix3 contributors \n \n"
       "Permission is hereby granted, free of charge, to any non-commercial entity ('Recipient') obtaining a copy of this software and "
@@ -91,15 +96,20 @@ using value_type = float;
 template <class ImageType>
 class DenoisingFunctor { MEMALIGN(DenoisingFunctor)
   public:
-  DenoisingFunctor (ImageType& dwi, vector<int> extent, Image<bool>& mask, ImageType& noise)
+  DenoisingFunctor (ImageType& dwi, vector<int> extent, Image<bool>& mask, ImageType& noise, bool incremental)
     : extent {{extent[0]/2, extent[1]/2, extent[2]/2}},
       m (dwi.size(3)),
       n (extent[0]*extent[1]*extent[2]),
       r ((m<n) ? m : n),
+      incremental (incremental),
       X (m,n), 
+      XtX (r,r),
+      eig (r),
       pos {{0, 0, 0}}, 
+      centre (n/2),
       mask (mask),
-      noise (noise)
+      noise (noise),
+      gram_valid (false)
   { }
   
   void operator () (ImageType& dwi, ImageType& out)
@@ -110,16 +120,21 @@ class DenoisingFunctor { MEMALIGN(DenoisingFunctor)
         return;
     }
 
-    // Load data in local window
-    load_data (dwi);
+    // Load data in local window & compute covariance matrix:
+    if (incremental) {
+      update_data (dwi);
+      XtX = gram.template cast<float>();
+    }
+    else {
+      load_data (dwi);
+      if (m <= n)
+        XtX.template triangularView<Eigen::Lower>() = X * X.transpose();
+      else 
+        XtX.template triangularView<Eigen::Lower>() = X.transpose() * X;
+    }
 
     // Compute Eigendecomposition:
-    Eigen::MatrixXf XtX (r,r);
-    if (m <= n)
-      XtX.template triangularView<Eigen::Lower>() = X * X.transpose();
-    else 
-      XtX.template triangularView<Eigen::Lower>() = X.transpose() * X;
-    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> eig (XtX);
+    eig.compute (XtX);
     // eigenvalues provide squared singular values:
     Eigen::VectorXf s = eig.eigenvalues();
    
@@ -142,20 +157,23 @@ class DenoisingFunctor { MEMALIGN(DenoisingFunctor)
       } 
     }
 
+    // the reconstructed signal is written to a separate vector, since in
+    // incremental mode X must be preserved for the next voxel:
+    Eigen::VectorXf signal = X.col (centre);
     if (cutoff_p > 0) {
       // recombine data using only eigenvectors above threshold:
       s.head (cutoff_p).setZero();
       s.tail (r-cutoff_p).setOnes();
       if (m <= n) 
-        X.col (n/2) = eig.eigenvectors() * ( s.asDiagonal() * ( eig.eigenvectors().adjoint() * X.col(n/2) ));
+        signal = eig.eigenvectors() * ( s.asDiagonal() * ( eig.eigenvectors().adjoint() * X.col(centre) ));
       else 
-        X.col (n/2) = X * ( eig.eigenvectors() * ( s.asDiagonal() * eig.eigenvectors().adjoint().col(n/2) ));
+        signal = X * ( eig.eigenvectors() * ( s.asDiagonal() * eig.eigenvectors().adjoint().col(centre) ));
     }
 
     // Store output
     assign_pos_of(dwi).to(out);
     for (auto l = Loop (3) (out); l; ++l)
-      out.value() = X(out.index(3), n/2);
+      out.value() = signal[out.index(3)];
 
     // store noise map if requested:
     if (noise.valid()) {
@@ -180,15 +198,116 @@ class DenoisingFunctor { MEMALIGN(DenoisingFunctor)
     dwi.index(1) = pos[1];
     dwi.index(2) = pos[2];
   }
+
+
+  // In incremental mode, the columns of X are arranged as a circular buffer
+  // along the x axis: the plane of voxels at x position i is stored in slot
+  // (i mod window width). Moving the window by one voxel along x then only
+  // involves replacing the plane that drops out of the window with the one
+  // that enters it, and updating the covariance matrix accordingly.
+  // The eigenvalues are invariant to this permutation of the columns.
+  void update_data (ImageType& dwi)
+  {
+    const ssize_t width = 2*extent[0]+1;
+    const ssize_t shift = dwi.index(0) - pos[0];
+    // sliding the window is only worthwhile if fewer than half the planes
+    // need replacing - otherwise recompute from scratch:
+    if (gram_valid && dwi.index(1) == pos[1] && dwi.index(2) == pos[2] && shift > 0 && 2*shift < width) {
+      const ssize_t x = dwi.index(0);
+      for (pos[0] = x-shift+1; pos[0] <= x; ++pos[0])
+        slide_window (dwi, pos[0]+extent[0]);
+      pos[0] = dwi.index(0) = x;
+    }
+    else {
+      pos[0] = dwi.index(0); pos[1] = dwi.index(1); pos[2] = dwi.index(2);
+      X.setZero();
+      for (ssize_t i = pos[0]-extent[0]; i <= pos[0]+extent[0]; ++i)
+        load_plane (dwi, i);
+      dwi.index(0) = pos[0];
+      // accumulate in double precision to limit drift over the row:
+      gram.setZero (r, r);
+      if (m <= n)
+        gram.template selfadjointView<Eigen::Lower>().rankUpdate (X.template cast<double>());
+      else
+        gram.template selfadjointView<Eigen::Lower>().rankUpdate (X.transpose().template cast<double>());
+      gram_valid = true;
+    }
+    centre = column (extent[0], extent[1], slot (pos[0]));
+  }
+
   
 private:
   const std::array<ssize_t, 3> extent;
   const ssize_t m, n, r;
+  const bool incremental;
   Eigen::MatrixXf X;
+  Eigen::MatrixXf XtX;
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> eig;
   std::array<ssize_t, 3> pos;
+  ssize_t centre;
   double sigma2;
   Image<bool> mask;
   ImageType noise;
+  Eigen::MatrixXd gram;
+  bool gram_valid;
+
+  ssize_t slot (ssize_t x) const {
+    const ssize_t width = 2*extent[0]+1;
+    return ((x % width) + width) % width;
+  }
+
+  ssize_t column (ssize_t z, ssize_t y, ssize_t s) const {
+    return (z*(2*extent[1]+1) + y) * (2*extent[0]+1) + s;
+  }
+
+  // load the plane of voxels at x position x into its slot in X:
+  void load_plane (ImageType& dwi, ssize_t x)
+  {
+    const ssize_t s = slot (x);
+    dwi.index(0) = x;
+    for (ssize_t z = 0; z <= 2*extent[2]; ++z) {
+      dwi.index(2) = pos[2]-extent[2]+z;
+      for (ssize_t y = 0; y <= 2*extent[1]; ++y) {
+        dwi.index(1) = pos[1]-extent[1]+y;
+        if (is_out_of_bounds (dwi,0,3))
+          X.col (column (z, y, s)).setZero();
+        else
+          X.col (column (z, y, s)) = dwi.row(3);
+      }
+    }
+    dwi.index(1) = pos[1];
+    dwi.index(2) = pos[2];
+  }
+
+  // replace the plane leaving the window with that at x position x, which
+  // occupies the same slot, and update the covariance matrix:
+  void slide_window (ImageType& dwi, ssize_t x)
+  {
+    const ssize_t s = slot (x);
+    const ssize_t nplane = (2*extent[1]+1) * (2*extent[2]+1);
+    if (m <= n) {
+      Eigen::MatrixXd plane (m, nplane);
+      for (ssize_t k = 0; k < nplane; ++k)
+        plane.col(k) = X.col (column (0, k, s)).template cast<double>();
+      gram.template selfadjointView<Eigen::Lower>().rankUpdate (plane, -1.0);
+      load_plane (dwi, x);
+      for (ssize_t k = 0; k < nplane; ++k)
+        plane.col(k) = X.col (column (0, k, s)).template cast<double>();
+      gram.template selfadjointView<Eigen::Lower>().rankUpdate (plane, 1.0);
+    }
+    else {
+      load_plane (dwi, x);
+      // inner products are recomputed exactly for the replaced columns only:
+      for (ssize_t k = 0; k < nplane; ++k) {
+        const ssize_t c = column (0, k, s);
+        const Eigen::VectorXd v = (X.transpose() * X.col(c)).template cast<double>();
+        for (ssize_t i = c; i < n; ++i)
+          gram(i,c) = v[i];
+        for (ssize_t j = 0; j < c; ++j)
+          gram(c,j) = v[j];
+      }
+    }
+  }
   
 };
 
@@ -232,9 +351,17 @@ void run ()
     noise = Image<value_type>::create (opt[0][0], header);
   }
 
-  DenoisingFunctor< Image<value_type> > func (dwi_in, extent, mask, noise);
-  ThreadedLoop ("running MP-PCA denoising", dwi_in, 0, 3)
-    .run (func, dwi_in, dwi_out);
+  const bool incremental = get_options("incremental").size();
+  DenoisingFunctor< Image<value_type> > func (dwi_in, extent, mask, noise, incremental);
+  if (incremental) {
+    // the window can only slide if each thread processes complete rows along x:
+    ThreadedLoop ("running MP-PCA denoising", dwi_in, { 0, 1, 2 })
+      .run (func, dwi_in, dwi_out);
+  }
+  else {
+    ThreadedLoop ("running MP-PCA denoising", dwi_in, 0, 3)
+      .run (func, dwi_in, dwi_out);
+  }
 }
 
 
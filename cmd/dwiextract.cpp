@@ -53,6 +53,9 @@ void usage ()
 void run()
 {
   auto input_header = Header::open (argument[0]);
+  // volumes are extracted in ascending order
+  if (std::string (argument[1]) != std::string (argument[0]))
+    input_header.set_sequential_access();
   auto input_image = input_header.get_image<float>();
 
   Eigen::MatrixXd grad_unprocessed = DWI::get_DW_scheme (input_image);
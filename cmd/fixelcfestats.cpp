@@ -19,6 +19,7 @@
 #include "algo/loop.h"
 #include "transform.h"
 #include "image.h"
+#include "file/path.h"
 #include "fixel/helpers.h"
 #include "fixel/keys.h"
 #include "fixel/loop.h"
@@ -83,7 +84,8 @@ void usage ()
 
   + Argument ("contrast", "the contrast vector, specified as a single row of weights").type_file_in ()
 
-  + Argument ("tracks", "the tracks used to determine fixel-fixel connectivity").type_tracks_in ()
+  + Argument ("tracks", "the tracks used to determine fixel-fixel connectivity; alternatively, the directory containing a "
+                        "fixel-fixel connectivity matrix previously saved using the -out_connectivity option").type_text ()
 
   + Argument ("out_fixel_directory", "the output directory where results will be saved. Will be created if it does not exist").type_text();
 
@@ -121,7 +123,14 @@ void usage ()
   + Argument ("value").type_float (0.0, 90.0)
 
   + Option ("mask", "provide a fixel data file containing a mask of those fixels to be used during processing")
-  + Argument ("file").type_image_in();
+  + Argument ("file").type_image_in()
+
+  + Option ("out_connectivity", "save the thresholded fixel-fixel connectivity matrix to a directory, such that it can "
+                                "be provided in place of the tracks input in subsequent analyses, without re-processing "
+                                "the tractogram. Note that the matrix depends on the fixel mask, angular threshold and "
+                                "connectivity threshold used; a higher connectivity threshold can however still be "
+                                "applied when the matrix is re-used.")
+  + Argument ("directory").type_text();
 
 }
 
@@ -276,35 +285,62 @@ void run() {
   if (contrast.rows() > 1)
     throw Exception ("only a single contrast vector (defined as a row) is currently supported");
 
-  // Compute fixel-fixel connectivity
-  Stats::CFE::init_connectivity_matrix_type connectivity_matrix (num_fixels);
-  vector<uint16_t> fixel_TDI (num_fixels, 0);
+  // Compute fixel-fixel connectivity, or load it from a previous run
+  std::unique_ptr<Stats::CFE::ConnectivityMatrix> connectivity_matrix;
   const std::string track_filename = argument[4];
-  DWI::Tractography::Properties properties;
-  DWI::Tractography::Reader<float> track_file (track_filename, properties);
-  // Read in tracts, and compute whole-brain fixel-fixel connectivity
-  const size_t num_tracks = properties["count"].empty() ? 0 : to<size_t> (properties["count"]);
-  if (!num_tracks)
-    throw Exception ("no tracks found in input file");
-  if (num_tracks < 1000000)
-    WARN ("more than 1 million tracks should be used to ensure robust fixel-fixel connectivity");
-  {
-    DWI::Tractography::Mapping::TrackLoader loader (track_file, num_tracks, "pre-computing fixel-fixel connectivity");
-    DWI::Tractography::Mapping::TrackMapperBase mapper (index_image);
-    mapper.set_upsample_ratio (DWI::Tractography::Mapping::determine_upsample_ratio (index_header, properties, 0.333f));
-    mapper.set_use_precise_mapping (true);
-    Stats::CFE::TrackProcessor tract_processor (index_image, directions, mask, fixel_TDI, connectivity_matrix, angular_threshold);
-    Thread::run_queue (
-        loader,
-        Thread::batch (DWI::Tractography::Streamline<float>()),
-        mapper,
-        Thread::batch (DWI::Tractography::Mapping::SetVoxelDir()),
-        tract_processor);
+  if (Path::is_dir (track_filename)) {
+    connectivity_matrix.reset (new Stats::CFE::ConnectivityMatrix (track_filename));
+    if (connectivity_matrix->size() != num_fixels)
+      throw Exception ("fixel-fixel connectivity matrix in directory \"" + track_filename + "\" does not match fixel template");
+    auto it = connectivity_matrix->keyval.find ("connectivity threshold");
+    if (it != connectivity_matrix->keyval.end() && to<value_type> (it->second) > connectivity_threshold)
+      WARN ("connectivity threshold (" + str(connectivity_threshold) + ") is lower than that used to construct the saved fixel-fixel connectivity matrix (" + it->second + ")");
+    it = connectivity_matrix->keyval.find ("mask fixels");
+    if (it != connectivity_matrix->keyval.end() && to<index_type> (it->second) != mask_fixels)
+      WARN ("fixel mask differs from that used to construct the saved fixel-fixel connectivity matrix");
+    it = connectivity_matrix->keyval.find ("angular threshold");
+    if (it != connectivity_matrix->keyval.end() && get_options ("angle").size() && to<value_type> (it->second) != angular_threshold)
+      WARN ("angular threshold (" + str(angular_threshold) + ") differs from that used to construct the saved fixel-fixel connectivity matrix (" + it->second + "); the latter will be used");
+  } else {
+    Stats::CFE::InitMatrix init_connectivity_matrix (num_fixels);
+    vector<uint32_t> fixel_TDI (num_fixels, 0);
+    DWI::Tractography::Properties properties;
+    DWI::Tractography::Reader<float> track_file (track_filename, properties);
+    // Read in tracts, and compute whole-brain fixel-fixel connectivity
+    const size_t num_tracks = properties["count"].empty() ? 0 : to<size_t> (properties["count"]);
+    if (!num_tracks)
+      throw Exception ("no tracks found in input file");
+    if (num_tracks < 1000000)
+      WARN ("more than 1 million tracks should be used to ensure robust fixel-fixel connectivity");
+    {
+      DWI::Tractography::Mapping::TrackLoader loader (track_file, num_tracks, "pre-computing fixel-fixel connectivity");
+      DWI::Tractography::Mapping::TrackMapperBase mapper (index_image);
+      mapper.set_upsample_ratio (DWI::Tractography::Mapping::determine_upsample_ratio (index_header, properties, 0.333f));
+      mapper.set_use_precise_mapping (true);
+      Stats::CFE::TrackProcessor tract_processor (index_image, directions, mask, fixel_TDI, init_connectivity_matrix, angular_threshold);
+      Thread::run_queue (
+          loader,
+          Thread::batch (DWI::Tractography::Streamline<float>()),
+          Thread::multi (mapper),
+          Thread::batch (DWI::Tractography::Mapping::SetVoxelDir()),
+          Thread::multi (tract_processor));
+    }
+    track_file.close();
+
+    // Threshold the connectivity matrix & convert to a compressed format;
+    //   this frees the memory used by the initial matrix as it progresses
+    connectivity_matrix.reset (new Stats::CFE::ConnectivityMatrix (init_connectivity_matrix, fixel_TDI, connectivity_threshold));
+    connectivity_matrix->keyval["angular threshold"] = str(angular_threshold);
+    connectivity_matrix->keyval["mask fixels"] = str(mask_fixels);
+    connectivity_matrix->keyval["tracks"] = Path::basename (track_filename);
   }
-  track_file.close();
+
+  opt = get_options ("out_connectivity");
+  if (opt.size())
+    connectivity_matrix->save (opt[0][0], index_header);
 
   // Normalise connectivity matrix, threshold, and put in a more efficient format
-  Stats::CFE::norm_connectivity_matrix_type norm_connectivity_matrix (mask_fixels);
+  Stats::CFE::NormMatrix norm_connectivity_matrix;
   // Also pre-compute fixel-fixel weights for smoothing.
   Stats::CFE::norm_connectivity_matrix_type smoothing_weights (mask_fixels);
   bool do_smoothing = false;
@@ -329,32 +365,32 @@ void run() {
         //   correspond to rows in the statistical analysis
         connectivity_value_type sum_weights = 0.0;
 
-        for (auto& it : connectivity_matrix[fixel]) {
-#ifndef NDEBUG
-          // Even if this fixel is within the mask, it should still not
-          //   connect to any fixel that is outside the mask
-          mask.index(0) = it.first;
-          assert (mask.value());
-#endif
-          const connectivity_value_type connectivity = it.second.value / connectivity_value_type (fixel_TDI[fixel]);
+        const auto connections = (*connectivity_matrix)[fixel];
+        for (size_t i = 0; i != connections.size(); ++i) {
+          const index_type connected_fixel = connections.index (i);
+          // A matrix loaded from file may have been generated using a different mask
+          if (fixel2row[connected_fixel] < 0)
+            continue;
+          const connectivity_value_type connectivity = connections.value (i);
           if (connectivity >= connectivity_threshold) {
             if (do_smoothing) {
-              const value_type distance = std::sqrt (Math::pow2 (positions[fixel][0] - positions[it.first][0]) +
-                                                     Math::pow2 (positions[fixel][1] - positions[it.first][1]) +
-                                                     Math::pow2 (positions[fixel][2] - positions[it.first][2]));
+              const value_type distance = std::sqrt (Math::pow2 (positions[fixel][0] - positions[connected_fixel][0]) +
+                                                     Math::pow2 (positions[fixel][1] - positions[connected_fixel][1]) +
+                                                     Math::pow2 (positions[fixel][2] - positions[connected_fixel][2]));
               const connectivity_value_type smoothing_weight = connectivity * gaussian_const1 * std::exp (-Math::pow2 (distance) / gaussian_const2);
               if (smoothing_weight >= connectivity_threshold) {
-                smoothing_weights[row].push_back (Stats::CFE::NormMatrixElement (fixel2row[it.first], smoothing_weight));
+                smoothing_weights[row].push_back (Stats::CFE::NormMatrixElement (fixel2row[connected_fixel], smoothing_weight));
                 sum_weights += smoothing_weight;
               }
             }
             // Here we pre-exponentiate each connectivity value by C
-            norm_connectivity_matrix[row].push_back (Stats::CFE::NormMatrixElement (fixel2row[it.first], std::pow (connectivity, cfe_c)));
+            norm_connectivity_matrix.add (fixel2row[connected_fixel], std::pow (connectivity, cfe_c));
           }
         }
 
         // Make sure the fixel is fully connected to itself
-        norm_connectivity_matrix[row].push_back (Stats::CFE::NormMatrixElement (uint32_t(row), connectivity_value_type(1.0)));
+        norm_connectivity_matrix.add (uint32_t(row), connectivity_value_type(1.0));
+        norm_connectivity_matrix.finalise_row();
         smoothing_weights[row].push_back (Stats::CFE::NormMatrixElement (uint32_t(row), connectivity_value_type(gaussian_const1)));
         sum_weights += connectivity_value_type(gaussian_const1);
 
@@ -363,26 +399,14 @@ void run() {
         for (auto i : smoothing_weights[row])
           i.normalise (norm_factor);
 
-        // Force deallocation of memory used for this fixel in the original matrix
-        std::map<uint32_t, Stats::CFE::connectivity>().swap (connectivity_matrix[fixel]);
-
-      } else {
-
-        // If fixel is not in the mask, tract_processor should never assign
-        //   any connections to it
-        assert (connectivity_matrix[fixel].empty());
-
       }
 
       progress++;
     }
   }
 
-  // The connectivity matrix is now in vector rather than matrix form;
-  //   throw out the structure holding the original data
-  // (Note however that all entries in the original structure should
-  //   have been deleted during the prior loop)
-  Stats::CFE::init_connectivity_matrix_type().swap (connectivity_matrix);
+  // The normalised matrix now holds all information required for enhancement
+  connectivity_matrix.reset();
 
 
   Header output_header (header);
@@ -430,6 +430,12 @@ void run ()
   }
 
 
+  // the input is read in the order in which it is stored on file, unless
+  // re-ordered using -coord (or overwritten in place as the output is written)
+  if (std::string (argument[1]) != std::string (argument[0]) && std::all_of (pos.begin(), pos.end(),
+        [] (const vector<int>& p) { return std::is_sorted (p.begin(), p.end()); }))
+    header_in.set_sequential_access();
+
   if (header_out.intensity_offset() == 0.0 && header_out.intensity_scale() == 1.0 && !header_out.datatype().is_floating_point()) {
     switch (header_out.datatype()() & DataType::Type) {
       case DataType::Bit:
@@ -346,7 +346,13 @@ void run ()
 
     const size_t axis = opt[0][0];
 
-    auto image_in = Header::open (argument[0]).get_image<value_type>().with_direct_io (axis);
+    // the input is read in the order in which it is stored, either while
+    // preloading it with the requested axis contiguous, or directly if it
+    // is already stored that way
+    auto header_in = Header::open (argument[0]);
+    if (output_path != std::string (argument[0]))
+      header_in.set_sequential_access();
+    auto image_in = header_in.get_image<value_type>().with_direct_io (axis);
 
     if (axis >= image_in.ndim())
       throw Exception ("Cannot perform operation along axis " + str (axis) + "; image only has " + str(image_in.ndim()) + " axes");
@@ -451,6 +457,9 @@ void run ()
       for (size_t i = 0; i != headers_in.size(); ++i) {
         assert (headers_in[i].valid());
         assert (headers_in[i].is_file_backed());
+        // each input is read in the order in which the first input is stored
+        if (Stride::order (headers_in[i], 0, header.ndim()) == Stride::order (header))
+          headers_in[i].set_sequential_access();
         kernel->process (headers_in[i]);
         ++progress;
       }
@@ -26,7 +26,6 @@
 #include "dwi/tractography/mapping/loader.h"
 #include "dwi/tractography/connectome/connectome.h"
 #include "dwi/tractography/connectome/metric.h"
-#include "dwi/tractography/connectome/mapper.h"
 #include "dwi/tractography/connectome/matrix.h"
 #include "dwi/tractography/connectome/tck2nodes.h"
 
@@ -71,7 +70,21 @@ void usage ()
     + Argument ("path").type_file_out()
 
   + Option ("vector", "output a vector representing connectivities from a given seed point to target nodes, "
-                      "rather than a matrix of node-node connectivities");
+                      "rather than a matrix of node-node connectivities")
+
+  + Option ("additional", "generate an additional connectome within the same pass through the tractogram, "
+                          "potentially using a different parcellation image and / or metric. "
+                          "The metric is specified as a comma-separated list of scalings to apply to each streamline contribution, "
+                          "from: length, invlength, invnodevol (as for the corresponding -scale_* options), "
+                          "or \"none\" to use no such scaling; "
+                          "the -scale_* options provided on the command line apply only to the primary connectome, "
+                          "with the exception of -scale_file, which applies to all connectomes. "
+                          "All other options (e.g. streamline assignment mechanism, edge statistic and matrix output options) "
+                          "apply to all connectomes; -out_assignments provides the assignments for the primary connectome only. "
+                          "This option can be used multiple times.").allow_multiple()
+    + Argument ("nodes_in").type_image_in()
+    + Argument ("metric").type_text()
+    + Argument ("connectome_out").type_file_out();
 
   REFERENCES
   + "If using the default streamline-parcel assignment mechanism (or -assignment_radial_search option): " // Internal
@@ -88,96 +101,153 @@ void usage ()
 
 
 
+// A parcellation image, along with the information about its contents
+//   that is required before and after connectome construction
+class Parcellation
+{ MEMALIGN(Parcellation)
+  public:
+    Parcellation (const std::string& path) :
+        path (path),
+        image (Image<node_t>::open (path)),
+        max_node_index (0)
+    {
+      // Find out how many segmented nodes there are, so the matrix can be pre-allocated
+      // Also check for node volume for all nodes
+      vector<uint32_t> node_volumes (1, 0);
+      for (auto i = Loop (image) (image); i; ++i) {
+        if (image.value() > max_node_index) {
+          max_node_index = image.value();
+          node_volumes.resize (max_node_index + 1, 0);
+        }
+        ++node_volumes[image.value()];
+      }
+
+      for (size_t i = 1; i != node_volumes.size(); ++i) {
+        if (!node_volumes[i])
+          missing_nodes.insert (i);
+      }
+      if (missing_nodes.size()) {
+        WARN ("The following nodes are missing from the parcellation image" + (path == std::string(argument[1]) ? std::string() : " \"" + path + "\"") + ":");
+        std::set<node_t>::iterator i = missing_nodes.begin();
+        std::string list = str(*i);
+        for (++i; i != missing_nodes.end(); ++i)
+          list += ", " + str(*i);
+        WARN (list);
+        WARN ("(This may indicate poor parcellation image preparation, use of incorrect or incomplete LUT file(s) in labelconvert, or very poor registration)");
+      }
+    }
+
+    const std::string path;
+    Image<node_t> image;
+    node_t max_node_index;
+    std::set<node_t> missing_nodes;
+    std::unique_ptr<Tck2nodes_base> tck2nodes;
+};
+
+
+
 template <typename T>
-void execute (Image<node_t>& node_image, const node_t max_node_index, const std::set<node_t>& missing_nodes)
+void execute (vector<std::unique_ptr<Parcellation>>& parcellations)
 {
   // Are we generating a matrix or a vector?
   const bool vector_output = get_options ("vector").size();
 
-  // Do we need to keep track of the nodes to which each streamline is
-  //   assigned, or would it be a waste of memory?
-  const bool track_assignments = get_options ("out_assignments").size();
-
-  // Get the metric, assignment mechanism & per-edge statistic for connectome construction
-  Metric metric;
-  Tractography::Connectome::setup_metric (metric, node_image);
-  std::unique_ptr<Tck2nodes_base> tck2nodes (load_assignment_mode (node_image));
+  // Get the assignment mechanism, metrics & per-edge statistic for connectome construction
+  for (auto& p : parcellations)
+    p->tck2nodes.reset (load_assignment_mode (p->image));
   auto opt = get_options ("stat_edge");
   const stat_edge statistic = opt.size() ? stat_edge(int(opt[0][0])) : stat_edge::SUM;
 
+  // The primary connectome is defined by the command-line arguments and -scale_* options;
+  //   any additional connectomes by the -additional option
+  auto additional = get_options ("additional");
+  vector<Parcellation*> nodes (1, parcellations.front().get());
+  vector<std::string> outputs (1, argument[2]);
+  vector<Metric> metrics (1 + additional.size());
+  Tractography::Connectome::setup_metric (metrics[0], parcellations.front()->image);
+  for (size_t i = 0; i != additional.size(); ++i) {
+    for (auto& p : parcellations) {
+      if (p->path == std::string (additional[i][0]))
+        nodes.push_back (p.get());
+    }
+    Tractography::Connectome::setup_metric (metrics[i+1], nodes.back()->image, additional[i][1]);
+    outputs.push_back (additional[i][2]);
+  }
+
   // Prepare for reading the track data
   Tractography::Properties properties;
-  Tractography::Reader<float> reader (argument[0], properties);
+  Tractography::MMapReader<float> reader (argument[0], properties);
 
   // Initialise classes in preparation for multi-threading
-  Mapping::TrackLoader loader (reader, properties["count"].empty() ? 0 : to<size_t>(properties["count"]), "Constructing connectome");
-  Tractography::Connectome::Mapper mapper (*tck2nodes, metric);
-  Tractography::Connectome::Matrix<T> connectome (max_node_index, statistic, vector_output, track_assignments);
-
-  // Multi-threaded connectome construction
-  if (tck2nodes->provides_pair()) {
-    Thread::run_queue (
-        loader,
-        Thread::batch (Tractography::Streamline<float>()),
-        Thread::multi (mapper),
-        Thread::batch (Mapped_track_nodepair()),
-        connectome);
-  } else {
-    Thread::run_queue (
-        loader,
-        Thread::batch (Tractography::Streamline<float>()),
-        Thread::multi (mapper),
-        Thread::batch (Mapped_track_nodelist()),
-        connectome);
+  Mapping::ParallelTrackLoader loader (reader, properties["count"].empty() ? 0 : to<size_t>(properties["count"]), "Constructing connectome" + std::string (outputs.size() > 1 ? "s" : ""));
+  vector<std::unique_ptr<Tractography::Connectome::Matrix<T>>> connectomes;
+  for (auto p : nodes)
+    connectomes.emplace_back (new Tractography::Connectome::Matrix<T> (p->max_node_index, statistic, vector_output));
+
+  // Multi-threaded connectome construction: each thread accumulates into its
+  //   own matrices, and these are merged once all streamlines have been processed;
+  //   if requested, streamline assignments are written to file as they are generated
+  {
+    MatrixWorker<T> worker (*connectomes[0], *nodes[0]->tck2nodes, metrics[0]);
+    for (size_t i = 1; i != connectomes.size(); ++i)
+      worker.add (*connectomes[i], *nodes[i]->tck2nodes, metrics[i]);
+    opt = get_options ("out_assignments");
+    if (opt.size()) {
+      WriteAssignments writer (opt[0][0], vector_output);
+      if (nodes[0]->tck2nodes->provides_pair()) {
+        Mapping::Ordered<Mapped_track_nodepair, WriteAssignments> ordered_writer (writer);
+        Thread::run_queue (
+            Thread::multi (loader),
+            Thread::batch (Tractography::Streamline<float>()),
+            Thread::multi (worker),
+            Thread::batch (Mapped_track_nodepair()),
+            ordered_writer);
+      } else {
+        Mapping::Ordered<Mapped_track_nodelist, WriteAssignments> ordered_writer (writer);
+        Thread::run_queue (
+            Thread::multi (loader),
+            Thread::batch (Tractography::Streamline<float>()),
+            Thread::multi (worker),
+            Thread::batch (Mapped_track_nodelist()),
+            ordered_writer);
+      }
+    } else {
+      Thread::run_queue (
+          Thread::multi (loader),
+          Thread::batch (Tractography::Streamline<float>()),
+          Thread::multi (worker));
+    }
   }
 
-  connectome.finalize();
-  connectome.error_check (missing_nodes);
-
-  connectome.save (argument[2], get_options ("keep_unassigned").size(), get_options ("symmetric").size(), get_options ("zero_diagonal").size());
-
-  opt = get_options ("out_assignments");
-  if (opt.size())
-    connectome.write_assignments (opt[0][0]);
+  for (size_t i = 0; i != connectomes.size(); ++i) {
+    connectomes[i]->finalize();
+    connectomes[i]->error_check (nodes[i]->missing_nodes);
+    connectomes[i]->save (outputs[i], get_options ("keep_unassigned").size(), get_options ("symmetric").size(), get_options ("zero_diagonal").size());
+  }
 }
 
 
 
 void run ()
 {
-  auto node_image = Image<node_t>::open (argument[1]);
-
-  // First, find out how many segmented nodes there are, so the matrix can be pre-allocated
-  // Also check for node volume for all nodes
-  vector<uint32_t> node_volumes (1, 0);
-  node_t max_node_index = 0;
-  for (auto i = Loop (node_image) (node_image); i; ++i) {
-    if (node_image.value() > max_node_index) {
-      max_node_index = node_image.value();
-      node_volumes.resize (max_node_index + 1, 0);
-    }
-    ++node_volumes[node_image.value()];
-  }
-
-  std::set<node_t> missing_nodes;
-  for (size_t i = 1; i != node_volumes.size(); ++i) {
-    if (!node_volumes[i])
-      missing_nodes.insert (i);
-  }
-  if (missing_nodes.size()) {
-    WARN ("The following nodes are missing from the parcellation image:");
-    std::set<node_t>::iterator i = missing_nodes.begin();
-    std::string list = str(*i);
-    for (++i; i != missing_nodes.end(); ++i)
-      list += ", " + str(*i);
-    WARN (list);
-    WARN ("(This may indicate poor parcellation image preparation, use of incorrect or incomplete LUT file(s) in labelconvert, or very poor registration)");
+  // Each distinct parcellation image is only loaded once
+  vector<std::unique_ptr<Parcellation>> parcellations;
+  parcellations.emplace_back (new Parcellation (argument[1]));
+  for (const auto& i : get_options ("additional")) {
+    bool loaded = false;
+    for (const auto& p : parcellations)
+      loaded = loaded || (p->path == std::string (i[0]));
+    if (!loaded)
+      parcellations.emplace_back (new Parcellation (i[0]));
   }
 
+  node_t max_node_index = 0;
+  for (const auto& p : parcellations)
+    max_node_index = std::max (max_node_index, p->max_node_index);
   if (max_node_index >= node_count_ram_limit) {
     INFO ("Very large number of nodes detected; using single-precision floating-point storage");
-    execute<float> (node_image, max_node_index, missing_nodes);
+    execute<float> (parcellations);
   } else {
-    execute<double> (node_image, max_node_index, missing_nodes);
+    execute<double> (parcellations);
   }
 }
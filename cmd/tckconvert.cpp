@@ -36,7 +36,7 @@ void usage ()
   SYNOPSIS = "Convert between different track file formats";
 
   DESCRIPTION
-  + "The program currently supports MRtrix .tck files (input/output), "
+  + "The program currently supports MRtrix .tck and compressed .tckz files (input/output), "
     "ascii text files (input/output), VTK polydata files (input/output), "
     "and RenderMan RIB (export only)."
 
@@ -646,7 +646,7 @@ void run ()
     // Reader
     Properties properties;
     std::unique_ptr<ReaderInterface<float> > reader;
-    if (has_suffix(argument[0], ".tck")) {
+    if (has_suffix(argument[0], ".tck") || has_suffix(argument[0], ".tckz")) {
         reader.reset( new Reader<float>(argument[0], properties) );
     }
     else if (has_suffix(argument[0], ".txt")) {
@@ -662,7 +662,7 @@ void run ()
 
     // Writer
     std::unique_ptr<WriterInterface<float> > writer;
-    if (has_suffix(argument[1], ".tck")) {
+    if (has_suffix(argument[1], ".tck") || has_suffix(argument[1], ".tckz")) {
         writer.reset( new Writer<float>(argument[1], properties) );
     }
     else if (has_suffix(argument[1], ".vtk")) {
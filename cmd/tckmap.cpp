@@ -30,6 +30,7 @@
 #include "dwi/tractography/mapping/loader.h"
 #include "dwi/tractography/mapping/mapper.h"
 #include "dwi/tractography/mapping/mapping.h"
+#include "dwi/tractography/mapping/tiles.h"
 #include "dwi/tractography/mapping/voxel.h"
 #include "dwi/tractography/mapping/writer.h"
 
@@ -147,7 +148,14 @@ const OptionGroup MappingOption = OptionGroup ("Options for the streamline-to-vo
       "(these lengths are then taken into account during TWI calculation)")
 
   + Option ("ends_only",
-      "only map the streamline endpoints to the image");
+      "only map the streamline endpoints to the image")
+
+  + Option ("tile_size",
+      "map streamlines into the output image one tile at a time, where each tile spans (up to) "
+      "this many voxels along each spatial axis; the memory required then depends on the tile "
+      "size rather than the dimensions of the output image, at the expense of mapping those "
+      "streamlines that span multiple tiles more than once")
+    + Argument ("voxels").type_integer (1);
 
 
 
@@ -165,7 +173,9 @@ SYNOPSIS = "Use track data as a form of contrast for producing a high-resolution
 DESCRIPTION
   + "Note: if you run into limitations with RAM usage, make sure you output the "
     "results to a .mif file or .mih / .dat file pair - this will avoid the allocation "
-    "of an additional buffer to store the output for write-out.";
+    "of an additional buffer to store the output for write-out. For very high-resolution "
+    "and/or multi-volume (e.g. -dec, -dixel or -tod) output images, the -tile_size option "
+    "can be used to avoid holding the whole image in memory.";
 
 REFERENCES
   + "* For TDI or DEC TDI:\n"
@@ -221,20 +231,20 @@ OPTIONS
 
 
 
-MapWriterBase* make_writer (Header& H, const std::string& name, const vox_stat_t stat_vox, const writer_dim dim)
+MapWriterBase* make_writer (Header& H, const std::string& name, const vox_stat_t stat_vox, const writer_dim dim, const bool tiled)
 {
   MapWriterBase* writer = nullptr;
   const uint8_t dt = uint8_t(H.datatype()()) & DataType::Type;
   if (dt == DataType::Bit)
-    writer = new MapWriter<bool>     (H, name, stat_vox, dim);
+    writer = new MapWriter<bool>     (H, name, stat_vox, dim, tiled);
   else if (dt == DataType::UInt8)
-    writer = new MapWriter<uint8_t>  (H, name, stat_vox, dim);
+    writer = new MapWriter<uint8_t>  (H, name, stat_vox, dim, tiled);
   else if (dt == DataType::UInt16)
-    writer = new MapWriter<uint16_t> (H, name, stat_vox, dim);
+    writer = new MapWriter<uint16_t> (H, name, stat_vox, dim, tiled);
   else if (dt == DataType::UInt32 || dt == DataType::UInt64)
-    writer = new MapWriter<uint32_t> (H, name, stat_vox, dim);
+    writer = new MapWriter<uint32_t> (H, name, stat_vox, dim, tiled);
   else if (dt == DataType::Float32 || dt == DataType::Float64)
-    writer = new MapWriter<float>    (H, name, stat_vox, dim);
+    writer = new MapWriter<float>    (H, name, stat_vox, dim, tiled);
   else
     throw Exception ("Unsupported data type in image header");
   return writer;
@@ -247,6 +257,42 @@ MapWriterBase* make_writer (Header& H, const std::string& name, const vox_stat_t
 
 
 
+// Map all streamlines provided by the loader into the writer
+void map_tracks (ParallelTrackLoader& loader, TrackMapperTWI& mapper, const tck_stat_t stat_tck, const writer_dim writer_type, MapWriterBase& writer)
+{
+  // Each mapping thread accumulates its streamlines into its own partial map;
+  //   these are combined into the output buffer once all streamlines have been mapped
+  MapAccumulator accumulator (writer);
+
+  // Complete branch here for Gaussian track-wise statistic; it's a nightmare to manage, so am
+  //   keeping the code as separate as possible
+  if (stat_tck == GAUSSIAN) {
+    Gaussian::TrackMapper& gaussian_mapper = dynamic_cast<Gaussian::TrackMapper&> (mapper);
+    switch (writer_type) {
+      case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
+      case GREYSCALE: Thread::run_queue (Thread::multi (loader), Thread::batch (Tractography::Streamline<float>()), Thread::multi (gaussian_mapper), Thread::batch (Gaussian::SetVoxel()),    Thread::multi (accumulator)); break;
+      case DEC:       Thread::run_queue (Thread::multi (loader), Thread::batch (Tractography::Streamline<float>()), Thread::multi (gaussian_mapper), Thread::batch (Gaussian::SetVoxelDEC()), Thread::multi (accumulator)); break;
+      case DIXEL:     Thread::run_queue (Thread::multi (loader), Thread::batch (Tractography::Streamline<float>()), Thread::multi (gaussian_mapper), Thread::batch (Gaussian::SetDixel()),    Thread::multi (accumulator)); break;
+      case TOD:       Thread::run_queue (Thread::multi (loader), Thread::batch (Tractography::Streamline<float>()), Thread::multi (gaussian_mapper), Thread::batch (Gaussian::SetVoxelTOD()), Thread::multi (accumulator)); break;
+    }
+  } else {
+    switch (writer_type) {
+      case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
+      case GREYSCALE: Thread::run_queue (Thread::multi (loader), Thread::batch (Tractography::Streamline<float>()), Thread::multi (mapper), Thread::batch (SetVoxel()),    Thread::multi (accumulator)); break;
+      case DEC:       Thread::run_queue (Thread::multi (loader), Thread::batch (Tractography::Streamline<float>()), Thread::multi (mapper), Thread::batch (SetVoxelDEC()), Thread::multi (accumulator)); break;
+      case DIXEL:     Thread::run_queue (Thread::multi (loader), Thread::batch (Tractography::Streamline<float>()), Thread::multi (mapper), Thread::batch (SetDixel()),    Thread::multi (accumulator)); break;
+      case TOD:       Thread::run_queue (Thread::multi (loader), Thread::batch (Tractography::Streamline<float>()), Thread::multi (mapper), Thread::batch (SetVoxelTOD()), Thread::multi (accumulator)); break;
+    }
+  }
+}
+
+
+
+
+
+
+
+
 DataType determine_datatype (const DataType current_dt, const contrast_t contrast, const DataType default_dt, const bool precise)
 {
   if (current_dt == DataType::Undefined) {
@@ -264,7 +310,7 @@ DataType determine_datatype (const DataType current_dt, const contrast_t contras
 void run () {
 
   Tractography::Properties properties;
-  Tractography::Reader<float> file (argument[0], properties);
+  Tractography::MMapReader<float> file (argument[0], properties);
 
   const size_t num_tracks = properties["count"].empty() ? 0 : to<size_t> (properties["count"]);
 
@@ -555,7 +601,6 @@ void run () {
 
 
   // Start initialising members for multi-threaded calculation
-  TrackLoader loader (file, num_tracks);
 
   std::unique_ptr<TrackMapperTWI> mapper ((stat_tck == GAUSSIAN) ? (new Gaussian::TrackMapper (header, contrast)) : (new TrackMapperTWI (header, contrast, stat_tck)));
   mapper->set_upsample_ratio      (upsample_ratio);
@@ -592,39 +637,45 @@ void run () {
     header.keyval()["twi_vector_file"] = Path::basename (path);
   }
 
+  if (stat_tck == GAUSSIAN)
+    dynamic_cast<Gaussian::TrackMapper*>(mapper.get())->set_gaussian_FWHM (gaussian_fwhm_tck);
+
+  const size_t tile_size = get_option_value ("tile_size", size_t(0));
+  const bool tiled = tile_size;
+
   std::unique_ptr<MapWriterBase> writer;
   switch (writer_type) {
     case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
-    case GREYSCALE: writer.reset (make_writer           (header, argument[1], stat_vox, GREYSCALE)); break;
-    case DEC:       writer.reset (new MapWriter<float>  (header, argument[1], stat_vox, DEC));       break;
-    case DIXEL:     writer.reset (make_writer           (header, argument[1], stat_vox, DIXEL));     break;
-    case TOD:       writer.reset (new MapWriter<float>  (header, argument[1], stat_vox, TOD));       break;
+    case GREYSCALE: writer.reset (make_writer           (header, argument[1], stat_vox, GREYSCALE, tiled)); break;
+    case DEC:       writer.reset (new MapWriter<float>  (header, argument[1], stat_vox, DEC,       tiled)); break;
+    case DIXEL:     writer.reset (make_writer           (header, argument[1], stat_vox, DIXEL,     tiled)); break;
+    case TOD:       writer.reset (new MapWriter<float>  (header, argument[1], stat_vox, TOD,       tiled)); break;
   }
 
   // Finally get to do some number crunching!
-  // Complete branch here for Gaussian track-wise statistic; it's a nightmare to manage, so am
-  //   keeping the code as separate as possible
-  if (stat_tck == GAUSSIAN) {
-    Gaussian::TrackMapper* const mapper_ptr = dynamic_cast<Gaussian::TrackMapper*>(mapper.get());
-    mapper_ptr->set_gaussian_FWHM (gaussian_fwhm_tck);
-    switch (writer_type) {
-      case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
-      case GREYSCALE: Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxel()),    *writer); break;
-      case DEC:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxelDEC()), *writer); break;
-      case DIXEL:     Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetDixel()),    *writer); break;
-      case TOD:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxelTOD()), *writer); break;
+  if (tiled) {
+    // Only those streamlines that may intersect each tile are mapped into it,
+    //   and each tile is written to the output image once complete
+    TileGrid tiles (header, tile_size);
+    tiles.bin (file, num_tracks);
+    ProgressBar progress ("mapping tracks to image tiles", tiles.size());
+    for (size_t n = 0; n != tiles.size(); ++n) {
+      writer->set_tile (tiles.from (n), tiles.extent (n));
+      if (tiles.streamlines (n).size()) {
+        ParallelTrackLoader loader (file, tiles.streamlines (n));
+        map_tracks (loader, *mapper, stat_tck, writer_type, *writer);
+      }
+      tiles.clear (n);
+      writer->finalise();
+      ++progress;
     }
   } else {
-    switch (writer_type) {
-      case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
-      case GREYSCALE: Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper), Thread::batch (SetVoxel()),    *writer); break;
-      case DEC:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper), Thread::batch (SetVoxelDEC()), *writer); break;
-      case DIXEL:     Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper), Thread::batch (SetDixel()),    *writer); break;
-      case TOD:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper), Thread::batch (SetVoxelTOD()), *writer); break;
+    {
+      ParallelTrackLoader loader (file, num_tracks);
+      map_tracks (loader, *mapper, stat_tck, writer_type, *writer);
     }
+    writer->finalise();
   }
-
-  writer->finalise();
 }
 
 
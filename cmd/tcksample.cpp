@@ -22,6 +22,7 @@
 #include "dwi/tractography/file.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/scalar_file.h"
+#include "dwi/tractography/mapping/loader.h"
 #include "dwi/tractography/mapping/mapper.h"
 #include "file/ofstream.h"
 #include "file/path.h"
@@ -409,38 +410,39 @@ class Receiver_NoStatistic : private ReceiverBase { MEMALIGN(Receiver_NoStatisti
 
 
 template <class InterpType>
-void execute_nostat (DWI::Tractography::Reader<value_type>& reader,
+void execute_nostat (DWI::Tractography::MMapReader<value_type>& reader,
                      const DWI::Tractography::Properties& properties,
                      const size_t num_tracks,
                      Image<value_type>& image,
                      const std::string& path)
 {
   MR::copy_ptr<TDI> no_tdi;
+  DWI::Tractography::Mapping::ParallelTrackLoader loader (reader, 0, "");
   SamplerNonPrecise<InterpType> sampler (image, stat_tck::NONE, no_tdi);
   Receiver_NoStatistic receiver (path, num_tracks, properties);
-  DWI::Tractography::Streamline<value_type> tck;
-  std::pair<size_t, vector_type> values;
-  size_t counter = 0;
-  while (reader (tck)) {
-    sampler (tck, values);
-    receiver (values);
-    ++counter;
-  }
-  if (counter != num_tracks)
-    WARN ("Expected " + str(num_tracks) + " tracks based on header; read " + str(counter));
+  // Sampled values must be written in the order of the input streamlines
+  DWI::Tractography::Mapping::Ordered<std::pair<size_t, vector_type>, Receiver_NoStatistic> ordered_receiver (receiver);
+  Thread::run_queue (Thread::multi (loader),
+                     Thread::batch (DWI::Tractography::Streamline<value_type>()),
+                     Thread::multi (sampler),
+                     Thread::batch (std::pair<size_t, vector_type>()),
+                     ordered_receiver);
+  if (reader.size() != num_tracks)
+    WARN ("Expected " + str(num_tracks) + " tracks based on header; read " + str(reader.size()));
 }
 
 template <class SamplerType>
-void execute (DWI::Tractography::Reader<value_type>& reader,
+void execute (DWI::Tractography::MMapReader<value_type>& reader,
               const size_t num_tracks,
               Image<value_type>& image,
               const stat_tck statistic,
               MR::copy_ptr<TDI>& tdi,
               const std::string& path)
 {
+  DWI::Tractography::Mapping::ParallelTrackLoader loader (reader, 0, "");
   SamplerType sampler (image, statistic, tdi);
   Receiver_Statistic receiver (num_tracks);
-  Thread::run_queue (reader,
+  Thread::run_queue (Thread::multi (loader),
                      Thread::batch (DWI::Tractography::Streamline<value_type>()),
                      Thread::multi (sampler),
                      Thread::batch (std::pair<size_t, value_type>()),
@@ -453,7 +455,7 @@ void execute (DWI::Tractography::Reader<value_type>& reader,
 void run ()
 {
   DWI::Tractography::Properties properties;
-  DWI::Tractography::Reader<value_type> reader (argument[0], properties);
+  DWI::Tractography::MMapReader<value_type> reader (argument[0], properties);
   auto H = Header::open (argument[1]);
   auto image = H.get_image<value_type>();
 
@@ -475,11 +477,11 @@ void run ()
   if (get_options ("use_tdi_fraction").size()) {
     if (statistic == stat_tck::NONE)
       throw Exception ("Cannot use -use_tdi_fraction option unless a per-streamline statistic is used");
-    DWI::Tractography::Reader<value_type> tdi_reader (argument[0], properties);
+    DWI::Tractography::Mapping::ParallelTrackLoader tdi_loader (reader, 0, "");
     DWI::Tractography::Mapping::TrackMapperBase mapper (H);
     mapper.set_use_precise_mapping (interp == interp_type::PRECISE);
     tdi.reset (new TDI (H, num_tracks));
-    Thread::run_queue (tdi_reader,
+    Thread::run_queue (Thread::multi (tdi_loader),
                        Thread::batch (DWI::Tractography::Streamline<value_type>()),
                        Thread::multi (mapper),
                        Thread::batch (DWI::Tractography::Mapping::SetVoxel()),
@@ -31,6 +31,137 @@ namespace MR
         }
     };
 
+
+
+    // detect whether an image type provides the fetch_row() / store_row()
+    // methods for bulk access to a run of voxels:
+    template <class ImageType>
+      struct has_fetch_row { NOMEMALIGN
+        template <class T> static auto test (int) -> decltype (std::declval<const T&>().fetch_row (size_t(0), (typename T::value_type*) nullptr, size_t(0)), std::true_type());
+        template <class T> static std::false_type test (...);
+        static constexpr bool value = decltype (test<ImageType> (0))::value;
+      };
+
+    template <class ImageType>
+      struct has_store_row { NOMEMALIGN
+        template <class T> static auto test (int) -> decltype (std::declval<T&>().store_row (size_t(0), (const typename T::value_type*) nullptr, size_t(0)), std::true_type());
+        template <class T> static std::false_type test (...);
+        static constexpr bool value = decltype (test<ImageType> (0))::value;
+      };
+
+    template <class ImageType>
+      FORCE_INLINE typename std::enable_if<has_fetch_row<ImageType>::value, void>::type
+      __fetch_row (ImageType& image, size_t axis, typename ImageType::value_type* data, size_t count) {
+        image.fetch_row (axis, data, count);
+      }
+
+    template <class ImageType>
+      inline typename std::enable_if<!has_fetch_row<ImageType>::value, void>::type
+      __fetch_row (ImageType& image, size_t axis, typename ImageType::value_type* data, size_t count) {
+        for (size_t n = 0; n < count; ++n, ++image.index (axis))
+          data[n] = image.value();
+        image.index (axis) -= count;
+      }
+
+    template <class ImageType>
+      FORCE_INLINE typename std::enable_if<has_store_row<ImageType>::value, void>::type
+      __store_row (ImageType& image, size_t axis, const typename ImageType::value_type* data, size_t count) {
+        image.store_row (axis, data, count);
+      }
+
+    template <class ImageType>
+      inline typename std::enable_if<!has_store_row<ImageType>::value, void>::type
+      __store_row (ImageType& image, size_t axis, const typename ImageType::value_type* data, size_t count) {
+        for (size_t n = 0; n < count; ++n, ++image.index (axis))
+          image.value() = data[n];
+        image.index (axis) -= count;
+      }
+
+
+
+    // copy an entire row along the innermost axis per call, converting the
+    // data in bulk where the image types support it:
+    template <class InputImageType, class OutputImageType>
+      struct __copy_row_func { MEMALIGN (__copy_row_func<InputImageType,OutputImageType>)
+        __copy_row_func (const InputImageType& in, const OutputImageType& out, const vector<size_t>& outer_axes, size_t axis) :
+          in (in), out (out), outer_axes (outer_axes), axis (axis) { }
+
+        InputImageType in;
+        OutputImageType out;
+        const vector<size_t> outer_axes;
+        const size_t axis;
+
+        void operator() (const Iterator& pos) {
+          using in_type = typename InputImageType::value_type;
+          using out_type = typename OutputImageType::value_type;
+          constexpr ssize_t chunk = 256;
+          in_type in_values [chunk];
+          out_type out_values [chunk];
+
+          assign_pos_of (pos, outer_axes).to (in, out);
+          const ssize_t size = in.size (axis);
+          for (ssize_t n = 0; n < size; n += chunk) {
+            in.index (axis) = n;
+            out.index (axis) = n;
+            const size_t count = std::min (chunk, size - n);
+            __fetch_row (in, axis, in_values, count);
+            for (size_t i = 0; i < count; ++i)
+              out_values[i] = in_values[i];
+            __store_row (out, axis, out_values, count);
+          }
+        }
+    };
+
+
+
+    template <class InputImageType, class OutputImageType>
+      inline typename std::enable_if<is_data_type<typename InputImageType::value_type>::value && 
+                                     is_data_type<typename OutputImageType::value_type>::value, bool>::type
+      __threaded_copy_rows (
+          const std::string& progress_message, 
+          InputImageType& source, 
+          OutputImageType& destination, 
+          const vector<size_t>& axes)
+      {
+        const vector<size_t> inner_axes (1, axes[0]);
+        const vector<size_t> outer_axes (axes.begin()+1, axes.end());
+        __copy_row_func<InputImageType,OutputImageType> copy_row (source, destination, outer_axes, axes[0]);
+        if (progress_message.size())
+          ThreadedLoop (progress_message, source, outer_axes, inner_axes).run_outer (copy_row);
+        else
+          ThreadedLoop (source, outer_axes, inner_axes).run_outer (copy_row);
+        check_app_exit_code();
+        return true;
+      }
+
+    // class types are copied voxel by voxel:
+    template <class InputImageType, class OutputImageType>
+      inline typename std::enable_if<!is_data_type<typename InputImageType::value_type>::value || 
+                                     !is_data_type<typename OutputImageType::value_type>::value, bool>::type
+      __threaded_copy_rows (const std::string&, InputImageType&, OutputImageType&, const vector<size_t>&) { return false; }
+
+
+
+    template <class InputImageType, class OutputImageType>
+      inline void __threaded_copy (
+          const std::string& progress_message, 
+          InputImageType& source, 
+          OutputImageType& destination, 
+          const vector<size_t>& axes,
+          size_t num_axes_in_thread) 
+      {
+        if (num_axes_in_thread == 1 && axes.size() > 1)
+          if (__threaded_copy_rows (progress_message, source, destination, axes))
+            return;
+
+        if (progress_message.size())
+          ThreadedLoop (progress_message, source, axes, num_axes_in_thread)
+            .run (__copy_func(), source, destination);
+        else
+          ThreadedLoop (source, axes, num_axes_in_thread)
+            .run (__copy_func(), source, destination);
+      }
+
   }
 
   //! \endcond
@@ -45,8 +176,7 @@ namespace MR
         const vector<size_t>& axes,
         size_t num_axes_in_thread = 1) 
     {
-      ThreadedLoop (source, axes, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (std::string(), source, destination, axes, num_axes_in_thread);
     }
 
   template <class InputImageType, class OutputImageType>
@@ -57,8 +187,7 @@ namespace MR
         size_t to_axis = std::numeric_limits<size_t>::max(),
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (source, from_axis, to_axis, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (std::string(), source, destination, Stride::order (source, from_axis, to_axis), num_axes_in_thread);
     }
 
 
@@ -72,8 +201,7 @@ namespace MR
         const vector<size_t>& axes,
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (message, source, axes, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (message, source, destination, axes, num_axes_in_thread);
     }
 
   template <class InputImageType, class OutputImageType>
@@ -85,8 +213,7 @@ namespace MR
         size_t to_axis = std::numeric_limits<size_t>::max(), 
         size_t num_axes_in_thread = 1)
     {
-      ThreadedLoop (message, source, from_axis, to_axis, num_axes_in_thread)
-        .run (__copy_func(), source, destination);
+      __threaded_copy (message, source, destination, Stride::order (source, from_axis, to_axis), num_axes_in_thread);
     }
 
 
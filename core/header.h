@@ -291,6 +291,14 @@ namespace MR
 
       bool is_file_backed () const { return valid() ? io->is_file_backed() : false; }
 
+      //! indicate that the image data will be read once, in the order in which they are stored
+      /*! This permits compressed images to be decompressed progressively into a
+       * bounded buffer, rather than being loaded into RAM in their entirety.
+       * It must be invoked prior to get_image(), and is ignored for images
+       * opened read-write. Data can still be accessed in any order, but
+       * access that does not follow the order on file may be very slow. */
+      void set_sequential_access () { if (io) io->set_sequential_access (true); }
+
       //! make header self-consistent
       void sanitise () {
         DEBUG ("sanitising image information...");
@@ -82,6 +82,35 @@ namespace MR
 
         FORCE_INLINE bool is_direct_io () const { return data_pointer; }
 
+        //! read \a count consecutive voxel values along \a axis into \a data
+        /*! values are read starting from the current voxel location, which is
+         * left unchanged. For file-backed images that do not use direct IO,
+         * the datatype conversion is performed for the whole run in one call,
+         * which is considerably faster than repeated calls to value(). */
+        void fetch_row (size_t axis, ValueType* data, size_t count) const {
+          assert (get_index (axis) + ssize_t (count) <= size (axis));
+          if (data_pointer) {
+            size_t offset = data_offset;
+            for (size_t n = 0; n < count; ++n, offset += stride (axis))
+              data[n] = Raw::fetch_native<ValueType> (data_pointer, offset);
+          }
+          else
+            buffer->get_values (data_offset, stride (axis), count, data);
+        }
+
+        //! write \a count consecutive voxel values along \a axis from \a data
+        /*! \sa fetch_row() */
+        void store_row (size_t axis, const ValueType* data, size_t count) {
+          assert (get_index (axis) + ssize_t (count) <= size (axis));
+          if (data_pointer) {
+            size_t offset = data_offset;
+            for (size_t n = 0; n < count; ++n, offset += stride (axis))
+              Raw::store_native<ValueType> (data[n], data_pointer, offset);
+          }
+          else
+            buffer->set_values (data_offset, stride (axis), count, data);
+        }
+
         //! get voxel value at current location
       FORCE_INLINE ValueType get_value () const {
           if (data_pointer) return Raw::fetch_native<ValueType> (data_pointer, data_offset);
@@ -221,7 +250,8 @@ namespace MR
         Buffer& operator= (const Buffer&) = delete;
         Buffer& operator= (Buffer&&) = default;
         Buffer (const Buffer& b) : 
-          Header (b), fetch_func (b.fetch_func), store_func (b.store_func) { }
+          Header (b), fetch_func (b.fetch_func), store_func (b.store_func), 
+          fetch_row_func (b.fetch_row_func), store_row_func (b.store_row_func) { }
 
 
         FORCE_INLINE ValueType get_value (size_t offset) const {
@@ -234,17 +264,45 @@ namespace MR
           store_func (val, io->segment (nseg), offset - nseg*io->segment_size(), intensity_offset(), intensity_scale());
         }
 
+        //! fetch \a count values spaced \a stride apart, starting from \a offset
+        void get_values (size_t offset, ssize_t stride, size_t count, ValueType* data) const {
+          if (!count) return;
+          const size_t nseg = offset / io->segment_size();
+          if (nseg != (offset + stride*(count-1)) / io->segment_size()) {
+            // run spans multiple segments - fall back to per-voxel access:
+            for (size_t n = 0; n < count; ++n, offset += stride)
+              data[n] = get_value (offset);
+            return;
+          }
+          fetch_row_func (data, io->segment (nseg), offset - nseg*io->segment_size(), stride, count, intensity_offset(), intensity_scale());
+        }
+
+        //! store \a count values spaced \a stride apart, starting from \a offset
+        void set_values (size_t offset, ssize_t stride, size_t count, const ValueType* data) const {
+          if (!count) return;
+          const size_t nseg = offset / io->segment_size();
+          if (nseg != (offset + stride*(count-1)) / io->segment_size()) {
+            for (size_t n = 0; n < count; ++n, offset += stride)
+              set_value (offset, data[n]);
+            return;
+          }
+          store_row_func (data, io->segment (nseg), offset - nseg*io->segment_size(), stride, count, intensity_offset(), intensity_scale());
+        }
+
         std::unique_ptr<uint8_t[]> data_buffer;
         void* get_data_pointer ();
 
         FORCE_INLINE ImageIO::Base* get_io () const { return io.get(); }
 
       protected:
-        std::function<ValueType(const void*,size_t,default_type,default_type)> fetch_func;
-        std::function<void(ValueType,void*,size_t,default_type,default_type)> store_func;
+        FetchFunc<ValueType> fetch_func;
+        StoreFunc<ValueType> store_func;
+        FetchRowFunc<ValueType> fetch_row_func;
+        StoreRowFunc<ValueType> store_row_func;
 
         void set_fetch_store_functions () {
-          __set_fetch_store_functions (fetch_func, store_func, datatype());
+          const bool with_scaling = intensity_offset() != 0.0 || intensity_scale() != 1.0;
+          __set_fetch_store_functions (fetch_func, store_func, fetch_row_func, store_row_func, datatype(), with_scaling);
         }
     };
 
@@ -294,6 +352,17 @@ namespace MR
 
       FORCE_INLINE value_type get_value () const { return Raw::fetch_native<ValueType> (data, offset); } 
         FORCE_INLINE void set_value (ValueType val) { Raw::store_native<ValueType> (val, data, offset); }
+
+        void fetch_row (size_t axis, ValueType* values, size_t count) const {
+          size_t o = offset;
+          for (size_t n = 0; n < count; ++n, o += stride (axis))
+            values[n] = Raw::fetch_native<ValueType> (data, o);
+        }
+        void store_row (size_t axis, const ValueType* values, size_t count) {
+          size_t o = offset;
+          for (size_t n = 0; n < count; ++n, o += stride (axis))
+            Raw::store_native<ValueType> (values[n], data, o);
+        }
       };
     
     CHECK_MEM_ALIGN (TmpImage<float>);
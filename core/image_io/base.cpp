@@ -25,7 +25,8 @@ namespace MR
     Base::Base (const Header& header) : 
       segsize (voxel_count (header)),
       is_new (false),
-      writable (false) { }
+      writable (false),
+      sequential_access (false) { }
 
 
     Base::~Base () { }
@@ -71,10 +71,19 @@ namespace MR
           if (!is_new) 
             writable = readwrite;
         }
+        //! indicate that the image data will be read in the order in which they are stored
+        /*! Handlers that would otherwise need to hold the entire image in RAM
+         * (i.e. compressed images) may then load the data one segment at a
+         * time into a bounded buffer. Data may still be accessed in any order,
+         * but this may be considerably slower. Must be invoked prior to
+         * open(), and only applies to existing images opened read-only. */
+        void set_sequential_access (bool sequential) {
+          sequential_access = sequential;
+        }
 
         uint8_t* segment (size_t n) const {
           assert (n < addresses.size());
-          return addresses[n].get();
+          return addresses[n] ? addresses[n].get() : fetch (n);
         }
         size_t nsegments () const {
           return addresses.size();
@@ -102,13 +111,16 @@ namespace MR
       protected:
         size_t segsize;
         vector<std::unique_ptr<uint8_t[]>> addresses;
-        bool is_new, writable;
+        bool is_new, writable, sequential_access;
 
         void check () const {
           assert (addresses.size());
         }
         virtual void load (const Header& header, size_t buffer_size) = 0;
         virtual void unload (const Header& header) = 0;
+        // invoked by segment() for any segment whose address is not set; only
+        // needs to be implemented by handlers that load segments on demand
+        virtual uint8_t* fetch (size_t) const { assert (0); return nullptr; }
     };
 
   }
@@ -96,44 +96,109 @@ namespace MR
 
 
 
-    // for single-byte types:
+    // byte order handling, for single-byte, little-endian and big-endian types:
 
-    template <typename RAMType, typename DiskType> 
+    struct ByteAccess { NOMEMALIGN
+      template <typename DiskType> static FORCE_INLINE DiskType fetch (const void* data, size_t i) { return Raw::fetch<DiskType> (data, i); }
+      template <typename DiskType> static FORCE_INLINE void store (DiskType val, void* data, size_t i) { Raw::store<DiskType> (val, data, i); }
+    };
+
+    struct LEAccess { NOMEMALIGN
+      template <typename DiskType> static FORCE_INLINE DiskType fetch (const void* data, size_t i) { return Raw::fetch_LE<DiskType> (data, i); }
+      template <typename DiskType> static FORCE_INLINE void store (DiskType val, void* data, size_t i) { Raw::store_LE<DiskType> (val, data, i); }
+    };
+
+    struct BEAccess { NOMEMALIGN
+      template <typename DiskType> static FORCE_INLINE DiskType fetch (const void* data, size_t i) { return Raw::fetch_BE<DiskType> (data, i); }
+      template <typename DiskType> static FORCE_INLINE void store (DiskType val, void* data, size_t i) { Raw::store_BE<DiskType> (val, data, i); }
+    };
+
+
+
+    // the conversion itself, with or without intensity scaling. Without
+    // scaling, the offset & scale are compile-time constants, giving results
+    // identical to the scaled version with offset 0 and scale 1, but allowing
+    // the compiler to remove the redundant operations:
+
+    template <typename RAMType, typename DiskType, class Access, bool scaled>
+      struct Converter { NOMEMALIGN
+        static FORCE_INLINE RAMType fetch (const void* data, size_t i, default_type offset, default_type scale) {
+          return round_func<RAMType> (scale_from_storage (Access::template fetch<DiskType> (data, i), scaled ? offset : 0.0, scaled ? scale : 1.0));
+        }
+        static FORCE_INLINE void store (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
+          Access::template store<DiskType> (round_func<DiskType> (scale_to_storage (val, scaled ? offset : 0.0, scaled ? scale : 1.0)), data, i);
+        }
+      };
+
+
+
+    template <typename RAMType, typename DiskType, class Access, bool scaled> 
       RAMType __fetch (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch<DiskType> (data, i), offset, scale)); 
+        return Converter<RAMType,DiskType,Access,scaled>::fetch (data, i, offset, scale);
       }
 
-    template <typename RAMType, typename DiskType> 
+    template <typename RAMType, typename DiskType, class Access, bool scaled> 
       void __store (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i); 
+        Converter<RAMType,DiskType,Access,scaled>::store (val, data, i, offset, scale);
       }
 
-    // for little-endian multi-byte types:
-
-    template <typename RAMType, typename DiskType> 
-      RAMType __fetch_LE (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch_LE<DiskType> (data, i), offset, scale));
+    // bulk conversion of a run of values, so that the indirect function call
+    // is only incurred once per run, and the inner loop can be inlined (and
+    // potentially vectorised) for each combination of types:
+
+    template <typename RAMType, typename DiskType, class Access, bool scaled> 
+      void __fetch_row (RAMType* dest, const void* data, size_t i, ssize_t stride, size_t count, default_type offset, default_type scale) {
+        if (stride == 1) {
+          for (size_t n = 0; n < count; ++n)
+            dest[n] = Converter<RAMType,DiskType,Access,scaled>::fetch (data, i+n, offset, scale);
+        }
+        else {
+          for (size_t n = 0; n < count; ++n, i += stride)
+            dest[n] = Converter<RAMType,DiskType,Access,scaled>::fetch (data, i, offset, scale);
+        }
       }
 
-    template <typename RAMType, typename DiskType> 
-      void __store_LE (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store_LE<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+    template <typename RAMType, typename DiskType, class Access, bool scaled> 
+      void __store_row (const RAMType* src, void* data, size_t i, ssize_t stride, size_t count, default_type offset, default_type scale) {
+        if (stride == 1) {
+          for (size_t n = 0; n < count; ++n)
+            Converter<RAMType,DiskType,Access,scaled>::store (src[n], data, i+n, offset, scale);
+        }
+        else {
+          for (size_t n = 0; n < count; ++n, i += stride)
+            Converter<RAMType,DiskType,Access,scaled>::store (src[n], data, i, offset, scale);
+        }
       }
 
 
-    // for big-endian multi-byte types:
 
-    template <typename RAMType, typename DiskType> 
-      RAMType __fetch_BE (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch_BE<DiskType> (data, i), offset, scale));
+    template <typename RAMType, typename DiskType, class Access, bool scaled>
+      inline void __set (
+          FetchFunc<RAMType>& fetch_func,
+          StoreFunc<RAMType>& store_func, 
+          FetchRowFunc<RAMType>& fetch_row_func,
+          StoreRowFunc<RAMType>& store_row_func)
+      {
+        fetch_func = __fetch<RAMType,DiskType,Access,scaled>;
+        store_func = __store<RAMType,DiskType,Access,scaled>;
+        fetch_row_func = __fetch_row<RAMType,DiskType,Access,scaled>;
+        store_row_func = __store_row<RAMType,DiskType,Access,scaled>;
       }
 
-    template <typename RAMType, typename DiskType> 
-      void __store_BE (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store_BE<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+    template <typename RAMType, typename DiskType, class Access>
+      inline void __set (
+          FetchFunc<RAMType>& fetch_func,
+          StoreFunc<RAMType>& store_func, 
+          FetchRowFunc<RAMType>& fetch_row_func,
+          StoreRowFunc<RAMType>& store_row_func, 
+          bool with_scaling)
+      {
+        if (with_scaling)
+          __set<RAMType,DiskType,Access,true> (fetch_func, store_func, fetch_row_func, store_row_func);
+        else
+          __set<RAMType,DiskType,Access,false> (fetch_func, store_func, fetch_row_func, store_row_func);
       }
 
-
   }
 
 
@@ -142,106 +207,58 @@ namespace MR
 
   template <typename ValueType>
     typename std::enable_if<is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
-        std::function<ValueType(const void*,size_t,default_type,default_type)>& fetch_func,
-        std::function<void(ValueType,void*,size_t,default_type,default_type)>& store_func, 
-        DataType datatype) {
+        FetchFunc<ValueType>& fetch_func,
+        StoreFunc<ValueType>& store_func, 
+        FetchRowFunc<ValueType>& fetch_row_func,
+        StoreRowFunc<ValueType>& store_row_func, 
+        DataType datatype,
+        bool with_scaling) {
+
+#define __SET(DiskType, Access) \
+      __set<ValueType,DiskType,Access> (fetch_func, store_func, fetch_row_func, store_row_func, with_scaling); \
+      return
 
       switch (datatype()) {
-        case DataType::Bit:
-          fetch_func = __fetch<ValueType,bool>;
-          store_func = __store<ValueType,bool>;
-          return;
-        case DataType::Int8:
-          fetch_func = __fetch<ValueType,int8_t>;
-          store_func = __store<ValueType,int8_t>;
-          return;
-        case DataType::UInt8:
-          fetch_func = __fetch<ValueType,uint8_t>;
-          store_func = __store<ValueType,uint8_t>;
-          return;
-        case DataType::Int16LE:
-          fetch_func = __fetch_LE<ValueType,int16_t>;
-          store_func = __store_LE<ValueType,int16_t>;
-          return;
-        case DataType::UInt16LE:
-          fetch_func = __fetch_LE<ValueType,uint16_t>;
-          store_func = __store_LE<ValueType,uint16_t>;
-          return;
-        case DataType::Int16BE:
-          fetch_func = __fetch_BE<ValueType,int16_t>;
-          store_func = __store_BE<ValueType,int16_t>;
-          return;
-        case DataType::UInt16BE:
-          fetch_func = __fetch_BE<ValueType,uint16_t>;
-          store_func = __store_BE<ValueType,uint16_t>;
-          return;
-        case DataType::Int32LE:
-          fetch_func = __fetch_LE<ValueType,int32_t>;
-          store_func = __store_LE<ValueType,int32_t>;
-          return;
-        case DataType::UInt32LE:
-          fetch_func = __fetch_LE<ValueType,uint32_t>;
-          store_func = __store_LE<ValueType,uint32_t>;
-          return;
-        case DataType::Int32BE:
-          fetch_func = __fetch_BE<ValueType,int32_t>;
-          store_func = __store_BE<ValueType,int32_t>;
-          return;
-        case DataType::UInt32BE:
-          fetch_func = __fetch_BE<ValueType,uint32_t>;
-          store_func = __store_BE<ValueType,uint32_t>;
-          return;
-        case DataType::Int64LE:
-          fetch_func = __fetch_LE<ValueType,int64_t>;
-          store_func = __store_LE<ValueType,int64_t>;
-          return;
-        case DataType::UInt64LE:
-          fetch_func = __fetch_LE<ValueType,uint64_t>;
-          store_func = __store_LE<ValueType,uint64_t>;
-          return;
-        case DataType::Int64BE:
-          fetch_func = __fetch_BE<ValueType,int64_t>;
-          store_func = __store_BE<ValueType,int64_t>;
-          return;
-        case DataType::UInt64BE:
-          fetch_func = __fetch_BE<ValueType,uint64_t>;
-          store_func = __store_BE<ValueType,uint64_t>;
-          return;
-        case DataType::Float32LE:
-          fetch_func = __fetch_LE<ValueType,float>;
-          store_func = __store_LE<ValueType,float>;
-          return;
-        case DataType::Float32BE:
-          fetch_func = __fetch_BE<ValueType,float>;
-          store_func = __store_BE<ValueType,float>;
-          return;
-        case DataType::Float64LE:
-          fetch_func = __fetch_LE<ValueType,double>;
-          store_func = __store_LE<ValueType,double>;
-          return;
-        case DataType::Float64BE:
-          fetch_func = __fetch_BE<ValueType,double>;
-          store_func = __store_BE<ValueType,double>;
-          return;
-        case DataType::CFloat32LE:
-          fetch_func = __fetch_LE<ValueType,cfloat>;
-          store_func = __store_LE<ValueType,cfloat>;
-          return;
-        case DataType::CFloat32BE:
-          fetch_func = __fetch_BE<ValueType,cfloat>;
-          store_func = __store_BE<ValueType,cfloat>;
-          return;
-        case DataType::CFloat64LE:
-          fetch_func = __fetch_LE<ValueType,cdouble>;
-          store_func = __store_LE<ValueType,cdouble>;
-          return;
-        case DataType::CFloat64BE:
-          fetch_func = __fetch_BE<ValueType,cdouble>;
-          store_func = __store_BE<ValueType,cdouble>;
-          return;
+        case DataType::Bit: __SET (bool, ByteAccess);
+        case DataType::Int8: __SET (int8_t, ByteAccess);
+        case DataType::UInt8: __SET (uint8_t, ByteAccess);
+        case DataType::Int16LE: __SET (int16_t, LEAccess);
+        case DataType::UInt16LE: __SET (uint16_t, LEAccess);
+        case DataType::Int16BE: __SET (int16_t, BEAccess);
+        case DataType::UInt16BE: __SET (uint16_t, BEAccess);
+        case DataType::Int32LE: __SET (int32_t, LEAccess);
+        case DataType::UInt32LE: __SET (uint32_t, LEAccess);
+        case DataType::Int32BE: __SET (int32_t, BEAccess);
+        case DataType::UInt32BE: __SET (uint32_t, BEAccess);
+        case DataType::Int64LE: __SET (int64_t, LEAccess);
+        case DataType::UInt64LE: __SET (uint64_t, LEAccess);
+        case DataType::Int64BE: __SET (int64_t, BEAccess);
+        case DataType::UInt64BE: __SET (uint64_t, BEAccess);
+        case DataType::Float32LE: __SET (float, LEAccess);
+        case DataType::Float32BE: __SET (float, BEAccess);
+        case DataType::Float64LE: __SET (double, LEAccess);
+        case DataType::Float64BE: __SET (double, BEAccess);
+        case DataType::CFloat32LE: __SET (cfloat, LEAccess);
+        case DataType::CFloat32BE: __SET (cfloat, BEAccess);
+        case DataType::CFloat64LE: __SET (cdouble, LEAccess);
+        case DataType::CFloat64BE: __SET (cdouble, BEAccess);
         default:
           throw Exception ("invalid data type in image header");
       }
+
+#undef __SET
+    }
+
+
+
+  template <typename ValueType>
+    typename std::enable_if<is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
+        FetchFunc<ValueType>& fetch_func,
+        StoreFunc<ValueType>& store_func, 
+        DataType datatype) {
+      FetchRowFunc<ValueType> fetch_row_func;
+      StoreRowFunc<ValueType> store_row_func;
+      __set_fetch_store_functions (fetch_func, store_func, fetch_row_func, store_row_func, datatype, true);
     }
 
 #undef MRTRIX_EXTERN
@@ -249,5 +266,3 @@ namespace MR
   __DEFINE_FETCH_STORE_FUNCTIONS;
 
 }
-
-
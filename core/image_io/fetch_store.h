@@ -22,19 +22,59 @@
 namespace MR
 {
 
+  //! \cond skip
+
+  // function pointer types used to convert individual values between their
+  // on-disk and in-RAM representations:
+  template <typename ValueType>
+    using FetchFunc = ValueType (*) (const void* data, size_t offset, default_type intensity_offset, default_type intensity_scale);
+  template <typename ValueType>
+    using StoreFunc = void (*) (ValueType val, void* data, size_t offset, default_type intensity_offset, default_type intensity_scale);
+
+  // function pointer types used to convert a run of \a count values, spaced
+  // \a stride elements apart, between their on-disk and in-RAM representations
+  // in a single call:
+  template <typename ValueType>
+    using FetchRowFunc = void (*) (ValueType* dest, const void* data, size_t offset, ssize_t stride, size_t count, default_type intensity_offset, default_type intensity_scale);
+  template <typename ValueType>
+    using StoreRowFunc = void (*) (const ValueType* src, void* data, size_t offset, ssize_t stride, size_t count, default_type intensity_offset, default_type intensity_scale);
+
+
 
   template <typename ValueType>
     typename std::enable_if<!is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
-        std::function<ValueType(const void*,size_t,default_type,default_type)>& /*fetch_func*/,
-        std::function<void(ValueType,void*,size_t,default_type,default_type)>& /*store_func*/, 
+        FetchFunc<ValueType>& /*fetch_func*/,
+        StoreFunc<ValueType>& /*store_func*/, 
+        FetchRowFunc<ValueType>& /*fetch_row_func*/,
+        StoreRowFunc<ValueType>& /*store_row_func*/, 
+        DataType /*datatype*/, 
+        bool /*with_scaling*/) { }
+
+  template <typename ValueType>
+    typename std::enable_if<!is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
+        FetchFunc<ValueType>& /*fetch_func*/,
+        StoreFunc<ValueType>& /*store_func*/, 
         DataType /*datatype*/) { }
 
 
 
+  // the conversion functions are selected once, based on the datatype,
+  // its byte order, and whether intensity scaling needs to be applied.
+  // If \a with_scaling is false, the intensity offset & scale parameters
+  // passed to the functions will be ignored.
   template <typename ValueType>
     typename std::enable_if<is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
-        std::function<ValueType(const void*,size_t,default_type,default_type)>& fetch_func,
-        std::function<void(ValueType,void*,size_t,default_type,default_type)>& store_func, 
+        FetchFunc<ValueType>& fetch_func,
+        StoreFunc<ValueType>& store_func, 
+        FetchRowFunc<ValueType>& fetch_row_func,
+        StoreRowFunc<ValueType>& store_row_func, 
+        DataType datatype,
+        bool with_scaling);
+
+  template <typename ValueType>
+    typename std::enable_if<is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
+        FetchFunc<ValueType>& fetch_func,
+        StoreFunc<ValueType>& store_func, 
         DataType datatype);
 
 
@@ -42,9 +82,16 @@ namespace MR
   // to avoid massive recompile times...
 #define __DEFINE_FETCH_STORE_FUNCTION_FOR_TYPE(ValueType) \
   MRTRIX_EXTERN template void __set_fetch_store_functions<ValueType> ( \
-      std::function<ValueType(const void*,size_t,default_type,default_type)>& fetch_func, \
-        std::function<void(ValueType,void*,size_t,default_type,default_type)>& store_func, \
-        DataType datatype) 
+      FetchFunc<ValueType>& fetch_func, \
+      StoreFunc<ValueType>& store_func, \
+      FetchRowFunc<ValueType>& fetch_row_func, \
+      StoreRowFunc<ValueType>& store_row_func, \
+      DataType datatype, \
+      bool with_scaling); \
+  MRTRIX_EXTERN template void __set_fetch_store_functions<ValueType> ( \
+      FetchFunc<ValueType>& fetch_func, \
+      StoreFunc<ValueType>& store_func, \
+      DataType datatype) 
 
 #define __DEFINE_FETCH_STORE_FUNCTIONS \
   __DEFINE_FETCH_STORE_FUNCTION_FOR_TYPE(bool); \
@@ -65,9 +112,8 @@ namespace MR
 #define MRTRIX_EXTERN extern
   __DEFINE_FETCH_STORE_FUNCTIONS;
 
+  //! \endcond
+
 }
 
 #endif
-
-
-
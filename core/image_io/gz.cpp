@@ -13,13 +13,23 @@
  */
 
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <limits>
+#include <map>
+#include <mutex>
 
 #include "app.h"
 #include "progressbar.h"
 #include "header.h"
+#include "raw.h"
+#include "stride.h"
+#include "thread_queue.h"
 #include "image_io/gz.h"
 #include "file/gz.h"
+#include "file/mmap.h"
+#include "file/ofstream.h"
 
 #define BYTES_PER_ZCALL 524288
 
@@ -28,6 +38,447 @@ namespace MR
   namespace ImageIO
   {
 
+    namespace
+    {
+
+      // Compressed images are written as a series of gzip members, each holding
+      //   at most block_size bytes of the uncompressed stream; the concatenation
+      //   of gzip members is itself a valid gzip file, so these files remain
+      //   readable by any other software. Each member header carries an extra
+      //   field (subfield ID "MR"; see RFC 1952) holding the total size of the
+      //   member and its uncompressed size, as 32-bit little-endian integers. This
+      //   permits the members to be located without decompression, such that
+      //   both compression and decompression can be performed multi-threaded.
+      //   Files without this extra field are decompressed sequentially. Members
+      //   are compressed independently, so the block size is a trade-off between
+      //   compression ratio and the granularity of parallelisation.
+      constexpr size_t block_size = 8 * BYTES_PER_ZCALL;
+      constexpr size_t member_header_size = 24;
+      constexpr size_t member_tailer_size = 8;
+
+      class Block
+      { NOMEMALIGN
+        public:
+          size_t index;
+          const uint8_t* data;
+          size_t size;
+      };
+
+      class CompressedBlock
+      { NOMEMALIGN
+        public:
+          size_t index, size;
+          vector<uint8_t> member;
+      };
+
+
+
+      class BlockCompressor
+      { NOMEMALIGN
+        public:
+          bool operator() (const Block& block, CompressedBlock& output) const
+          {
+            z_stream zs;
+            memset (&zs, 0, sizeof (zs));
+            // negative windowBits: raw deflate stream, gzip wrapper generated manually
+            if (deflateInit2 (&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+              throw Exception ("error initialising zlib compression");
+            const size_t bound = deflateBound (&zs, block.size);
+            output.index = block.index;
+            output.size = block.size;
+            output.member.resize (member_header_size + bound + member_tailer_size);
+            zs.next_in = const_cast<Bytef*> (block.data);
+            zs.avail_in = block.size;
+            zs.next_out = output.member.data() + member_header_size;
+            zs.avail_out = bound;
+            const int status = deflate (&zs, Z_FINISH);
+            const size_t compressed_size = zs.total_out;
+            deflateEnd (&zs);
+            if (status != Z_STREAM_END)
+              throw Exception ("error compressing image data");
+
+            output.member.resize (member_header_size + compressed_size + member_tailer_size);
+            uint8_t* header = output.member.data();
+            memset (header, 0, member_header_size);
+            header[0] = 0x1f; header[1] = 0x8b; // gzip magic number
+            header[2] = 8;                      // deflate
+            header[3] = 4;                      // FEXTRA flag
+            header[9] = 255;                    // unknown OS
+            Raw::store_LE<uint16_t> (12, header + 10);
+            header[12] = 'M'; header[13] = 'R';
+            Raw::store_LE<uint16_t> (8, header + 14);
+            Raw::store_LE<uint32_t> (output.member.size(), header + 16);
+            Raw::store_LE<uint32_t> (block.size, header + 20);
+            uint8_t* tailer = header + member_header_size + compressed_size;
+            Raw::store_LE<uint32_t> (crc32 (crc32 (0, Z_NULL, 0), block.data, block.size), tailer);
+            Raw::store_LE<uint32_t> (block.size, tailer + 4);
+            return true;
+          }
+      };
+
+
+
+      // Compress the concatenation of the memory regions provided
+      //   into the specified file, one gzip member per block
+      void compress (const std::string& path, const vector<std::pair<const uint8_t*,size_t>>& regions, ProgressBar& progress)
+      {
+        File::OFStream out (path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+        size_t region = 0, offset = 0, index = 0;
+        auto source = [&] (Block& block) {
+          while (region < regions.size() && offset == regions[region].second) {
+            ++region;
+            offset = 0;
+          }
+          if (region == regions.size())
+            return false;
+          block.index = index++;
+          block.data = regions[region].first + offset;
+          block.size = std::min (block_size, regions[region].second - offset);
+          offset += block.size;
+          return true;
+        };
+
+        // members may complete out of order; these are held until they can be written
+        size_t next = 0;
+        std::map<size_t, CompressedBlock> pending;
+        auto sink = [&] (CompressedBlock& block) {
+          pending[block.index] = std::move (block);
+          for (auto i = pending.begin(); i != pending.end() && i->first == next; i = pending.erase (i), ++next) {
+            out.write (reinterpret_cast<const char*> (i->second.member.data()), i->second.member.size());
+            for (size_t n = 0; n != i->second.size / BYTES_PER_ZCALL; ++n)
+              ++progress;
+          }
+          return true;
+        };
+
+        Thread::run_queue (source, Block(), Thread::multi (BlockCompressor()), CompressedBlock(), sink);
+        assert (pending.empty());
+
+        if (!out.good())
+          throw Exception ("error writing to GZ file \"" + path + "\": " + strerror (errno));
+      }
+
+
+
+
+      class Member
+      { NOMEMALIGN
+        public:
+          const uint8_t* data;
+          size_t compressed_size;
+          int64_t offset; // position of the first uncompressed byte within the stream
+          size_t size;
+      };
+
+      // Decompress the portion of each member that overlaps the target region
+      class MemberDecompressor
+      { NOMEMALIGN
+        public:
+          MemberDecompressor (const std::string& path, uint8_t* target, const int64_t start, const int64_t size) :
+              path (path), target (target), start (start), size (size) { }
+
+          bool operator() (const Member& member)
+          {
+            const bool contained = member.offset >= start && member.offset + int64_t(member.size) <= start + size;
+            if (!contained)
+              buffer.resize (member.size);
+            uint8_t* output = contained ? target + (member.offset - start) : buffer.data();
+
+            z_stream zs;
+            memset (&zs, 0, sizeof (zs));
+            if (inflateInit2 (&zs, -MAX_WBITS) != Z_OK)
+              throw Exception ("error initialising zlib decompression");
+            zs.next_in = const_cast<Bytef*> (member.data);
+            zs.avail_in = member.compressed_size;
+            zs.next_out = output;
+            zs.avail_out = member.size;
+            const int status = inflate (&zs, Z_FINISH);
+            const size_t decompressed_size = zs.total_out;
+            inflateEnd (&zs);
+
+            const uint8_t* tailer = member.data + member.compressed_size;
+            if (status != Z_STREAM_END || decompressed_size != member.size
+                || Raw::fetch_LE<uint32_t> (tailer + 4) != member.size
+                || Raw::fetch_LE<uint32_t> (tailer) != crc32 (crc32 (0, Z_NULL, 0), output, member.size))
+              throw Exception ("error uncompressing GZ file \"" + path + "\": data are corrupt");
+
+            if (!contained) {
+              const int64_t first = std::max (start, member.offset);
+              const int64_t last = std::min (start + size, member.offset + int64_t(member.size));
+              memcpy (target + (first - start), output + (first - member.offset), last - first);
+            }
+            return true;
+          }
+
+        private:
+          const std::string& path;
+          uint8_t* const target;
+          const int64_t start, size;
+          vector<uint8_t> buffer;
+      };
+
+
+
+      // The gzip members of a file written by compress(), located without
+      //   decompression; valid() returns false for any other file
+      class BlockFile
+      { NOMEMALIGN
+        public:
+          BlockFile (const std::string& path) :
+              path (path),
+              mmap (File::Entry (path))
+          {
+            const uint8_t* p = mmap.address();
+            const uint8_t* const end = p + mmap.size();
+            int64_t offset = 0;
+            while (p < end) {
+              if (end - p < int64_t(member_header_size + member_tailer_size)
+                  || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || p[3] != 4
+                  || Raw::fetch_LE<uint16_t> (p + 10) != 12
+                  || p[12] != 'M' || p[13] != 'R'
+                  || Raw::fetch_LE<uint16_t> (p + 14) != 8) {
+                members.clear();
+                return;
+              }
+              const size_t member_size = Raw::fetch_LE<uint32_t> (p + 16);
+              if (member_size < member_header_size + member_tailer_size || member_size > size_t (end - p)) {
+                members.clear();
+                return;
+              }
+              members.push_back ({ p + member_header_size, member_size - member_header_size - member_tailer_size, offset, Raw::fetch_LE<uint32_t> (p + 20) });
+              offset += members.back().size;
+              p += member_size;
+            }
+          }
+
+          bool valid () const { return members.size(); }
+
+          // Decompress size bytes, starting from position start within the
+          //   uncompressed stream, into target
+          void read (const int64_t start, uint8_t* target, const int64_t size, ProgressBar* progress = nullptr) const
+          {
+            assert (valid());
+            if (members.back().offset + int64_t(members.back().size) < start + size)
+              throw Exception ("unexpected end of file while uncompressing GZ file \"" + path + "\"");
+
+            auto member = members.begin();
+            auto source = [&] (Member& item) {
+              while (member != members.end() && member->offset + int64_t(member->size) <= start)
+                ++member;
+              if (member == members.end() || member->offset >= start + size)
+                return false;
+              item = *member++;
+              if (progress) {
+                for (size_t n = 0; n != item.size / BYTES_PER_ZCALL; ++n)
+                  ++(*progress);
+              }
+              return true;
+            };
+
+            Thread::run_queue (source, Member(), Thread::multi (MemberDecompressor (path, target, start, size)));
+          }
+
+        private:
+          const std::string path;
+          File::MMap mmap;
+          vector<Member> members;
+      };
+
+
+
+      constexpr size_t no_segment = std::numeric_limits<size_t>::max();
+      constexpr size_t idle_hazard = no_segment - 1;
+
+      // The hazards claimed by each thread from each GZ::Stream, released when
+      //   the thread exits (unless the stream has since been destroyed)
+      class ThreadHazards
+      { NOMEMALIGN
+        public:
+          class Entry
+          { NOMEMALIGN
+            public:
+              uint64_t stream_id;
+              std::weak_ptr<void> stream;
+              std::atomic<size_t>* hazard;
+          };
+
+          ~ThreadHazards ()
+          {
+            for (auto& entry : entries) {
+              auto stream = entry.stream.lock();
+              if (stream)
+                entry.hazard->store (no_segment);
+            }
+          }
+
+          vector<Entry> entries;
+      };
+
+      thread_local ThreadHazards thread_hazards;
+
+      std::atomic<uint64_t> stream_count (0);
+
+    }
+
+
+
+
+    // Progressive decompression of an image flagged for sequential access: each
+    //   segment is decompressed when first requested, into a ring of buffers
+    //   indexed by segment number. Since segment() provides a raw pointer that
+    //   the caller may use after the buffer has been recycled, each thread
+    //   publishes the segment that it is currently accessing (in effect a
+    //   hazard pointer); a buffer holding a segment published by any thread is
+    //   never overwritten, but is set aside and replaced with another buffer.
+    class GZ::Stream : public std::enable_shared_from_this<GZ::Stream>
+    { NOMEMALIGN
+      public:
+        Stream (const std::string& path, const int64_t start, const size_t segment_bytes, const size_t capacity) :
+            id (stream_count++),
+            path (path),
+            start (start),
+            segment_bytes (segment_bytes),
+            capacity (capacity),
+            slots (new Slot [capacity]),
+            position (-1)
+        {
+          blocks.reset (new BlockFile (path));
+          if (!blocks->valid()) {
+            blocks.reset();
+            gz.open (path, "rb");
+          }
+        }
+
+        uint8_t* get (const size_t n)
+        {
+          std::atomic<size_t>& hazard (thread_hazard());
+          if (hazard.load (std::memory_order_relaxed) != n)
+            hazard.store (n);
+          const Slot& slot (slots[n % capacity]);
+          if (slot.index.load() == n) {
+            uint8_t* data = slot.data.load();
+            if (slot.index.load() == n)
+              return data;
+          }
+          return load (n);
+        }
+
+      private:
+        class Slot
+        { NOMEMALIGN
+          public:
+            Slot () : index (no_segment), data (nullptr) { }
+            std::atomic<size_t> index;
+            std::atomic<uint8_t*> data;
+        };
+
+        const uint64_t id;
+        const std::string path;
+        const int64_t start;
+        const size_t segment_bytes, capacity;
+        std::unique_ptr<Slot[]> slots;
+        std::deque<std::atomic<size_t>> hazards;
+        vector<std::unique_ptr<uint8_t[]>> buffers;
+        vector<std::pair<size_t,uint8_t*>> retired;
+        std::unique_ptr<BlockFile> blocks;
+        File::GZ gz;
+        int64_t position;
+        std::mutex mutex;
+
+        std::atomic<size_t>& thread_hazard ()
+        {
+          for (const auto& entry : thread_hazards.entries) {
+            if (entry.stream_id == id)
+              return *entry.hazard;
+          }
+          std::lock_guard<std::mutex> lock (mutex);
+          std::atomic<size_t>* hazard = nullptr;
+          for (auto& h : hazards) {
+            size_t expected = no_segment;
+            if (h.compare_exchange_strong (expected, idle_hazard)) {
+              hazard = &h;
+              break;
+            }
+          }
+          if (!hazard) {
+            hazards.emplace_back (idle_hazard);
+            hazard = &hazards.back();
+          }
+          auto& entries (thread_hazards.entries);
+          entries.erase (std::remove_if (entries.begin(), entries.end(),
+                [] (const ThreadHazards::Entry& entry) { return entry.stream.expired(); }), entries.end());
+          entries.push_back ({ id, shared_from_this(), hazard });
+          return *hazard;
+        }
+
+        bool in_use (const size_t n) const
+        {
+          for (const auto& h : hazards) {
+            if (h.load() == n)
+              return true;
+          }
+          return false;
+        }
+
+        uint8_t* load (const size_t n)
+        {
+          std::lock_guard<std::mutex> lock (mutex);
+          Slot& slot (slots[n % capacity]);
+          if (slot.index.load() == n)
+            return slot.data.load();
+
+          const size_t previous = slot.index.exchange (no_segment);
+          uint8_t* data = slot.data.load();
+          if (data && previous != no_segment && in_use (previous)) {
+            retired.push_back ({ previous, data });
+            data = nullptr;
+          }
+          if (!data) {
+            for (auto i = retired.begin(); i != retired.end(); ++i) {
+              if (!in_use (i->first)) {
+                data = i->second;
+                retired.erase (i);
+                break;
+              }
+            }
+          }
+          if (!data) {
+            buffers.emplace_back (new uint8_t [segment_bytes]);
+            data = buffers.back().get();
+          }
+          slot.data.store (data);
+
+          read (n, data);
+          slot.index.store (n);
+          return data;
+        }
+
+        void read (const size_t n, uint8_t* data)
+        {
+          const int64_t offset = start + int64_t(n) * segment_bytes;
+          if (blocks) {
+            blocks->read (offset, data, segment_bytes);
+            return;
+          }
+          if (offset != position) {
+            if (offset < position)
+              DEBUG ("non-sequential access to image file \"" + path + "\"; uncompressing from start of file");
+            gz.seek (offset);
+          }
+          for (size_t remaining = segment_bytes; remaining;) {
+            const size_t count = std::min (remaining, size_t (BYTES_PER_ZCALL));
+            if (gz.read (reinterpret_cast<char*> (data), count) != int (count))
+              throw Exception ("unexpected end of file while uncompressing GZ file \"" + path + "\"");
+            data += count;
+            remaining -= count;
+          }
+          position = offset + segment_bytes;
+        }
+    };
+
+
+
     void GZ::load (const Header& header, size_t)
     {
       if (files.empty())
@@ -38,6 +489,22 @@ namespace MR
       if (files.size() * bytes_per_segment > std::numeric_limits<size_t>::max())
         throw Exception ("image \"" + header.name() + "\" is larger than maximum accessible memory");
 
+      if (sequential_access && !is_new && !writable && files.size() == 1) {
+        // segments span the axis stored slowest on file (e.g. each volume of a
+        // 4D image); enough of these are required for the buffer to be useful
+        const size_t capacity = 2 * (Thread::number_of_threads() + 1);
+        const size_t axis = Stride::order (header).back();
+        const size_t voxels_per_segment = segsize / header.size (axis);
+        if (size_t (header.size (axis)) >= 2 * capacity && !((header.datatype().bits() * voxels_per_segment) % 8)) {
+          segsize = voxels_per_segment;
+          bytes_per_segment = header.datatype().bits() * segsize / 8;
+          stream = std::make_shared<Stream> (files[0].name, files[0].start, bytes_per_segment, capacity);
+          addresses.resize (header.size (axis));
+          DEBUG ("image \"" + header.name() + "\" will be uncompressed progressively, " + str(capacity) + " segments of " + str(bytes_per_segment) + " bytes at a time");
+          return;
+        }
+      }
+
       DEBUG ("loading image \"" + header.name() + "\"...");
       addresses.resize (header.datatype().bits() == 1 && files.size() > 1 ? files.size() : 1);
       addresses[0].reset (new uint8_t [files.size() * bytes_per_segment]);
@@ -50,6 +517,12 @@ namespace MR
         ProgressBar progress ("uncompressing image \"" + header.name() + "\"",
             files.size() * bytes_per_segment / BYTES_PER_ZCALL);
         for (size_t n = 0; n < files.size(); n++) {
+          const BlockFile blocks (files[n].name);
+          if (blocks.valid()) {
+            blocks.read (files[n].start, addresses[0].get() + n*bytes_per_segment, bytes_per_segment, &progress);
+            continue;
+          }
+          DEBUG ("image file \"" + files[n].name + "\" is not block-compressed; uncompressing sequentially");
           File::GZ zf (files[n].name, "rb");
           zf.seek (files[n].start);
           uint8_t* address = addresses[0].get() + n*bytes_per_segment;
@@ -76,6 +549,12 @@ namespace MR
 
     void GZ::unload (const Header& header)
     {
+      if (stream) {
+        assert (!writable);
+        stream.reset();
+        return;
+      }
+
       if (addresses.size()) {
         assert (addresses[0]);
 
@@ -84,20 +563,10 @@ namespace MR
               files.size() * bytes_per_segment / BYTES_PER_ZCALL);
           for (size_t n = 0; n < files.size(); n++) {
             assert (files[n].start == int64_t (lead_in_size));
-            File::GZ zf (files[n].name, "wb");
-            if (lead_in)
-              zf.write (reinterpret_cast<const char*> (lead_in.get()), lead_in_size);
-            uint8_t* address = addresses[0].get() + n*bytes_per_segment;
-            uint8_t* last = address + bytes_per_segment - BYTES_PER_ZCALL;
-            while (address < last) {
-              zf.write (reinterpret_cast<const char*> (address), BYTES_PER_ZCALL);
-              address += BYTES_PER_ZCALL;
-              ++progress;
-            }
-            last += BYTES_PER_ZCALL;
-            zf.write (reinterpret_cast<const char*> (address), last - address);
-            if (lead_out)
-              zf.write (reinterpret_cast<const char*> (lead_out.get()), lead_out_size);
+            compress (files[n].name, {
+                { lead_in.get(), lead_in_size },
+                { addresses[0].get() + n*bytes_per_segment, bytes_per_segment },
+                { lead_out.get(), lead_out_size } }, progress);
           }
         }
 
@@ -106,8 +575,14 @@ namespace MR
 
 
 
+    uint8_t* GZ::fetch (size_t n) const
+    {
+      assert (stream);
+      return stream->get (n);
+    }
+
+
 
   }
 }
 
-
@@ -45,12 +45,16 @@ namespace MR
         }
 
       protected:
+        class Stream;
+
         int64_t  bytes_per_segment;
         size_t   lead_in_size, lead_out_size;
         std::unique_ptr<uint8_t[]> lead_in, lead_out;
+        std::shared_ptr<Stream> stream;
 
         virtual void load (const Header&, size_t);
         virtual void unload (const Header&);
+        virtual uint8_t* fetch (size_t n) const;
     };
 
   }
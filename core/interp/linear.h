@@ -244,8 +244,39 @@ namespace MR
           return coeff_matrix * factors;
         }
 
+        //! Read interpolated values from volumes along axis >= 3 into \a out
+        /*! This yields the same result as row(), without allocating memory
+         * for each call; \a out must already be of size ImageType::size(axis). */
+        template <class VectorType>
+        void row (size_t axis, VectorType&& out) {
+          assert (ssize_t (out.size()) == ImageType::size (axis));
+          if (Base<ImageType>::out_of_bounds) {
+            out.setConstant (Base<ImageType>::out_of_bounds_value);
+            return;
+          }
+
+          ssize_t c[] = { ssize_t (std::floor (P[0])), ssize_t (std::floor (P[1])), ssize_t (std::floor (P[2])) };
+
+          row_buffer.resize (ImageType::size (axis));
+          out.setZero();
+          ImageType::index (axis) = 0;
+          size_t i(0);
+          for (ssize_t z = 0; z < 2; ++z) {
+            ImageType::index(2) = clamp (c[2] + z, ImageType::size (2));
+            for (ssize_t y = 0; y < 2; ++y) {
+              ImageType::index(1) = clamp (c[1] + y, ImageType::size (1));
+              for (ssize_t x = 0; x < 2; ++x) {
+                ImageType::index(0) = clamp (c[0] + x, ImageType::size (0));
+                ImageType::fetch_row (axis, row_buffer.data(), row_buffer.size());
+                out += factors[i++] * row_buffer;
+              }
+            }
+          }
+        }
+
       protected:
         Eigen::Matrix<coef_type, 8, 1> factors;
+        Eigen::Matrix<value_type, Eigen::Dynamic, 1> row_buffer;
     };
 
 
@@ -433,13 +433,41 @@ namespace MR
                 ValueType c = c0 * cp - s0 * sp;
                 ValueType s = s0 * cp + c0 * sp;
                 for (int l = ( (m&1) ? m+1 : m); l <= lmax; l+=2)
-                  v += get (f,l,m) * (c * val[index (l,m)] + s * val[index (l,-m)]);
+                  v += get (f,l,m) * Math::sqrt2 * (c * val[index (l,m)] + s * val[index (l,-m)]);
                 c0 = c;
                 s0 = s;
               }
               return v;
             }
 
+          //! the SH basis for direction \a unit_dir, as used in value()
+          /*! The coefficients are written into \a dest such that the value of
+           * the SH series \a val along \a unit_dir is given by val.dot(dest);
+           * this permits the amplitudes of many SH series along many
+           * directions to be computed using vectorised matrix operations. */
+          template <class VectorType, class UnitVectorType>
+            void basis (VectorType&& dest, const UnitVectorType& unit_dir) const {
+              PrecomputedFraction<ValueType> f;
+              set (f, std::acos (unit_dir[2]));
+              ValueType rxy = std::sqrt ( pow2(unit_dir[1]) + pow2(unit_dir[0]) );
+              ValueType cp = (rxy) ? unit_dir[0]/rxy : 1.0;
+              ValueType sp = (rxy) ? unit_dir[1]/rxy : 0.0;
+              for (int l = 0; l <= lmax; l+=2)
+                dest[index (l,0)] = get (f,l,0);
+              ValueType c0 (1.0), s0 (0.0);
+              for (int m = 1; m <= lmax; m++) {
+                ValueType c = c0 * cp - s0 * sp;
+                ValueType s = s0 * cp + c0 * sp;
+                for (int l = ( (m&1) ? m+1 : m); l <= lmax; l+=2) {
+                  const ValueType al = get (f,l,m) * Math::sqrt2;
+                  dest[index (l,m)] = al * c;
+                  dest[index (l,-m)] = al * s;
+                }
+                c0 = c;
+                s0 = s;
+              }
+            }
+
         protected:
           int lmax, ndir, nAL;
           ValueType inc;
@@ -448,6 +476,117 @@ namespace MR
 
 
 
+      //! Precomputed SH basis - used to speed up SH amplitude evaluation
+      /*! This serves the same purpose as PrecomputedAL, but is organised for
+       * vectorised evaluation. For each of a set of regularly spaced
+       * elevations, the associated Legendre polynomials are stored (along with
+       * the normalisation of the m != 0 terms) contiguously in the same order
+       * as the SH coefficients themselves; the basis along any direction is
+       * then obtained by linear interpolation between two such columns,
+       * multiplied by the azimuthal terms. The amplitude of an SH series
+       * therefore involves only a handful of vectorised operations on
+       * contiguous data, rather than the nested loops over l and m.
+       *
+       * Since only even degrees are used, the basis is antipodally
+       * symmetric, and only elevations up to pi/2 need to be tabulated. The
+       * angular \a resolution (in degrees) sets the spacing of the
+       * tabulated elevations, and trades memory usage against accuracy.
+       *
+       * The amplitudes of many SH series along many directions can be
+       * computed using matrix operations, by gathering the basis for each
+       * direction using basis(). */
+      template <typename ValueType> class PrecomputedBasis
+      { MEMALIGN(PrecomputedBasis<ValueType>)
+        public:
+          using value_type = ValueType;
+          using matrix_type = Eigen::Matrix<ValueType,Eigen::Dynamic,Eigen::Dynamic>;
+          using vector_type = Eigen::Matrix<ValueType,Eigen::Dynamic,1>;
+
+          //! the default spacing of the tabulated elevations, in degrees
+          static default_type default_resolution () { return 0.25; }
+
+          PrecomputedBasis () : lmax (0), num_intervals (0), inc (0.0) { }
+          PrecomputedBasis (int up_to_lmax, default_type resolution = default_resolution()) {
+            init (up_to_lmax, resolution);
+          }
+
+          bool operator! () const {
+            return !table.size();
+          }
+          operator bool () const {
+            return table.size();
+          }
+
+          void init (int up_to_lmax, default_type resolution = default_resolution()) {
+            if (!(resolution > 0.0))
+              throw Exception ("angular resolution of precomputed SH basis must be positive");
+            lmax = up_to_lmax;
+            num_intervals = std::max (1, int (std::ceil (90.0 / resolution)));
+            inc = 0.5 * Math::pi / num_intervals;
+            table.resize (NforL (lmax), num_intervals+1);
+            Eigen::Matrix<default_type,Eigen::Dynamic,1,0,64> buf (lmax+1);
+            for (int n = 0; n <= num_intervals; ++n) {
+              const default_type cos_el = std::cos (n*inc);
+              for (int m = 0; m <= lmax; ++m) {
+                Legendre::Plm_sph (buf, lmax, m, cos_el);
+                for (int l = ( (m&1) ? m+1 : m); l <= lmax; l+=2) {
+                  table (index (l,m), n) = m ? Math::sqrt2 * buf[l] : buf[l];
+                  table (index (l,-m), n) = table (index (l,m), n);
+                }
+              }
+            }
+          }
+
+          int get_lmax () const { return lmax; }
+          size_t n_SH () const { return table.rows(); }
+
+          //! the value of the SH series \a val along \a unit_dir
+          template <class VectorType, class UnitVectorType>
+            ValueType value (const VectorType& val, const UnitVectorType& unit_dir) const {
+              Eigen::Matrix<ValueType,Eigen::Dynamic,1,0,256> buffer (n_SH());
+              basis (buffer, unit_dir);
+              return buffer.dot (val.head (n_SH()));
+            }
+
+          //! the SH basis for direction \a unit_dir, as used in value()
+          /*! The coefficients are written into \a dest such that the value of
+           * the SH series \a val along \a unit_dir is given by val.dot(dest). */
+          template <class VectorType, class UnitVectorType>
+            void basis (VectorType&& dest, const UnitVectorType& unit_dir) const {
+              // Map onto the upper hemisphere
+              const ValueType sign = unit_dir[2] < 0.0 ? -1.0 : 1.0;
+              ValueType f = std::acos (std::min (ValueType(1.0), sign * ValueType(unit_dir[2]))) / inc;
+              const int n = std::min (int (f), num_intervals-1);
+              f -= n;
+              const ValueType rxy = std::sqrt ( pow2(unit_dir[1]) + pow2(unit_dir[0]) );
+              const ValueType cp = (rxy) ? sign*unit_dir[0]/rxy : 1.0;
+              const ValueType sp = (rxy) ? sign*unit_dir[1]/rxy : 0.0;
+              Eigen::Matrix<ValueType,Eigen::Dynamic,1,0,64> c (lmax+1), s (lmax+1);
+              c[0] = 1.0;
+              s[0] = 0.0;
+              for (int m = 1; m <= lmax; m++) {
+                c[m] = c[m-1] * cp - s[m-1] * sp;
+                s[m] = s[m-1] * cp + c[m-1] * sp;
+              }
+              auto out = dest.head (n_SH());
+              for (int l = 0; l <= lmax; l+=2) {
+                out[index (l,0)] = 1.0;
+                for (int m = 1; m <= l; m++) {
+                  out[index (l,m)] = c[m];
+                  out[index (l,-m)] = s[m];
+                }
+              }
+              out.array() *= ((ValueType(1.0)-f) * table.col (n) + f * table.col (n+1)).array();
+            }
+
+        protected:
+          int lmax, num_intervals;
+          ValueType inc;
+          matrix_type table;
+      };
+
+
+
 
 
 
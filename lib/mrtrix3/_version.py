@@ -0,0 +1 @@
+__version__ = "40a11df0"
@@ -27,6 +27,31 @@ namespace MR {
     namespace Tractography {
       namespace GT {
         
+        namespace {
+          // Coefficients of the polynomial in x^2 equal to sum_l c[l/2] P_l(x), for even l
+          Eigen::VectorXd legendre2poly (const Eigen::VectorXd& c)
+          {
+            const int lmax = 2 * (c.size() - 1);
+            vector<Eigen::VectorXd> P (lmax+1, Eigen::VectorXd::Zero (lmax+1));
+            P[0][0] = 1.0;
+            if (lmax > 0)
+              P[1][1] = 1.0;
+            for (int l = 2; l <= lmax; l++) {
+              for (int i = 1; i <= l; i++)
+                P[l][i] = (2*l-1) * P[l-1][i-1] / l;
+              P[l] -= (l-1) * P[l-2] / double(l);
+            }
+            Eigen::VectorXd poly = Eigen::VectorXd::Zero (c.size());
+            for (int l = 0; l <= lmax; l += 2) {
+              for (int i = 0; i <= l; i += 2)
+                poly[i/2] += c[l/2] * P[l][i];
+            }
+            return poly;
+          }
+        }
+        
+        
+        
         ExternalEnergyComputer::ExternalEnergyComputer(Stats& stat, const Image<float>& dwimage, const Properties& props)
           : EnergyComputer(stat),
             dwi(dwimage),
@@ -49,6 +74,9 @@ namespace MR {
             WARN("No isotropic response functions provided; using single-tissue white matter model.");
           }
           
+          header.size(3) = dwimage.size(3);
+          res = Image<float>::scratch(header, "signal residual");
+          
           header.ndim() = 3;
           eext = Image<float>::scratch(header, "external energy");
           
@@ -66,6 +94,8 @@ namespace MR {
           
           K.resize(nrows, ncols);
           K.setZero();
+          Kdir.resize(nrows, 3);
+          Kpoly.resize(nrows, lmax/2+1);
           Ak.resize(nrows, nf+1);
           Ak.setZero();
           
@@ -92,6 +122,14 @@ namespace MR {
               Math::SH::delta(delta_vec, unit_dir, lmax);
               Math::SH::sconv(delta_vec, wmr_rh, delta_vec);
               K.row(r) = delta_vec;
+              // Kdir, Kpoly: by the addition theorem, the signal of a segment with direction u
+              //   in measurement r is sum_l RH_l (2l+1)/(4pi) P_l(g_r.u), i.e. a polynomial in
+              //   (g_r.u)^2; a zero vector is treated as [1 0 0], as in Math::SH::delta()
+              Kdir.row(r) = (n > 0.0) ? unit_dir.transpose() : Eigen::RowVector3d (1.0, 0.0, 0.0);
+              Eigen::VectorXd wmr_band (lmax/2+1);
+              for (int l = 0; l <= lmax; l += 2)
+                wmr_band[l/2] = (l/2 < wmr_rh.size() ? wmr_rh[l/2] : 0.0) * (2*l+1) / (4.0*Math::pi);
+              Kpoly.row(r) = legendre2poly (wmr_band);
               // Ak
               Ak(r,0) = wmr0;
               for (size_t j = 0; j < props.resp_ISO.size(); j++)
@@ -99,11 +137,14 @@ namespace MR {
             }
           }
           K *= props.weight;
+          Kpoly *= props.weight;
           
           // Allocate temporary memory --------------------------------------------------
           y.resize(nrows);
           t.resize(ncols);
           d.resize(ncols);
+          kd.resize(nrows);
+          c2.resize(nrows);
           fk.resize(nf+1);
           
           // Set NNLS solver ------------------------------------------------------------
@@ -120,10 +161,12 @@ namespace MR {
           DEBUG("Reset external energy.");
           double e;
           dE = 0.0;
-          for (auto l = Loop(dwi, 0, 3) (dwi, tod, eext); l; ++l)
+          for (auto l = Loop(dwi, 0, 3) (dwi, tod, res, eext); l; ++l)
           {
-            y = dwi.row(3);
             t = tod.row(3);
+            y = dwi.row(3);
+            y.noalias() -= K * t;
+            res.row(3) = y;
             e = calcEnergy();
             eext.value() = e;
             dE += e;
@@ -140,14 +183,16 @@ namespace MR {
         void ExternalEnergyComputer::acceptChanges()
         {
           assert (changes_vox.size() == changes_tod.size());
+          assert (changes_vox.size() == changes_res.size());
           assert (changes_vox.size() == changes_eext.size());
           assert (!fiso.valid() || changes_vox.size() == changes_fiso.size());
 
           for (size_t k = 0; k != changes_vox.size(); ++k) 
           {
-            assign_pos_of(changes_vox[k], 0, 3).to(tod, eext);
+            assign_pos_of(changes_vox[k], 0, 3).to(tod, res, eext);
             assert(!is_out_of_bounds(tod, 0, 3));
             tod.row(3) = changes_tod[k];
+            res.row(3) = changes_res[k];
             eext.value() = changes_eext[k];
             if (fiso.valid()) {
               assign_pos_of(changes_vox[k], 0, 3).to(fiso);
@@ -163,6 +208,7 @@ namespace MR {
         {
           changes_vox.clear();
           changes_tod.clear();
+          changes_res.clear();
           changes_fiso.clear();
           changes_eext.clear();
           dE = 0.0;
@@ -175,7 +221,14 @@ namespace MR {
           Point_t v = Point_t(Math::floor<float>(p[0]), Math::floor<float>(p[1]), Math::floor<float>(p[2]));
           Point_t w = Point_t(hanning(p[0]-v[0]), hanning(p[1]-v[1]), hanning(p[2]-v[2]));
           
+          // The contributions of the segment to the TOD and to the predicted signal
+          //   are computed once, and subsequently scaled for each voxel; the latter
+          //   (equal to K * d) is evaluated from the tabulated polynomials
           Math::SH::delta(d, dir, lmax);
+          c2 = (Kdir * dir.cast<double>()).array().square();
+          kd = Kpoly.col(Kpoly.cols()-1);
+          for (ssize_t i = Kpoly.cols()-2; i >= 0; --i)
+            kd = kd.cwiseProduct(c2.matrix()) + Kpoly.col(i);
           
           Eigen::Vector3i x = v.cast<int>();
           add2vox(x, factor*(1.-w[0])*(1.-w[1])*(1.-w[2]));
@@ -203,30 +256,36 @@ namespace MR {
           assign_pos_of(vox, 0, 3).to(tod);
           if (is_out_of_bounds(tod, 0, 3))
             return;
-          t = w * d;
           for (size_t k = 0; k != changes_vox.size(); ++k) {
             if (changes_vox[k] == vox) {
-              changes_tod[k] += t;
+              changes_tod[k].noalias() += w * d;
+              changes_res[k].noalias() -= w * kd;
               return;
             }
           }
           changes_vox.push_back(vox);
-          t += tod.row(3);
+          t = tod.row(3);
+          t.noalias() += w * d;
           changes_tod.push_back(t);
+          assign_pos_of(vox, 0, 3).to(res);
+          y = res.row(3);
+          y.noalias() -= w * kd;
+          changes_res.push_back(y);
         }
         
         
         double ExternalEnergyComputer::eval()
         {
           assert (changes_vox.size() == changes_tod.size());
+          assert (changes_vox.size() == changes_res.size());
 
           dE = 0.0;
           double e;
           for (size_t k = 0; k != changes_vox.size(); ++k) 
           {
-            assign_pos_of(changes_vox[k], 0, 3).to(dwi, eext);
-            assert(!is_out_of_bounds(dwi, 0, 3));
-            y = dwi.row(3);
+            assign_pos_of(changes_vox[k], 0, 3).to(eext);
+            assert(!is_out_of_bounds(eext, 0, 3));
+            y = changes_res[k];
             t = changes_tod[k];
             e = calcEnergy();
             changes_fiso.push_back(fk.tail(nf));
@@ -238,9 +297,9 @@ namespace MR {
         }
 
         
+        // Requires y to contain the residual of the DWI signal after subtraction of the TOD signal
         double ExternalEnergyComputer::calcEnergy()
         {
-          y.noalias() -= K * t;
           Math::ICLS::Solver<double> nnls_solver (nnls);
           nnls_solver(fk, y);
           y.noalias() -= Ak.rightCols(nf) * fk.tail(nf);
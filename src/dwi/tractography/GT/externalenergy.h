@@ -76,6 +76,7 @@ namespace MR {
           Image<float> tod;
           Image<float> fiso;
           Image<float> eext;
+          Image<float> res;     // residual of the DWI signal after subtraction of the TOD signal, i.e. dwi - K * tod
           
           transform_type T;
           
@@ -83,12 +84,15 @@ namespace MR {
           size_t nrows, ncols, nf;
           double beta, mu, dE;
           Eigen::MatrixXd K, Ak;
-          Eigen::VectorXd y, t, d, fk;
+          Eigen::MatrixXd Kdir, Kpoly;   // gradient directions, and polynomial coefficients such that K * delta(u) can be evaluated from Kdir * u
+          Eigen::VectorXd y, t, d, kd, fk;
+          Eigen::ArrayXd c2;
           
           Math::ICLS::Problem<double> nnls;
           
           vector<Eigen::Vector3i > changes_vox;
           vector<Eigen::VectorXd > changes_tod;
+          vector<Eigen::VectorXd > changes_res;
           vector<Eigen::VectorXd > changes_fiso;
           vector<double> changes_eext;
           
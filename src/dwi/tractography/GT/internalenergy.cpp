@@ -56,13 +56,13 @@ namespace MR {
           for (int i = -1; i <= 1; i++) {
             for (int j = -1; j <= 1; j++) {
               for (int k = -1; k <= 1; k++) {
-                const ParticleGrid::ParticleVectorType* pvec = pGrid.at(x+i, y+j, z+k);
-                if (pvec == NULL)
+                const ParticleGrid::Cell* cell = pGrid.at(x+i, y+j, z+k);
+                if (cell == NULL)
                   continue;
                 
-                for (ParticleGrid::ParticleVectorType::const_iterator it = pvec->begin(); it != pvec->end(); ++it) 
+                for (Particle* par : *cell) 
                 {
-                  pe.par = *it;
+                  pe.par = par;
                   if (pe.par == p)
                     continue;
                   d1 = (ep - pe.par->getEndPoint(-1)).squaredNorm();
@@ -16,6 +16,8 @@
 #ifndef __gt_particle_h__
 #define __gt_particle_h__
 
+#include <atomic>
+
 #include "types.h"
 
 
@@ -39,7 +41,7 @@ namespace MR {
           
           // Constructors and destructor --------------------------------------------------
           
-          Particle()
+          Particle() : next(nullptr)
           {
             predecessor = nullptr;
             successor = nullptr;
@@ -47,7 +49,7 @@ namespace MR {
             alive = false;
           }
           
-          Particle(const Point_t& p, const Point_t& d)
+          Particle(const Point_t& p, const Point_t& d) : next(nullptr)
           {
             init(p, d);
           }
@@ -76,13 +78,11 @@ namespace MR {
             alive = false;
           }
 
-          // disable copy and assignment
+          // disable copy, move and assignment: particles are referenced by address
           Particle(const Particle&) = delete;
           Particle& operator=(const Particle&) = delete;
-          
-          // default move constructor and assignment
-          Particle(Particle&&) = default;
-          Particle& operator=(Particle&&) = default;
+          Particle(Particle&&) = delete;
+          Particle& operator=(Particle&&) = delete;
 
           
           // Getters and setters ----------------------------------------------------------
@@ -199,6 +199,10 @@ namespace MR {
           bool visited;
           bool alive;
           
+          // Next particle within the same ParticleGrid cell
+          std::atomic<Particle*> next;
+          friend class ParticleGrid;
+          
           void setPredecessor(Particle* p1)
           {
             if (predecessor)
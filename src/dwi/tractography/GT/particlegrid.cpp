@@ -25,39 +25,83 @@ namespace MR {
         {
           Particle* p = pool.create(pos, dir);
           size_t gidx = pos2idx(pos);
-          grid[gidx].push_back(p);
+          std::lock_guard<std::mutex> lock (stripes[gidx % num_stripes]);
+          link(gidx, p);
         }
         
         void ParticleGrid::shift(Particle *p, const Point_t& pos, const Point_t& dir)
         {
           size_t gidx0 = pos2idx(p->getPosition());
           size_t gidx1 = pos2idx(pos);
-          std::remove (grid[gidx0].begin(), grid[gidx0].end(), p);
+          if (gidx0 == gidx1) {
+            p->setPosition(pos);
+            p->setDirection(dir);
+            return;
+          }
+          std::mutex& m0 (stripes[gidx0 % num_stripes]);
+          std::mutex& m1 (stripes[gidx1 % num_stripes]);
+          std::unique_lock<std::mutex> lock0 (m0, std::defer_lock), lock1;
+          if (&m0 == &m1) {
+            lock0.lock();
+          } else {
+            lock1 = std::unique_lock<std::mutex> (m1, std::defer_lock);
+            std::lock(lock0, lock1);
+          }
+          unlink(gidx0, p);
           p->setPosition(pos);
           p->setDirection(dir);
-          grid[gidx1].push_back(p);
+          link(gidx1, p);
         }
         
         void ParticleGrid::remove(Particle* p)
         {
           size_t gidx0 = pos2idx(p->getPosition());
-          std::remove (grid[gidx0].begin(), grid[gidx0].end(), p);
+          {
+            std::lock_guard<std::mutex> lock (stripes[gidx0 % num_stripes]);
+            unlink(gidx0, p);
+          }
           pool.destroy(p);
         }
         
         void ParticleGrid::clear()
         {
-          grid.clear();
+          if (grid) {
+            for (size_t i = 0; i != ncells(); ++i)
+              grid[i].head.store(nullptr);
+          }
           pool.clear();
         }
         
-        const ParticleGrid::ParticleVectorType* ParticleGrid::at(const ssize_t x, const ssize_t y, const ssize_t z) const
+        const ParticleGrid::Cell* ParticleGrid::at(const ssize_t x, const ssize_t y, const ssize_t z) const
         {
           if ((x < 0) || (size_t(x) >= dims[0]) || (y < 0) || (size_t(y) >= dims[1]) || (z < 0) || (size_t(z) >= dims[2]))  // out of bounds
             return nullptr;
           return &grid[xyz2idx(x, y, z)];
         }
         
+        void ParticleGrid::link(const size_t gidx, Particle* p)
+        {
+          // Publish the particle only once its successor in the list has been set,
+          //   such that concurrent traversals of the cell remain valid
+          p->next.store(grid[gidx].head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+          grid[gidx].head.store(p, std::memory_order_release);
+        }
+        
+        void ParticleGrid::unlink(const size_t gidx, Particle* p)
+        {
+          // The successor of the removed particle is left intact, such that any
+          //   concurrent traversal currently at that particle can continue
+          std::atomic<Particle*>* prev = &grid[gidx].head;
+          Particle* q = prev->load(std::memory_order_relaxed);
+          while (q && q != p) {
+            prev = &q->next;
+            q = prev->load(std::memory_order_relaxed);
+          }
+          assert (q == p);
+          if (q)
+            prev->store(p->next.load(std::memory_order_relaxed), std::memory_order_release);
+        }
+        
         void ParticleGrid::exportTracks(Tractography::Writer<float> &writer)
         {
           std::lock_guard<std::mutex> lock (mutex);
@@ -67,9 +111,9 @@ namespace MR {
           int alpha = 0;
           vector<Point_t> track;
           // Loop through all unvisited particles
-          for (ParticleVectorType& gridvox : grid)
+          for (size_t i = 0; i != ncells(); ++i)
           {
-            for (Particle* par0 : gridvox) 
+            for (Particle* par0 : grid[i]) 
             {
               par = par0;
               if (!par->isVisited())
@@ -107,8 +151,8 @@ namespace MR {
             }
           }
           // Free all particle locks
-          for (ParticleVectorType& gridvox : grid) {
-            for (Particle* par : gridvox) {
+          for (size_t i = 0; i != ncells(); ++i) {
+            for (Particle* par : grid[i]) {
                 par->setVisited(false);
             }
           }
@@ -16,6 +16,7 @@
 #ifndef __gt_particlegrid_h__
 #define __gt_particlegrid_h__
 
+#include <atomic>
 #include <mutex>
 
 #include "header.h"
@@ -34,12 +35,37 @@ namespace MR {
         
         /**
          * @brief The ParticleGrid class
+         *
+         * Each grid cell holds a singly-linked list of the particles within it,
+         * which may be traversed without locking while other threads modify the
+         * grid. Modifications of the grid are serialised per cell using a fixed
+         * set of mutexes, each shared by a stripe of cells.
          */
         class ParticleGrid
         { MEMALIGN(ParticleGrid)
         public:
           
-          using ParticleVectorType = vector<Particle*>;
+          class Iterator
+          { NOMEMALIGN
+          public:
+            Iterator(Particle* p) : p(p) { }
+            Particle* operator*() const { return p; }
+            Iterator& operator++() { p = p->next.load(std::memory_order_acquire); return *this; }
+            bool operator!=(const Iterator& other) const { return p != other.p; }
+          private:
+            Particle* p;
+          };
+          
+          class Cell
+          { NOMEMALIGN
+          public:
+            Cell() : head(nullptr) { }
+            Iterator begin() const { return Iterator(head.load(std::memory_order_acquire)); }
+            Iterator end() const { return Iterator(nullptr); }
+          private:
+            std::atomic<Particle*> head;
+            friend class ParticleGrid;
+          };
           
           template <class HeaderType>
           ParticleGrid(const HeaderType& image)
@@ -48,7 +74,7 @@ namespace MR {
             dims[0] = Math::ceil<size_t>( image.size(0) * image.spacing(0) / (2.0*Particle::L) );
             dims[1] = Math::ceil<size_t>( image.size(1) * image.spacing(1) / (2.0*Particle::L) );
             dims[2] = Math::ceil<size_t>( image.size(2) * image.spacing(2) / (2.0*Particle::L) );
-            grid.resize(dims[0]*dims[1]*dims[2]);
+            grid.reset(new Cell[dims[0]*dims[1]*dims[2]]);
             
             // Initialise scanner-to-grid transform
             Eigen::DiagonalMatrix<default_type, 3> newspacing (2.0*Particle::L, 2.0*Particle::L, 2.0*Particle::L);
@@ -78,7 +104,7 @@ namespace MR {
           
           void clear();
           
-          const ParticleVectorType* at(const ssize_t x, const ssize_t y, const ssize_t z) const;
+          const Cell* at(const ssize_t x, const ssize_t y, const ssize_t z) const;
           
           inline Particle* getRandom() {
             return pool.random();
@@ -88,9 +114,12 @@ namespace MR {
           
           
         protected:
+          static constexpr size_t num_stripes = 1024;
+          
           std::mutex mutex;
+          std::mutex stripes[num_stripes];
           ParticlePool pool;
-          vector<ParticleVectorType> grid;
+          std::unique_ptr<Cell[]> grid;
           Math::RNG rng;
           transform_type T_s2g;
           size_t dims[3];
@@ -119,6 +148,15 @@ namespace MR {
             return z + dims[2] * (y + dims[1] * x);
           }
           
+          inline size_t ncells() const
+          {
+            return dims[0] * dims[1] * dims[2];
+          }
+          
+          // Must be called with the stripe of the cell locked
+          void link(const size_t gidx, Particle* p);
+          void unlink(const size_t gidx, Particle* p);
+          
         };
 
       }
@@ -16,8 +16,10 @@
 #ifndef __gt_spatiallock_h__
 #define __gt_spatiallock_h__
 
+#include <atomic>
 #include <Eigen/Dense>
-#include <mutex>
+
+#include "memory.h"
 
 #include "types.h"
 
@@ -28,7 +30,17 @@ namespace MR {
       namespace GT {
         
         /**
-         * @brief SpatialLock manages a mutex lock on n positions in 3D space.
+         * @brief SpatialLock manages a lock on n positions in 3D space.
+         *
+         * Space is divided into cells with size equal to the lock threshold,
+         * each of which is mapped by a spatial hash onto one entry of a fixed
+         * table of atomic flags. Locking a position sets the flag of its own
+         * cell, and fails if the flag of any of the 26 neighbouring cells is
+         * already set: any two positions closer than the threshold along all
+         * three axes therefore cannot be locked simultaneously, without the
+         * need for a global mutex. (Positions further apart may also conflict,
+         * either if they lie within neighbouring cells, or due to hash
+         * collisions.)
          */
         template <typename T = float >
         class SpatialLock
@@ -37,12 +49,13 @@ namespace MR {
           using value_type = T;
           using point_type = Eigen::Matrix<value_type, 3, 1>;
           
-          SpatialLock() : _tx(0), _ty(0), _tz(0) { }
-          SpatialLock(const value_type t) : _tx(t), _ty(t), _tz(t) { }
-          SpatialLock(const value_type tx, const value_type ty, const value_type tz) : _tx(tx), _ty(ty), _tz(tz) { }
-          
-          ~SpatialLock() {
-            lockcentres.clear();
+          SpatialLock() : SpatialLock(0, 0, 0) { }
+          SpatialLock(const value_type t) : SpatialLock(t, t, t) { }
+          SpatialLock(const value_type tx, const value_type ty, const value_type tz) :
+            _tx(tx), _ty(ty), _tz(tz), cells(new std::atomic<bool>[num_cells])
+          {
+            for (size_t i = 0; i != num_cells; ++i)
+              cells[i].store(false);
           }
           
           void setThreshold(const value_type t) {
@@ -82,37 +95,44 @@ namespace MR {
 
           
         protected:
-          std::mutex mutex;
-          vector< std::pair<point_type, bool> > lockcentres;
+          static constexpr size_t num_cells = 1 << 16;   // must be a power of 2
+
           value_type _tx, _ty, _tz;
+          std::unique_ptr<std::atomic<bool>[]> cells;
+
+          inline size_t hash(const int64_t x, const int64_t y, const int64_t z) const {
+            return size_t((x * 73856093) ^ (y * 19349663) ^ (z * 83492791)) & (num_cells - 1);
+          }
 
           bool try_lock(const point_type& pos, ssize_t& idx) {
-            std::lock_guard<std::mutex> lock (mutex);
-            idx = -1;
-            ssize_t i = 0;
-            point_type d;
-            for (auto& x : lockcentres) {
-              if (x.second) {
-                d = x.first - pos;
-                if ((std::fabs(d[0]) < _tx) && (std::fabs(d[1]) < _ty) && (std::fabs(d[2]) < _tz))
-                  return false;
-              } else {
-                idx = i;
+            assert (_tx > 0 && _ty > 0 && _tz > 0);
+            assert (idx == -1);
+            const int64_t x = std::floor(pos[0] / _tx);
+            const int64_t y = std::floor(pos[1] / _ty);
+            const int64_t z = std::floor(pos[2] / _tz);
+            const size_t own = hash(x, y, z);
+            if (cells[own].exchange(true))
+              return false;
+            // Each thread sets its own flag before testing those of its neighbours,
+            //   so of two threads attempting to lock neighbouring cells concurrently,
+            //   at least one will observe the other and fail
+            for (int64_t i = -1; i <= 1; i++) {
+              for (int64_t j = -1; j <= 1; j++) {
+                for (int64_t k = -1; k <= 1; k++) {
+                  const size_t h = hash(x+i, y+j, z+k);
+                  if (h != own && cells[h].load()) {
+                    cells[own].store(false);
+                    return false;
+                  }
+                }
               }
-              i++;
-            }
-            if (idx == -1) {
-              idx = lockcentres.size();
-              lockcentres.emplace_back(pos, true);
-            } else {
-              lockcentres[idx].first = pos;
-              lockcentres[idx].second = true;
             }
+            idx = own;
             return true;
           }
 
           void unlock(const size_t idx) {
-            lockcentres[idx].second = false;
+            cells[idx].store(false);
           }
 
 
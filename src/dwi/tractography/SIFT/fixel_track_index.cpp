@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "dwi/tractography/SIFT/fixel_track_index.h"
+
+#include <cstring>
+
+#include "file/entry.h"
+#include "file/ofstream.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace SIFT
+      {
+
+
+
+      namespace {
+        // File layout: this magic string (zero-padded to 32 bytes); the number of
+        //   fixels, the number of entries, and the length scaling factor (each 64-bit);
+        //   zero-padding to header_size; the offsets of the first entry for each fixel
+        //   (plus the total number of entries), as 64-bit integers; the streamline index
+        //   of each entry, as 32-bit integers; and the quantised length of each entry,
+        //   as 8-bit integers. All values are little-endian.
+        const char* magic = "mrtrix fixel-track index\n";
+      }
+
+
+
+
+      void FixelTrackIndex::build (const size_t num_fixels, const vector<TrackContribution*>& contributions)
+      {
+        clear();
+
+        // First pass: count the number of entries for each fixel
+        vector<uint64_t> counts (num_fixels + 1, 0);
+        for (const auto i : contributions) {
+          if (i) {
+            for (size_t f = 0; f != i->dim(); ++f) {
+              assert ((*i)[f].get_fixel_index() < num_fixels);
+              ++counts[(*i)[f].get_fixel_index() + 1];
+            }
+          }
+        }
+        for (size_t f = 0; f != num_fixels; ++f)
+          counts[f+1] += counts[f];
+
+        try {
+          offsets_data.resize (num_fixels + 1);
+          tracks_data.resize (counts.back());
+          lengths_data.resize (counts.back());
+        } catch (...) {
+          throw Exception ("Error assigning memory for fixel-streamline index");
+        }
+        for (size_t f = 0; f != num_fixels + 1; ++f)
+          offsets_data[f] = ByteOrder::LE (counts[f]);
+
+        // Second pass: fill; streamlines are visited in order, so the entries for
+        //   each fixel are sorted by streamline index
+        for (track_t t = 0; t != contributions.size(); ++t) {
+          if (contributions[t]) {
+            const TrackContribution& cont (*contributions[t]);
+            for (size_t f = 0; f != cont.dim(); ++f) {
+              const uint64_t position = counts[cont[f].get_fixel_index()]++;
+              tracks_data[position] = ByteOrder::LE (uint32_t (t));
+              lengths_data[position] = cont[f].get_quantised_length();
+            }
+          }
+        }
+
+        offsets = reinterpret_cast<const uint8_t*> (offsets_data.data());
+        tracks  = reinterpret_cast<const uint8_t*> (tracks_data.data());
+        lengths = lengths_data.data();
+        fixel_count = num_fixels;
+        entry_count = tracks_data.size();
+        length_scale = Track_fixel_contribution::storage_scale();
+
+        DEBUG ("Fixel-streamline index generated: " + str(size()) + " entries across " + str(num_fixels) + " fixels");
+      }
+
+
+
+
+      void FixelTrackIndex::load (const std::string& path)
+      {
+        clear();
+
+        std::unique_ptr<File::MMap> map (new File::MMap (File::Entry (path), false, false));
+        if (map->size() < int64_t(header_size) || memcmp (map->address(), magic, strlen (magic)))
+          throw Exception ("file \"" + path + "\" is not a fixel-streamline index file");
+
+        const uint8_t* header = map->address() + 32;
+        const uint64_t num_fixels  = Raw::fetch_LE<uint64_t> (header, 0);
+        const uint64_t num_entries = Raw::fetch_LE<uint64_t> (header, 1);
+        const double scale         = Raw::fetch_LE<double>   (header, 2);
+        const uint64_t expected_size = header_size + (num_fixels + 1) * sizeof(uint64_t) + num_entries * (sizeof(uint32_t) + sizeof(uint8_t));
+        if (uint64_t(map->size()) != expected_size)
+          throw Exception ("fixel-streamline index file \"" + path + "\" is truncated or malformed");
+
+        const uint8_t* data = map->address() + header_size;
+        if (Raw::fetch_LE<uint64_t> (data, 0) || Raw::fetch_LE<uint64_t> (data, num_fixels) != num_entries)
+          throw Exception ("fixel-streamline index file \"" + path + "\" is malformed");
+
+        mmap = std::move (map);
+        offsets = data;
+        tracks  = offsets + (num_fixels + 1) * sizeof(uint64_t);
+        lengths = tracks + num_entries * sizeof(uint32_t);
+        fixel_count = num_fixels;
+        entry_count = num_entries;
+        length_scale = scale;
+
+        DEBUG ("Fixel-streamline index loaded from file \"" + path + "\": " + str(size()) + " entries across " + str(fixel_count) + " fixels");
+      }
+
+
+
+
+      void FixelTrackIndex::save (const std::string& path) const
+      {
+        assert (valid());
+        File::OFStream out (path, std::ios::out | std::ios::binary | std::ios::trunc);
+        char header[header_size];
+        memset (header, 0, header_size);
+        memcpy (header, magic, strlen (magic));
+        Raw::store_LE<uint64_t> (num_fixels(), header + 32, 0);
+        Raw::store_LE<uint64_t> (size(), header + 32, 1);
+        Raw::store_LE<double> (length_scale, header + 32, 2);
+        out.write (header, header_size);
+        out.write (reinterpret_cast<const char*> (offsets), (num_fixels() + 1) * sizeof(uint64_t));
+        out.write (reinterpret_cast<const char*> (tracks), size() * sizeof(uint32_t));
+        out.write (reinterpret_cast<const char*> (lengths), size() * sizeof(uint8_t));
+        if (!out.good())
+          throw Exception ("error writing fixel-streamline index file \"" + path + "\": " + strerror (errno));
+      }
+
+
+
+
+      void FixelTrackIndex::clear()
+      {
+        vector<uint64_t>().swap (offsets_data);
+        vector<uint32_t>().swap (tracks_data);
+        vector<uint8_t>().swap (lengths_data);
+        mmap.reset();
+        offsets = tracks = lengths = nullptr;
+        fixel_count = 0;
+        entry_count = 0;
+        length_scale = 0.0f;
+      }
+
+
+
+
+      }
+    }
+  }
+}
+
+
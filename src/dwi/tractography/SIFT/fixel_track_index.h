@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __dwi_tractography_sift_fixel_track_index_h__
+#define __dwi_tractography_sift_fixel_track_index_h__
+
+
+#include "memory.h"
+#include "raw.h"
+#include "types.h"
+
+#include "file/mmap.h"
+
+#include "dwi/tractography/SIFT/track_contribution.h"
+#include "dwi/tractography/SIFT/types.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace SIFT
+      {
+
+
+
+
+      // The inverse of the streamline contributions stored in the Model class: for each
+      //   fixel, the list of streamlines that traverse it, along with the length of each
+      //   (as stored in the corresponding Track_fixel_contribution). This permits
+      //   operations on individual fixels to be performed in time proportional to the
+      //   number of streamlines traversing them, rather than the total number of streamlines.
+      //
+      // Data are stored in compressed sparse row form: the entries for all fixels are held
+      //   in a single array, with the entries for each fixel stored contiguously and in
+      //   ascending order of streamline index. Each entry requires 5 bytes: a 32-bit
+      //   streamline index, and the quantised length from Track_fixel_contribution.
+      //   A streamline contributes more than one entry to a fixel only if its
+      //   Track_fixel_contribution data for that fixel could not be summed.
+      //
+      // The index can be written to file using save(), and subsequently memory-mapped
+      //   rather than re-generated. All data are stored little-endian, both in memory
+      //   and on disk. Note that the index does not track any subsequent modification
+      //   of the streamline contributions or fixels from which it was generated.
+      class FixelTrackIndex
+      { MEMALIGN(FixelTrackIndex)
+
+        public:
+          class Entry
+          { MEMALIGN(Entry)
+            public:
+              Entry (const track_t i, const float l) :
+                  track_index (i),
+                  length (l) { }
+              track_t get_track_index() const { return track_index; }
+              float   get_length()      const { return length; }
+            private:
+              const track_t track_index;
+              const float   length;
+          };
+
+          class Iterator
+          { MEMALIGN(Iterator)
+            public:
+              Iterator (const FixelTrackIndex& index, const uint64_t position) :
+                  index (index),
+                  position (position) { }
+              Entry operator*() const { return Entry (index.track_index (position), index.length (position)); }
+              Iterator& operator++() { ++position; return *this; }
+              bool operator!= (const Iterator& that) const { return position != that.position; }
+            private:
+              const FixelTrackIndex& index;
+              uint64_t position;
+          };
+
+          class Range
+          { MEMALIGN(Range)
+            public:
+              Range (const FixelTrackIndex& index, const uint64_t first, const uint64_t last) :
+                  index (index),
+                  first (first),
+                  last (last) { }
+              Iterator begin() const { return Iterator (index, first); }
+              Iterator end()   const { return Iterator (index, last); }
+              size_t size() const { return last - first; }
+              bool empty() const { return first == last; }
+            private:
+              const FixelTrackIndex& index;
+              const uint64_t first, last;
+          };
+
+
+          FixelTrackIndex () { clear(); }
+          FixelTrackIndex (const size_t num_fixels, const vector<TrackContribution*>& contributions) { build (num_fixels, contributions); }
+          FixelTrackIndex (const std::string& path) { load (path); }
+          FixelTrackIndex (const FixelTrackIndex&) = delete;
+
+          // Generate the index from the contributions of all streamlines
+          void build (const size_t num_fixels, const vector<TrackContribution*>&);
+          // Memory-map an index previously written to file
+          void load (const std::string&);
+          void save (const std::string&) const;
+          void clear();
+
+          bool valid() const { return offsets; }
+          size_t num_fixels() const { return fixel_count; }
+          uint64_t size() const { return entry_count; }
+
+          Range operator[] (const size_t fixel_index) const
+          {
+            assert (fixel_index < num_fixels());
+            return Range (*this, Raw::fetch_LE<uint64_t> (offsets, fixel_index), Raw::fetch_LE<uint64_t> (offsets, fixel_index+1));
+          }
+
+          track_t track_index (const uint64_t position) const { assert (position < size()); return Raw::fetch_LE<uint32_t> (tracks, position); }
+          float   length      (const uint64_t position) const { assert (position < size()); return lengths[position] * length_scale; }
+
+
+        private:
+          // Data are either owned by this class, or memory-mapped from file
+          vector<uint64_t> offsets_data;
+          vector<uint32_t> tracks_data;
+          vector<uint8_t>  lengths_data;
+          std::unique_ptr<File::MMap> mmap;
+
+          const uint8_t* offsets;
+          const uint8_t* tracks;
+          const uint8_t* lengths;
+          size_t fixel_count;
+          uint64_t entry_count;
+          float length_scale;
+
+          static constexpr size_t header_size = 64;
+
+      };
+
+
+
+
+      }
+    }
+  }
+}
+
+
+#endif
+
@@ -76,6 +76,42 @@ namespace MR
 
 
 
+      Gradient_queue::Gradient_queue (const Gradient_queue::VecType& in) :
+          gradients (in)
+      {
+        vector<EntryType> entries;
+        for (track_t i = 0; i != gradients.size(); ++i) {
+          if (gradients[i].get_tck_index() == i && gradients[i].get_gradient_per_unit_length() < 0.0)
+            entries.push_back (EntryType (gradients[i].get_gradient_per_unit_length(), i));
+        }
+        queue = decltype(queue) (std::greater<EntryType>(), std::move (entries));
+      }
+
+
+
+      const Cost_fn_gradient_sort* Gradient_queue::get()
+      {
+        while (!queue.empty()) {
+          const EntryType entry (queue.top());
+          queue.pop();
+          const Cost_fn_gradient_sort& current (gradients[entry.second]);
+          if (current.get_tck_index() != entry.second)
+            continue;
+          if (entry.first == current.get_gradient_per_unit_length())
+            return &current;
+          // Gradient has increased since this entry was added; if it has instead
+          //   decreased, a more recent entry for this streamline has already been processed
+          if (entry.first < current.get_gradient_per_unit_length())
+            update (entry.second);
+        }
+        return nullptr;
+      }
+
+
+
+
+
+
       }
     }
   }
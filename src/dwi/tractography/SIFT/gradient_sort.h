@@ -17,6 +17,7 @@
 #define __dwi_tractography_sift_sort_h__
 
 
+#include <queue>
 #include <set>
 
 #include "types.h"
@@ -148,6 +149,48 @@ namespace MR
 
 
 
+      // Priority queue of candidate streamlines for removal, in ascending order of
+      //   cost function gradient per unit length. Unlike MT_gradient_vector_sorter, the
+      //   gradients of streamlines may be modified (e.g. following the removal of
+      //   other streamlines traversing the same fixels) after the queue is built:
+      // * Only streamlines with a negative gradient are ever added to the queue.
+      // * If the gradient of a streamline decreases, update() must be called to add
+      //     a new entry for it; any existing entry for that streamline then becomes
+      //     stale, and is discarded when it reaches the front of the queue.
+      // * If the gradient of a streamline increases, its existing entry is re-inserted
+      //     with the new value when it reaches the front of the queue.
+      // * Streamlines that have been removed (i.e. with a track index in the gradient
+      //     vector that differs from their position) are discarded.
+      class Gradient_queue
+      { MEMALIGN(Gradient_queue)
+
+          using VecType = vector<Cost_fn_gradient_sort>;
+          using EntryType = std::pair<double, track_t>;
+
+        public:
+          Gradient_queue (const VecType&);
+
+          // Returns the streamline with the most negative gradient per unit length,
+          //   or nullptr if there are no streamlines with a negative gradient
+          const Cost_fn_gradient_sort* get();
+
+          void update (const track_t index)
+          {
+            if (gradients[index].get_gradient_per_unit_length() < 0.0)
+              queue.push (EntryType (gradients[index].get_gradient_per_unit_length(), index));
+          }
+
+          size_t size() const { return queue.size(); }
+
+        private:
+          const VecType& gradients;
+          std::priority_queue<EntryType, vector<EntryType>, std::greater<EntryType>> queue;
+
+      };
+
+
+
+
       }
     }
   }
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "dwi/tractography/SIFT/mapping_cache.h"
+
+#include <cstring>
+#include <sys/stat.h>
+
+#include "file/entry.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace SIFT
+      {
+
+
+
+      namespace {
+        // File layout: this magic string (zero-padded to 32 bytes); the key, the number
+        //   of fixels (including the invalid fixel 0), the number of streamlines, and the
+        //   total number of streamline-fixel contributions (each as 64-bit integers); the
+        //   offset of the first contribution of each streamline (plus the total number of
+        //   contributions), as 64-bit integers; the total contribution and length of each
+        //   streamline (32-bit float; a negative length indicates a streamline that was not
+        //   mapped); and each streamline-fixel contribution, in the packed 32-bit format of
+        //   Track_fixel_contribution (using canonical fixel indices). All values are
+        //   little-endian.
+        const char* magic = "mrtrix SIFT mapping cache\n";
+
+        // Values are converted to little-endian within a small buffer prior to writing
+        class BufferedLEWriter
+        { NOMEMALIGN
+          public:
+            BufferedLEWriter (File::OFStream& out) : out (out) { buffer.reserve (buffer_size); }
+            template <typename T>
+            void operator() (const T value)
+            {
+              const size_t size = buffer.size();
+              buffer.resize (size + sizeof (T));
+              Raw::store_LE (value, buffer.data() + size);
+              if (buffer.size() >= buffer_size)
+                flush();
+            }
+            void flush() { out.write (buffer.data(), buffer.size()); buffer.clear(); }
+          private:
+            File::OFStream& out;
+            vector<char> buffer;
+            static constexpr size_t buffer_size = 65536;
+        };
+      }
+
+
+
+      MappingCache::Key& MappingCache::Key::add (const void* data, const size_t size)
+      {
+        const uint8_t* p = reinterpret_cast<const uint8_t*> (data);
+        for (size_t i = 0; i != size; ++i) {
+          value ^= p[i];
+          value *= 0x100000001b3ULL;
+        }
+        return *this;
+      }
+
+
+
+      void MappingCache::add_tractogram (Key& key, const std::string& path, const Tractography::Properties& properties)
+      {
+        struct stat sbuf;
+        if (stat (path.c_str(), &sbuf))
+          throw Exception ("cannot stat track file \"" + path + "\": " + strerror (errno));
+        key (int64_t (sbuf.st_size)) (int64_t (sbuf.st_mtime));
+        for (const auto& p : properties)
+          key (p.first) (p.second);
+      }
+
+
+
+
+
+      MappingCache::MappingCache (const std::string& path, const uint64_t key, const size_t num_fixels) :
+          track_count (0),
+          offsets (nullptr),
+          totals (nullptr),
+          entries (nullptr)
+      {
+        if (!Path::exists (path))
+          return;
+
+        std::unique_ptr<File::MMap> map (new File::MMap (File::Entry (path), false, false));
+        if (map->size() < int64_t(header_size) || memcmp (map->address(), magic, strlen (magic))) {
+          WARN ("file \"" + path + "\" is not a SIFT mapping cache file; streamlines will be mapped");
+          return;
+        }
+
+        const uint8_t* header = map->address() + 32;
+        if (Raw::fetch_LE<uint64_t> (header, 0) != key) {
+          INFO ("SIFT mapping cache file \"" + path + "\" was generated from different data; streamlines will be mapped");
+          return;
+        }
+        const uint64_t file_fixels  = Raw::fetch_LE<uint64_t> (header, 1);
+        const uint64_t file_tracks  = Raw::fetch_LE<uint64_t> (header, 2);
+        const uint64_t file_entries = Raw::fetch_LE<uint64_t> (header, 3);
+        const uint64_t expected_size = header_size
+                                       + (file_tracks + 1) * sizeof(uint64_t)
+                                       + file_tracks * 2 * sizeof(float)
+                                       + file_entries * sizeof(uint32_t);
+        if (file_fixels != num_fixels || uint64_t(map->size()) != expected_size) {
+          WARN ("SIFT mapping cache file \"" + path + "\" is truncated or malformed; streamlines will be mapped");
+          return;
+        }
+
+        track_count = file_tracks;
+        offsets   = map->address() + header_size;
+        totals    = offsets + (track_count + 1) * sizeof(uint64_t);
+        entries   = totals + track_count * 2 * sizeof(float);
+        if (Raw::fetch_LE<uint64_t> (offsets, 0) || Raw::fetch_LE<uint64_t> (offsets, track_count) != file_entries) {
+          WARN ("SIFT mapping cache file \"" + path + "\" is malformed; streamlines will be mapped");
+          return;
+        }
+        mmap = std::move (map);
+
+        DEBUG ("SIFT mapping cache file \"" + path + "\" loaded: " + str(track_count) + " streamlines, " + str(file_entries) + " contributions");
+      }
+
+
+
+
+      TrackContribution* MappingCache::get_contribution (const track_t index, const vector<uint32_t>& fixel_index) const
+      {
+        assert (valid() && index < num_tracks());
+        const float total_contribution = Raw::fetch_LE<float> (totals, 2*index);
+        const float total_length       = Raw::fetch_LE<float> (totals, 2*index+1);
+        if (total_length < 0.0f)
+          return nullptr;
+        const uint64_t first = Raw::fetch_LE<uint64_t> (offsets, index);
+        const uint64_t last  = Raw::fetch_LE<uint64_t> (offsets, index+1);
+        vector<Track_fixel_contribution> data;
+        data.reserve (last - first);
+        for (uint64_t i = first; i != last; ++i) {
+          const uint32_t packed = Raw::fetch_LE<uint32_t> (entries, i);
+          const uint32_t canonical = packed & 0x00FFFFFF;
+          if (canonical >= fixel_index.size() || !fixel_index[canonical])
+            throw Exception ("SIFT mapping cache file contains an invalid fixel index");
+          data.push_back (Track_fixel_contribution (fixel_index[canonical], (packed >> 24) * Track_fixel_contribution::storage_scale()));
+        }
+        return new TrackContribution (data, total_contribution, total_length);
+      }
+
+
+
+
+      void MappingCache::save (const std::string& path, const uint64_t key,
+                               const vector<TrackContribution*>& contributions,
+                               const vector<uint32_t>& canonical_index)
+      {
+        vector<uint64_t> offsets (contributions.size() + 1);
+        offsets[0] = 0;
+        for (size_t i = 0; i != contributions.size(); ++i)
+          offsets[i+1] = offsets[i] + (contributions[i] ? contributions[i]->dim() : 0);
+
+        File::OFStream out (path, std::ios::out | std::ios::binary | std::ios::trunc);
+        char header[header_size];
+        memset (header, 0, header_size);
+        memcpy (header, magic, strlen (magic));
+        Raw::store_LE<uint64_t> (key, header + 32, 0);
+        Raw::store_LE<uint64_t> (canonical_index.size(), header + 32, 1);
+        Raw::store_LE<uint64_t> (contributions.size(), header + 32, 2);
+        Raw::store_LE<uint64_t> (offsets.back(), header + 32, 3);
+        out.write (header, header_size);
+
+        BufferedLEWriter writer (out);
+        for (const auto offset : offsets)
+          writer (offset);
+        for (const auto i : contributions) {
+          writer (i ? i->get_total_contribution() : 0.0f);
+          writer (i ? i->get_total_length() : -1.0f);
+        }
+        for (const auto i : contributions) {
+          if (i) {
+            for (size_t f = 0; f != i->dim(); ++f) {
+              const Track_fixel_contribution& c ((*i)[f]);
+              writer (uint32_t (canonical_index[c.get_fixel_index()] | (uint32_t (c.get_quantised_length()) << 24)));
+            }
+          }
+        }
+        writer.flush();
+
+        if (!out.good())
+          throw Exception ("error writing SIFT mapping cache file \"" + path + "\": " + strerror (errno));
+      }
+
+
+
+
+      }
+    }
+  }
+}
+
+
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __dwi_tractography_sift_mapping_cache_h__
+#define __dwi_tractography_sift_mapping_cache_h__
+
+
+#include "memory.h"
+#include "raw.h"
+#include "types.h"
+
+#include "file/mmap.h"
+
+#include "dwi/tractography/properties.h"
+
+#include "dwi/tractography/SIFT/track_contribution.h"
+#include "dwi/tractography/SIFT/types.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace SIFT
+      {
+
+
+
+
+      // Storage of the outcome of Model::map_streamlines() (the contribution of every
+      //   streamline to every fixel), such that a subsequent invocation using the same
+      //   data can skip the mapping step; fixel streamline densities are re-derived
+      //   from the streamline contributions when the cache is loaded.
+      //
+      // Each cache file is labelled with a key, generated from the tractogram (its
+      //   size, modification time and header properties) and from the fixels
+      //   obtained from FOD segmentation (position, direction, fibre density and
+      //   processing mask weight of each); the cache is only used if the key matches.
+      //   Fixels are identified within the file according to a fixed traversal of
+      //   the image (see Model::canonical_fixel_order()), since the order in which
+      //   fixels are stored in memory depends on the multi-threaded FOD segmentation.
+      class MappingCache
+      { MEMALIGN(MappingCache)
+
+        public:
+          // 64-bit FNV-1a hash, used to generate the key for a cache file
+          class Key
+          { NOMEMALIGN
+            public:
+              Key () : value (0xcbf29ce484222325ULL) { }
+              template <typename T>
+              Key& operator() (const T& data) { return add (&data, sizeof (T)); }
+              Key& operator() (const std::string& data) { (*this) (uint64_t (data.size())); return add (data.data(), data.size()); }
+              Key& add (const void* data, const size_t size);
+              uint64_t get() const { return value; }
+            private:
+              uint64_t value;
+          };
+
+          // Add the identity of a track file to a cache key
+          static void add_tractogram (Key&, const std::string& path, const Tractography::Properties&);
+
+
+          // Memory-map an existing cache file; valid() returns false if it does not
+          //   exist, does not match the key provided, or is not a valid cache file
+          MappingCache (const std::string& path, const uint64_t key, const size_t num_fixels);
+
+          bool valid() const { return bool(mmap); }
+
+          track_t num_tracks() const { return track_count; }
+
+          // Construct the contribution of a streamline, mapping the canonical fixel
+          //   indices stored in the file back to those of the current model;
+          //   returns nullptr for any streamline that was not mapped
+          TrackContribution* get_contribution (const track_t, const vector<uint32_t>& fixel_index) const;
+
+
+          static void save (const std::string& path, const uint64_t key,
+                            const vector<TrackContribution*>& contributions,
+                            const vector<uint32_t>& canonical_index);
+
+
+        private:
+          std::unique_ptr<File::MMap> mmap;
+          track_t track_count;
+          const uint8_t* offsets;
+          const uint8_t* totals;
+          const uint8_t* entries;
+
+          static constexpr size_t header_size = 64;
+
+      };
+
+
+
+
+      }
+    }
+  }
+}
+
+
+#endif
+
@@ -34,6 +34,8 @@
 #include "dwi/tractography/mapping/mapping.h"
 #include "dwi/tractography/mapping/voxel.h"
 
+#include "dwi/tractography/SIFT/fixel_track_index.h"
+#include "dwi/tractography/SIFT/mapping_cache.h"
 #include "dwi/tractography/SIFT/model_base.h"
 #include "dwi/tractography/SIFT/track_contribution.h"
 #include "dwi/tractography/SIFT/track_index_range.h"
@@ -93,6 +95,18 @@ namespace MR
           std::string tck_file_path;
           vector<TrackContribution*> contributions;
 
+          // The inverse of the contributions member: the streamlines traversing
+          //   each fixel. This is only generated on request, via index_fixel_tracks();
+          //   it is cleared if fixels are removed from the model.
+          FixelTrackIndex fixel_tracks;
+          void index_fixel_tracks() { if (!fixel_tracks.valid()) fixel_tracks.build (fixels.size(), contributions); }
+
+          // For each fixel index in a mapping cache file, the index of the corresponding
+          //   fixel in this model; the key is updated according to the fixels encountered
+          vector<uint32_t> canonical_fixel_order (MappingCache::Key&) const;
+          bool load_mapping (const std::string&, const uint64_t, const vector<uint32_t>&);
+          void save_mapping (const std::string&, const uint64_t, const vector<uint32_t>&) const;
+
           using Fixel_map<Fixel>::accessor;
           using Fixel_map<Fixel>::begin;
 
@@ -133,6 +147,36 @@ namespace MR
               vector<double> fixel_TDs;
           };
 
+          // Fixel streamline densities are accumulated from the cached contributions
+          //   in the same manner as in TrackMappingWorker
+          class MappingLoader
+          { MEMALIGN(MappingLoader)
+            public:
+              MappingLoader (Model& i, const MappingCache& c, const vector<uint32_t>& o) :
+                  master (i),
+                  cache (c),
+                  fixel_order (o),
+                  mutex (new std::mutex),
+                  TD_sum (0.0),
+                  fixel_TDs (master.fixels.size(), 0.0) { }
+              MappingLoader (const MappingLoader& that) :
+                  master (that.master),
+                  cache (that.cache),
+                  fixel_order (that.fixel_order),
+                  mutex (that.mutex),
+                  TD_sum (0.0),
+                  fixel_TDs (master.fixels.size(), 0.0) { }
+              ~MappingLoader();
+              bool operator() (const TrackIndexRange&);
+            private:
+              Model& master;
+              const MappingCache& cache;
+              const vector<uint32_t>& fixel_order;
+              std::shared_ptr<std::mutex> mutex;
+              double TD_sum;
+              vector<double> fixel_TDs;
+          };
+
           class FixelRemapper
           { MEMALIGN(FixelRemapper)
             public:
@@ -175,11 +219,30 @@ namespace MR
         if (!count)
           throw Exception ("Cannot map streamlines: track file " + Path::basename(path) + " is empty");
 
+        const default_type upsample_ratio = Mapping::determine_upsample_ratio (Fixel_map<Fixel>::header(), properties, 0.1);
+
+        auto opt = App::get_options ("mapping_cache");
+        const std::string cache_path = opt.size() ? std::string (opt[0][0]) : std::string();
+        vector<uint32_t> fixel_order;
+        uint64_t cache_key = 0;
+        if (cache_path.size()) {
+          MappingCache::Key key;
+          MappingCache::add_tractogram (key, path, properties);
+          key (upsample_ratio) (Track_fixel_contribution::storage_scale()) (bool (App::get_options ("no_dilate_lut").size()));
+          fixel_order = canonical_fixel_order (key);
+          cache_key = key.get();
+          if (load_mapping (cache_path, cache_key, fixel_order)) {
+            tck_file_path = path;
+            INFO ("Streamline mapping loaded from cache file \"" + cache_path + "\"; proportionality coefficient is " + str (mu()));
+            return;
+          }
+        }
+
         contributions.assign (count, nullptr);
 
         {
           Mapping::TrackLoader loader (file, count);
-          TrackMappingWorker worker (*this, Mapping::determine_upsample_ratio (Fixel_map<Fixel>::header(), properties, 0.1));
+          TrackMappingWorker worker (*this, upsample_ratio);
           Thread::run_queue (loader,
                              Thread::batch (Tractography::Streamline<>()),
                              Thread::multi (worker));
@@ -199,6 +262,9 @@ namespace MR
 
         tck_file_path = path;
 
+        if (cache_path.size())
+          save_mapping (cache_path, cache_key, fixel_order);
+
         INFO ("Proportionality coefficient after streamline mapping is " + str (mu()));
       }
 
@@ -206,6 +272,60 @@ namespace MR
 
 
 
+      template <class Fixel>
+      vector<uint32_t> Model<Fixel>::canonical_fixel_order (MappingCache::Key& key) const
+      {
+        vector<uint32_t> order;
+        order.reserve (fixels.size());
+        order.push_back (0);
+        VoxelAccessor v (accessor());
+        for (auto l = Loop (v) (v); l; ++l) {
+          if (v.value()) {
+            const MapVoxel& voxel (*v.value());
+            key (int32_t (v.index(0))) (int32_t (v.index(1))) (int32_t (v.index(2))) (uint32_t (voxel.num_fixels()));
+            for (typename Fixel_map<Fixel>::ConstIterator i = begin (v); i; ++i) {
+              order.push_back (uint32_t (size_t (i)));
+              key (i().get_FOD()) (i().get_weight()) (i().get_dir()[0]) (i().get_dir()[1]) (i().get_dir()[2]);
+            }
+          }
+        }
+        assert (order.size() == fixels.size());
+        return order;
+      }
+
+
+
+      template <class Fixel>
+      bool Model<Fixel>::load_mapping (const std::string& path, const uint64_t key, const vector<uint32_t>& fixel_order)
+      {
+        MappingCache cache (path, key, fixels.size());
+        if (!cache.valid())
+          return false;
+        contributions.assign (cache.num_tracks(), nullptr);
+        {
+          TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks(), "Loading streamline mapping from cache");
+          MappingLoader loader (*this, cache, fixel_order);
+          Thread::run_queue (writer, TrackIndexRange(), Thread::multi (loader));
+        }
+        return true;
+      }
+
+
+
+      template <class Fixel>
+      void Model<Fixel>::save_mapping (const std::string& path, const uint64_t key, const vector<uint32_t>& fixel_order) const
+      {
+        vector<uint32_t> canonical_index (fixels.size(), 0);
+        for (size_t i = 1; i != fixel_order.size(); ++i)
+          canonical_index[fixel_order[i]] = i;
+        MappingCache::save (path, key, contributions, canonical_index);
+        INFO ("Streamline mapping written to cache file \"" + path + "\"");
+      }
+
+
+
+
+
       template <class Fixel>
       void Model<Fixel>::remove_excluded_fixels ()
       {
@@ -250,6 +370,7 @@ namespace MR
         INFO (str (fixels.size() - new_fixels.size()) + " out of " + str(fixels.size()) + " fixels removed from reconstruction (" + str(new_fixels.size()) + ") remaining)");
 
         fixels.swap (new_fixels);
+        fixel_tracks.clear();
 
         TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks(), "Removing excluded fixels");
         FixelRemapper remapper (*this, fixel_index_mapping);
@@ -376,6 +497,36 @@ namespace MR
 
 
 
+      template <class Fixel>
+      Model<Fixel>::MappingLoader::~MappingLoader()
+      {
+        std::lock_guard<std::mutex> lock (*mutex);
+        master.TD_sum += TD_sum;
+        for (size_t i = 0; i != fixel_TDs.size(); ++i)
+          master.fixels[i] += fixel_TDs[i];
+      }
+
+
+
+      template <class Fixel>
+      bool Model<Fixel>::MappingLoader::operator() (const TrackIndexRange& in)
+      {
+        for (track_t track_index = in.first; track_index != in.second; ++track_index) {
+          TrackContribution* const cont = cache.get_contribution (track_index, fixel_order);
+          master.contributions[track_index] = cont;
+          if (cont) {
+            TD_sum += cont->get_total_contribution();
+            for (size_t i = 0; i != cont->dim(); ++i)
+              fixel_TDs [(*cont)[i].get_fixel_index()] += (*cont)[i].get_length();
+          }
+        }
+        return true;
+      }
+
+
+
+
+
       template <class Fixel>
       bool Model<Fixel>::FixelRemapper::operator() (const TrackIndexRange& in)
       {
@@ -42,7 +42,12 @@ const OptionGroup SIFTModelOption = OptionGroup ("Options affecting the SIFT mod
 
   + Option ("fd_thresh", "fibre density threshold; exclude an FOD lobe from filtering processing if its integral is less than this amount "
                          "(streamlines will still be mapped to it, but it will not contribute to the cost function or the filtering)")
-    + Argument ("value").type_float (0.0, 2.0 * Math::pi);
+    + Argument ("value").type_float (0.0, 2.0 * Math::pi)
+
+  + Option ("mapping_cache", "cache the mapping of streamlines to FOD lobes in this file. If the file exists, and was generated "
+                             "from the same track file, FOD image and model options, the mapping is loaded from it rather than "
+                             "recomputed; otherwise the streamlines are mapped, and the result written to this file")
+    + Argument ("path").type_text();
 
 
 
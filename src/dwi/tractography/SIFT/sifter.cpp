@@ -78,6 +78,9 @@ namespace MR
           throw Exception ("Error assigning memory for SIFT gradient vector");
         }
 
+        // Used to update only those gradients affected by each streamline removal
+        index_fixel_tracks();
+
         unsigned int tracks_remaining = num_tracks();
 
         if (tracks_remaining < term_number)
@@ -108,6 +111,7 @@ namespace MR
           const double current_mu     = mu();
           const double current_cf     = calc_cost_function();
           const double current_roc_cf = calc_roc_cost_function();
+          const double current_TD_sum = TD_sum;
 
 
           TrackIndexRangeWriter range_writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
@@ -115,22 +119,13 @@ namespace MR
           Thread::run_queue (range_writer, TrackIndexRange(), Thread::multi (gradient_calculator));
 
 
-          // Theoretically possible to optimise the sorting block size at execution time
-          // * Estimate the smallest possible block size that will not overload the std::set
-          // * Simulate a gradient vector using a Gaussian distribution of gradients (ignore length dependence)
-          // * Simulate sorting this gradient vector; need to simulate both the sort, and some number of get() calls
-          // * Perform a golden section search to find the optimal block size
-          // This wasn't implemented as the optimal block size seems pretty stable regardless of gradient vector size
-
-          // Ideally the sorting block size should change dynamically as streamlines are filtered
-          // This is to reduce the load on the single-threaded section as the multi-threaded sorting complexity declines
-          //   (as more streamlines are no longer present, hence have a null gradient and are excluded from the full sort)
-          // Tried for an algebraic solution but the numbers didn't line up with my experiments
-          // Trying a heuristic for now; go for a sort size of 1000 following initial sort, assuming half of all
-          //   remaining streamlines have a negative gradient
-
-          const track_t sort_size = std::min (num_tracks() / double(Thread::number_of_threads()), std::round (2000.0 * double(num_tracks()) / double(tracks_remaining)));
-          MT_gradient_vector_sorter sorter (gradient_vector, sort_size);
+          // Rather than sorting the full gradient vector, candidate streamlines are drawn
+          //   from a priority queue; following each removal, the gradients of those
+          //   streamlines traversing the same fixels as the removed streamline are
+          //   updated (using the values of mu and TD_sum from the start of the iteration),
+          //   such that the gradients of all remaining streamlines remain consistent
+          //   with the current fixel TDs
+          Gradient_queue queue (gradient_vector);
 
           // Remove candidate streamlines one at a time, and correspondingly modify the fixels to which they were attributed
           removed_this_iteration = 0;
@@ -176,17 +171,16 @@ namespace MR
 
             } else { // Proceed as normal
 
-              const vector<Cost_fn_gradient_sort>::iterator candidate = sorter.get();
-
-              const track_t candidate_index = candidate->get_tck_index();
+              const Cost_fn_gradient_sort* const candidate = queue.get();
 
-              if (candidate->get_cost_gradient() >= 0.0) {
+              if (!candidate || candidate->get_cost_gradient() >= 0.0) {
                 recalculate = POS_GRADIENT;
                 if (!removed_this_iteration)
                   another_iteration = false;
                 goto end_iteration;
               }
 
+              const track_t candidate_index = candidate->get_tck_index();
               assert (candidate_index != num_tracks());
               assert (contributions[candidate_index]);
 
@@ -219,14 +213,8 @@ namespace MR
               if (this_actual_cf_change < std::min ( {required_cf_change_ratio, required_cf_change_quantisation, this_nonlinearity })) {
 
                 // Candidate streamline removal meets all criteria; remove from reconstruction
-                for (size_t f = 0; f != candidate_contribution.dim(); ++f) {
-                  const Track_fixel_contribution& fixel_cont = candidate_contribution[f];
-                  fixels[fixel_cont.get_fixel_index()] -= fixel_cont.get_length();
-                }
-                TD_sum -= candidate_contribution.get_total_contribution();
                 contributing_length_removed += candidate_contribution.get_total_length();
-                delete contributions[candidate_index];
-                contributions[candidate_index] = nullptr;
+                remove_track (candidate_index, gradient_vector, queue, current_mu, current_TD_sum);
                 ++removed_this_iteration;
                 --tracks_remaining;
 
@@ -446,6 +434,70 @@ namespace MR
 
 
 
+      void SIFTer::remove_track (const track_t index, vector<Cost_fn_gradient_sort>& gradient_vector, Gradient_queue& queue, const double current_mu, const double current_TD_sum)
+      {
+        assert (contributions[index]);
+        const TrackContribution& tck_cont (*contributions[index]);
+
+        // A streamline may have more than one entry for a particular fixel
+        vector<size_t> fixel_indices;
+        fixel_indices.reserve (tck_cont.dim());
+        for (size_t f = 0; f != tck_cont.dim(); ++f)
+          fixel_indices.push_back (tck_cont[f].get_fixel_index());
+        std::sort (fixel_indices.begin(), fixel_indices.end());
+        fixel_indices.erase (std::unique (fixel_indices.begin(), fixel_indices.end()), fixel_indices.end());
+
+        // The contribution of a fixel to the gradient of a streamline (as calculated in
+        //   calc_gradient()) depends only on the TD of that fixel; subtract these
+        //   contributions for all affected streamlines, modify the fixel TDs, and then
+        //   add the new contributions
+        vector<track_t> affected;
+        auto update = [&] (const double multiplier)
+        {
+          for (const auto f : fixel_indices) {
+            const Fixel& fixel = fixels[f];
+            const double d_cost_d_mu = fixel.get_d_cost_d_mu (current_mu);
+            const double cost = fixel.get_cost (current_mu);
+            for (const auto i : fixel_tracks[f]) {
+              const track_t t = i.get_track_index();
+              if (t == index || !contributions[t] || !contributions[t]->get_total_contribution())
+                continue;
+              const double mu_if_removed = FOD_sum / (current_TD_sum - contributions[t]->get_total_contribution());
+              const double change = fixel.get_cost_wo_track (mu_if_removed, i.get_length()) - cost - (d_cost_d_mu * (mu_if_removed - current_mu));
+              Cost_fn_gradient_sort& gradient (gradient_vector[t]);
+              gradient.set (t, gradient.get_cost_gradient() + (multiplier * change), gradient.get_gradient_per_unit_length());
+              if (multiplier < 0.0)
+                affected.push_back (t);
+            }
+          }
+        };
+
+        update (-1.0);
+        for (size_t f = 0; f != tck_cont.dim(); ++f)
+          fixels[tck_cont[f].get_fixel_index()] -= tck_cont[f].get_length();
+        TD_sum -= tck_cont.get_total_contribution();
+        update (1.0);
+
+        delete contributions[index];
+        contributions[index] = nullptr;
+        gradient_vector[index].set (num_tracks(), 0.0, 0.0);
+
+        std::sort (affected.begin(), affected.end());
+        affected.erase (std::unique (affected.begin(), affected.end()), affected.end());
+        for (const auto t : affected) {
+          Cost_fn_gradient_sort& gradient (gradient_vector[t]);
+          const double old_grad_per_unit_length = gradient.get_gradient_per_unit_length();
+          gradient.set (t, gradient.get_cost_gradient(), gradient.get_cost_gradient() / contributions[t]->get_total_contribution());
+          if (gradient.get_gradient_per_unit_length() < old_grad_per_unit_length)
+            queue.update (t);
+        }
+      }
+
+
+
+
+
+
       bool SIFTer::TrackGradientCalculator::operator() (const TrackIndexRange& in) const
       {
         for (track_t track_index = in.first; track_index != in.second; ++track_index) {
@@ -93,6 +93,8 @@ namespace MR
         using MapType::TD_sum;
         using MapType::proc_mask;
         using MapType::num_tracks;
+        using MapType::fixel_tracks;
+        using MapType::index_fixel_tracks;
 
 
         // User-controllable settings
@@ -109,6 +111,10 @@ namespace MR
         double calc_roc_cost_function() const;
         double calc_gradient (const track_t, const double, const double) const;
 
+        // Remove a contributing streamline from the reconstruction, and update the
+        //   gradients of all other streamlines that traverse the same fixels
+        void remove_track (const track_t, vector<Cost_fn_gradient_sort>&, Gradient_queue&, const double, const double);
+
 
 
         // For calculating the streamline removal gradients in a multi-threaded fashion
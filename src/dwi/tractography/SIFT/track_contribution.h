@@ -52,6 +52,9 @@ namespace MR
           uint32_t get_fixel_index() const { return (data & 0x00FFFFFF); }
           float    get_length()      const { return (uint32_t((data & 0xFF000000) >> 24) * scale_from_storage); }
 
+          // The length as stored internally; multiply by storage_scale() to get the length in mm
+          uint8_t  get_quantised_length() const { return uint8_t((data & 0xFF000000) >> 24); }
+
 
           bool add (const float length)
           {
@@ -80,6 +83,8 @@ namespace MR
           // Minimum length that will be non-zero once converted to an integer for word-sharing storage
           static float min() { return min_length_for_storage; }
 
+          static float storage_scale() { return scale_from_storage; }
+
 
         private:
           uint32_t data;
@@ -49,6 +49,39 @@ namespace MR
 
 
 
+
+      TrackIndexBlocks::TrackIndexBlocks (const track_t num_indices, const size_t num_blocks)
+      {
+        assert (num_blocks);
+        bounds.reserve (num_blocks + 1);
+        for (size_t i = 0; i != num_blocks; ++i)
+          bounds.push_back (track_t ((uint64_t(num_indices) * i) / num_blocks));
+        bounds.push_back (num_indices);
+      }
+
+
+
+      TrackIndexBlocks::TrackIndexBlocks (const vector<size_t>& costs, const size_t num_blocks)
+      {
+        assert (num_blocks);
+        uint64_t total = 0;
+        for (const auto c : costs)
+          total += c;
+        bounds.reserve (num_blocks + 1);
+        bounds.push_back (0);
+        uint64_t sum = 0;
+        track_t index = 0;
+        for (size_t i = 1; i != num_blocks; ++i) {
+          const uint64_t target = (total * i) / num_blocks;
+          while (index != costs.size() && sum + costs[index] <= target)
+            sum += costs[index++];
+          bounds.push_back (index);
+        }
+        bounds.push_back (costs.size());
+      }
+
+
+
       }
     }
   }
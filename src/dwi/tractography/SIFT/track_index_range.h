@@ -16,7 +16,10 @@
 #ifndef __dwi_tractography_sift_track_index_range_h__
 #define __dwi_tractography_sift_track_index_range_h__
 
+#include <atomic>
+
 #include "progressbar.h"
+#include "thread.h"
 #include "dwi/tractography/SIFT/types.h"
 
 namespace MR
@@ -61,6 +64,71 @@ namespace MR
 
 
 
+
+
+
+
+      // For processes that are repeated many times over the same range of indices
+      //   (e.g. each iteration of SIFT2), the range can instead be divided ahead of
+      //   time into one contiguous block per thread, to be processed using run_blocks().
+      //   This avoids the overhead of the queue; and since each block is processed by
+      //   exactly one thread, results can be accumulated separately for each block
+      //   without any locking, and then combined in a fixed order.
+      class TrackIndexBlocks
+      { MEMALIGN(TrackIndexBlocks)
+
+        public:
+          // Blocks containing (approximately) equal numbers of indices
+          TrackIndexBlocks (const track_t num_indices, const size_t num_blocks = default_num_blocks());
+          // Blocks of (approximately) equal total cost, given the cost of each index
+          TrackIndexBlocks (const vector<size_t>& costs, const size_t num_blocks = default_num_blocks());
+
+          size_t size() const { return bounds.size() - 1; }
+          TrackIndexRange operator[] (const size_t i) const { assert (i < size()); return TrackIndexRange (bounds[i], bounds[i+1]); }
+
+          static size_t default_num_blocks() { return std::max (Thread::number_of_threads(), size_t(1)); }
+
+        private:
+          vector<track_t> bounds;
+
+      };
+
+
+
+      template <class Functor>
+      class __BlockRunner
+      { MEMALIGN(__BlockRunner<Functor>)
+        public:
+          __BlockRunner (const TrackIndexBlocks& blocks, const Functor& functor) :
+              blocks (blocks),
+              functor (functor),
+              next (new std::atomic<size_t> (0)) { }
+          __BlockRunner (const __BlockRunner&) = default;
+          void execute()
+          {
+            size_t block;
+            while ((block = (*next)++) < blocks.size())
+              functor (blocks[block], block);
+          }
+        private:
+          const TrackIndexBlocks& blocks;
+          Functor functor;
+          std::shared_ptr<std::atomic<size_t>> next;
+      };
+
+      // Process each block using a separate copy of the functor, invoked as
+      //   functor (TrackIndexRange, block_index)
+      template <class Functor>
+      void run_blocks (const TrackIndexBlocks& blocks, const Functor& functor, const std::string& name = "SIFT blocks")
+      {
+        __BlockRunner<Functor> runner (blocks, functor);
+        auto threads = Thread::run (Thread::multi (runner, blocks.size()), name);
+        threads.wait();
+      }
+
+
+
+
       }
     }
   }
@@ -13,8 +13,6 @@
  */
 
 
-#include <mutex>
-
 #include "dwi/tractography/SIFT2/coeff_optimiser.h"
 #include "dwi/tractography/SIFT2/line_search.h"
 #include "dwi/tractography/SIFT2/tckfactor.h"
@@ -31,7 +29,7 @@ namespace MR {
 
 
 
-      CoefficientOptimiserBase::CoefficientOptimiserBase (TckFactor& tckfactor, StreamlineStats& step_stats, StreamlineStats& coefficient_stats, unsigned int& nonzero_streamlines, BitSet& fixels_to_exclude, double& sum_costs) :
+      CoefficientOptimiserBase::CoefficientOptimiserBase (TckFactor& tckfactor, vector<CoefficientOptimiserResult>& results) :
             master (tckfactor),
             mu (tckfactor.mu()),
 #ifdef SIFT2_COEFF_OPTIMISER_DEBUG
@@ -41,16 +39,8 @@ namespace MR {
             step_truncated (0),
             coeff_truncated (0),
 #endif
-            step_stats (step_stats),
-            coefficient_stats (coefficient_stats),
-            nonzero_streamlines (nonzero_streamlines),
-            fixels_to_exclude (fixels_to_exclude),
-            sum_costs (sum_costs),
-            local_stats_steps (),
-            local_stats_coefficients (),
-            local_nonzero_count (0),
-            local_to_exclude (fixels_to_exclude.size()),
-            local_sum_costs (0.0) { }
+            results (results),
+            result (nullptr) { }
 
 
 
@@ -64,37 +54,26 @@ namespace MR {
             step_truncated (0),
             coeff_truncated (0),
 #endif
-            step_stats (that.step_stats),
-            coefficient_stats (that.coefficient_stats),
-            nonzero_streamlines (that.nonzero_streamlines),
-            fixels_to_exclude (that.fixels_to_exclude),
-            sum_costs (that.sum_costs),
-            local_stats_steps (),
-            local_stats_coefficients (),
-            local_nonzero_count (0),
-            local_to_exclude (fixels_to_exclude.size()),
-            local_sum_costs (0.0) { }
+            results (that.results),
+            result (nullptr) { }
 
 
 
       CoefficientOptimiserBase::~CoefficientOptimiserBase()
       {
-        std::lock_guard<std::mutex> lock (master.mutex);
 #ifdef SIFT2_COEFF_OPTIMISER_DEBUG
         fprintf (stderr, "%ld of %ld initial searches failed, %ld in wrong direction, %ld steps truncated, %ld coefficients truncated\n", failed, total, wrong_dir, step_truncated, coeff_truncated);
 #endif
-        step_stats += local_stats_steps;
-        coefficient_stats += local_stats_coefficients;
-        nonzero_streamlines += local_nonzero_count;
-        fixels_to_exclude |= local_to_exclude;
-        sum_costs += local_sum_costs;
       }
 
 
 
-      bool CoefficientOptimiserBase::operator() (const SIFT::TrackIndexRange& range)
+      bool CoefficientOptimiserBase::operator() (const SIFT::TrackIndexRange& range, const size_t block)
       {
 
+        assert (block < results.size());
+        result = &results[block];
+
         for (SIFT::track_t track_index = range.first; track_index != range.second; ++track_index) {
 
           double dFs = get_coeff_change (track_index);
@@ -134,10 +113,10 @@ namespace MR {
           master.coefficients[track_index] = new_coefficient;
 
           // Update the stats
-          local_stats_steps += dFs;
-          local_stats_coefficients += new_coefficient;
+          result->step_stats += dFs;
+          result->coefficient_stats += new_coefficient;
           if (master.contributions[track_index] && master.contributions[track_index]->dim() && new_coefficient > master.min_coeff)
-            ++local_nonzero_count;
+            ++result->nonzero_streamlines;
 
 #ifdef STREAMLINE_OF_INTEREST
           if (track_index == STREAMLINE_OF_INTEREST) {
@@ -193,7 +172,7 @@ namespace MR {
         }
 
         if (index_to_exclude)
-          local_to_exclude[index_to_exclude] = true;
+          result->fixels_to_exclude[index_to_exclude] = true;
         else
           return 0.0;
 
@@ -226,8 +205,8 @@ namespace MR {
 
 
 
-      CoefficientOptimiserGSS::CoefficientOptimiserGSS (TckFactor& tckfactor, StreamlineStats& step_stats, StreamlineStats& coefficient_stats, unsigned int& nonzero_streamlines, BitSet& fixels_to_exclude, double& sum_costs) :
-            CoefficientOptimiserBase (tckfactor, step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs) { }
+      CoefficientOptimiserGSS::CoefficientOptimiserGSS (TckFactor& tckfactor, vector<CoefficientOptimiserResult>& results) :
+            CoefficientOptimiserBase (tckfactor, results) { }
 
       CoefficientOptimiserGSS::CoefficientOptimiserGSS (const CoefficientOptimiserGSS& that) :
             CoefficientOptimiserBase (that) { }
@@ -252,8 +231,8 @@ namespace MR {
 
 
 
-      CoefficientOptimiserQLS::CoefficientOptimiserQLS (TckFactor& tckfactor, StreamlineStats& step_stats, StreamlineStats& coefficient_stats, unsigned int& nonzero_streamlines, BitSet& fixels_to_exclude, double& sum_costs) :
-            CoefficientOptimiserBase (tckfactor, step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs),
+      CoefficientOptimiserQLS::CoefficientOptimiserQLS (TckFactor& tckfactor, vector<CoefficientOptimiserResult>& results) :
+            CoefficientOptimiserBase (tckfactor, results),
             qls (-master.max_coeff_step, master.max_coeff_step)
       {
         qls.set_exit_if_outside_bounds (false);
@@ -298,8 +277,8 @@ namespace MR {
 
 
 
-      CoefficientOptimiserIterative::CoefficientOptimiserIterative (TckFactor& tckfactor, StreamlineStats& step_stats, StreamlineStats& coefficient_stats, unsigned int& nonzero_streamlines, BitSet& fixels_to_exclude, double& sum_costs) :
-            CoefficientOptimiserBase (tckfactor, step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs)
+      CoefficientOptimiserIterative::CoefficientOptimiserIterative (TckFactor& tckfactor, vector<CoefficientOptimiserResult>& results) :
+            CoefficientOptimiserBase (tckfactor, results)
 #ifdef SIFT2_COEFF_OPTIMISER_DEBUG
       , iter_count (0)
 #endif
@@ -315,7 +294,6 @@ namespace MR {
       CoefficientOptimiserIterative::~CoefficientOptimiserIterative()
       {
 #ifdef SIFT2_COEFF_OPTIMISER_DEBUG
-        Thread::Mutex::Lock lock (master.mutex);
         fprintf (stderr, "Mean number of iterations: %f\n", iter_count / float(total));
 #endif
       }
@@ -371,7 +349,7 @@ namespace MR {
         iter_count += iter;
 #endif
 
-        local_sum_costs += line_search_functor (0.0);
+        result->sum_costs += line_search_functor (0.0);
 
         return dFs;
       }
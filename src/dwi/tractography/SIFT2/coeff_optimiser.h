@@ -18,6 +18,7 @@
 
 
 #include "bitset.h"
+#include "types.h"
 
 #include "math/golden_section_search.h"
 #include "math/quadratic_line_search.h"
@@ -42,14 +43,33 @@ namespace MR {
 
 
 
+      // Outcomes of the optimisation of the coefficients of one block of streamlines
+      //   (see SIFT::TrackIndexBlocks); these are combined by TckFactor once all
+      //   blocks have been processed
+      class CoefficientOptimiserResult
+      { MEMALIGN(CoefficientOptimiserResult)
+        public:
+          CoefficientOptimiserResult (const size_t num_fixels) :
+              nonzero_streamlines (0),
+              fixels_to_exclude (num_fixels),
+              sum_costs (0.0) { }
+
+          StreamlineStats step_stats, coefficient_stats;
+          unsigned int nonzero_streamlines;
+          BitSet fixels_to_exclude;
+          double sum_costs;
+      };
+
+
+
       class CoefficientOptimiserBase
       { MEMALIGN(CoefficientOptimiserBase)
         public:
-          CoefficientOptimiserBase (TckFactor&, StreamlineStats&, StreamlineStats&, unsigned int&, BitSet&, double&);
+          CoefficientOptimiserBase (TckFactor&, vector<CoefficientOptimiserResult>&);
           CoefficientOptimiserBase (const CoefficientOptimiserBase&);
           virtual ~CoefficientOptimiserBase();
 
-          bool operator() (const SIFT::TrackIndexRange&);
+          bool operator() (const SIFT::TrackIndexRange&, const size_t block);
 
 
         protected:
@@ -65,18 +85,11 @@ namespace MR {
 
 
         private:
-          StreamlineStats& step_stats;
-          StreamlineStats& coefficient_stats;
-          unsigned int& nonzero_streamlines;
-          BitSet& fixels_to_exclude;
-          double& sum_costs;
-
-          StreamlineStats local_stats_steps, local_stats_coefficients;
-          size_t local_nonzero_count;
-          BitSet local_to_exclude;
+          vector<CoefficientOptimiserResult>& results;
 
         protected:
-          mutable double local_sum_costs;
+          // The results for the block currently being processed by this thread
+          CoefficientOptimiserResult* result;
 
         private:
           double do_fixel_exclusion (const SIFT::track_t);
@@ -95,7 +108,7 @@ namespace MR {
       { MEMALIGN(CoefficientOptimiserGSS)
 
         public:
-          CoefficientOptimiserGSS (TckFactor&, StreamlineStats&, StreamlineStats&, unsigned int&, BitSet&, double&);
+          CoefficientOptimiserGSS (TckFactor&, vector<CoefficientOptimiserResult>&);
           CoefficientOptimiserGSS (const CoefficientOptimiserGSS&);
           ~CoefficientOptimiserGSS() { }
 
@@ -115,7 +128,7 @@ namespace MR {
       { MEMALIGN(CoefficientOptimiserQLS)
 
         public:
-          CoefficientOptimiserQLS (TckFactor&, StreamlineStats&, StreamlineStats&, unsigned int&, BitSet&, double&);
+          CoefficientOptimiserQLS (TckFactor&, vector<CoefficientOptimiserResult>&);
           CoefficientOptimiserQLS (const CoefficientOptimiserQLS&);
           ~CoefficientOptimiserQLS() { }
 
@@ -135,7 +148,7 @@ namespace MR {
       { MEMALIGN(CoefficientOptimiserIterative)
 
         public:
-          CoefficientOptimiserIterative (TckFactor&, StreamlineStats&, StreamlineStats&, unsigned int&, BitSet&, double&);
+          CoefficientOptimiserIterative (TckFactor&, vector<CoefficientOptimiserResult>&);
           CoefficientOptimiserIterative (const CoefficientOptimiserIterative&);
           ~CoefficientOptimiserIterative();
 
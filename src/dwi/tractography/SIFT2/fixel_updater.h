@@ -32,22 +32,25 @@ namespace MR {
       class TckFactor;
 
 
+      // Calculates the streamline density and mean weighting coefficient in each fixel
+      // Rather than each thread processing a range of streamlines, and accumulating
+      //   the contributions to all fixels in local storage, each thread processes a
+      //   block of fixels (despite the use of TrackIndexRange), and obtains the
+      //   streamlines traversing each fixel from the fixel-streamline index; the
+      //   results can therefore be written directly to the fixels.
       class FixelUpdater
       { MEMALIGN(FixelUpdater)
 
         public:
-          FixelUpdater (TckFactor&);
-          ~FixelUpdater();
+          // weighting_factors: the exponential of the weighting coefficient of each streamline,
+          //   or zero if the coefficient is at its minimum
+          FixelUpdater (TckFactor&, const vector<double>& weighting_factors);
 
-          bool operator() (const SIFT::TrackIndexRange& range);
+          bool operator() (const SIFT::TrackIndexRange& range, const size_t block);
 
         private:
           TckFactor& master;
-
-          // Each thread needs a local copy of these
-          vector<double> fixel_coeff_sums;
-          vector<double> fixel_TDs;
-          vector<SIFT::track_t> fixel_counts;
+          const vector<double>& weighting_factors;
 
       };
 
@@ -13,8 +13,6 @@
  */
 
 
-#include <mutex>
-
 #include "dwi/tractography/SIFT2/reg_calculator.h"
 #include "dwi/tractography/SIFT2/tckfactor.h"
 
@@ -30,26 +28,16 @@ namespace MR {
 
 
 
-      RegularisationCalculator::RegularisationCalculator (TckFactor& tckfactor, double& cf_reg_tik, double& cf_reg_tv) :
+      RegularisationCalculator::RegularisationCalculator (TckFactor& tckfactor, vector<double>& cf_reg_tik, vector<double>& cf_reg_tv) :
         master (tckfactor),
         cf_reg_tik (cf_reg_tik),
-        cf_reg_tv (cf_reg_tv),
-        tikhonov_sum (0.0),
-        tv_sum (0.0) { }
-
-
-
-      RegularisationCalculator::~RegularisationCalculator()
-      {
-        std::lock_guard<std::mutex> lock (master.mutex);
-        cf_reg_tik += tikhonov_sum;
-        cf_reg_tv  += tv_sum;
-      }
+        cf_reg_tv (cf_reg_tv) { }
 
 
 
-      bool RegularisationCalculator::operator() (const SIFT::TrackIndexRange& range)
+      bool RegularisationCalculator::operator() (const SIFT::TrackIndexRange& range, const size_t block)
       {
+        double tikhonov_sum = 0.0, tv_sum = 0.0;
         for (SIFT::track_t track_index = range.first; track_index != range.second; ++track_index) {
           const double coefficient = master.coefficients[track_index];
           tikhonov_sum += Math::pow2 (coefficient);
@@ -63,6 +51,8 @@ namespace MR {
           }
           tv_sum += this_tv_sum;
         }
+        cf_reg_tik[block] = tikhonov_sum;
+        cf_reg_tv [block] = tv_sum;
         return true;
       }
 
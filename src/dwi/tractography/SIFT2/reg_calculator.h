@@ -17,6 +17,8 @@
 #define __dwi_tractography_sift2_reg_calculator_h__
 
 
+#include "types.h"
+
 #include "dwi/tractography/SIFT/track_index_range.h"
 #include "dwi/tractography/SIFT/types.h"
 
@@ -32,23 +34,21 @@ namespace MR {
       class TckFactor;
 
 
+      // Each block of streamlines (see SIFT::TrackIndexBlocks) writes its sums of
+      //   regularisation terms to the corresponding elements of the vectors provided
       class RegularisationCalculator
       { NOMEMALIGN
 
         public:
-          RegularisationCalculator (TckFactor&, double&, double&);
-          ~RegularisationCalculator();
+          RegularisationCalculator (TckFactor&, vector<double>&, vector<double>&);
 
-          bool operator() (const SIFT::TrackIndexRange& range);
+          bool operator() (const SIFT::TrackIndexRange& range, const size_t block);
 
 
         private:
           TckFactor& master;
-          double& cf_reg_tik;
-          double& cf_reg_tv;
-
-          // Each thread needs a local copy of these
-          double tikhonov_sum, tv_sum;
+          vector<double>& cf_reg_tik;
+          vector<double>& cf_reg_tv;
 
       };
 
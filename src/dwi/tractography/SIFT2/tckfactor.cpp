@@ -167,11 +167,7 @@ namespace MR {
           i->clear_TD();
           i->clear_mean_coeff();
         }
-        {
-          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
-          FixelUpdater worker (*this);
-          Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
-        }
+        update_fixels();
 
         VAR (calc_cost_function());
 
@@ -233,6 +229,15 @@ namespace MR {
         //   due to driving streamlines to unwanted high weights
         BitSet fixels_to_exclude (fixels.size());
 
+        // The same partitioning of streamlines between threads is used in every iteration;
+        //   the cost of optimising each streamline coefficient scales with its length
+        vector<size_t> track_costs (num_tracks());
+        for (SIFT::track_t i = 0; i != num_tracks(); ++i)
+          track_costs[i] = 1 + (contributions[i] ? contributions[i]->dim() : 0);
+        const SIFT::TrackIndexBlocks track_blocks (track_costs);
+        vector<CoefficientOptimiserResult> optimiser_results;
+        vector<double> block_reg_tik (track_blocks.size()), block_reg_tv (track_blocks.size());
+
         do {
 
           ++iter;
@@ -243,12 +248,19 @@ namespace MR {
           nonzero_streamlines = 0;
           fixels_to_exclude.clear();
           double sum_costs = 0.0;
+          optimiser_results.assign (track_blocks.size(), CoefficientOptimiserResult (fixels.size()));
           {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
-            //CoefficientOptimiserGSS worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
-            //CoefficientOptimiserQLS worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
-            CoefficientOptimiserIterative worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
-            Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
+            //CoefficientOptimiserGSS worker (*this, /*projected_steps,*/ optimiser_results);
+            //CoefficientOptimiserQLS worker (*this, /*projected_steps,*/ optimiser_results);
+            CoefficientOptimiserIterative worker (*this, /*projected_steps,*/ optimiser_results);
+            SIFT::run_blocks (track_blocks, worker, "SIFT2 coefficient optimisation");
+          }
+          for (const auto& i : optimiser_results) {
+            step_stats += i.step_stats;
+            coefficient_stats += i.coefficient_stats;
+            nonzero_streamlines += i.nonzero_streamlines;
+            fixels_to_exclude |= i.fixels_to_exclude;
+            sum_costs += i.sum_costs;
           }
           step_stats.normalise();
           coefficient_stats.normalise();
@@ -270,11 +282,7 @@ namespace MR {
             i->clear_TD();
             i->clear_mean_coeff();
           }
-          {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
-            FixelUpdater worker (*this);
-            Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
-          }
+          update_fixels();
           // Scale the fixel mean coefficient terms (each streamline in the fixel is weighted by its length)
           for (vector<Fixel>::iterator i = fixels.begin(); i != fixels.end(); ++i)
             i->normalise_mean_coeff();
@@ -286,10 +294,10 @@ namespace MR {
           //   streamline weighting coefficients and the new fixel mean coefficients
           // Log different regularisation costs separately
           double cf_reg_tik = 0.0, cf_reg_tv = 0.0;
-          {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
-            RegularisationCalculator worker (*this, cf_reg_tik, cf_reg_tv);
-            Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
+          SIFT::run_blocks (track_blocks, RegularisationCalculator (*this, block_reg_tik, block_reg_tv), "SIFT2 regularisation");
+          for (size_t i = 0; i != track_blocks.size(); ++i) {
+            cf_reg_tik += block_reg_tik[i];
+            cf_reg_tv  += block_reg_tv [i];
           }
           cf_reg_tik *= reg_multiplier_tikhonov;
           cf_reg_tv  *= reg_multiplier_tv;
@@ -318,6 +326,23 @@ namespace MR {
 
 
 
+      void TckFactor::update_fixels()
+      {
+        index_fixel_tracks();
+        vector<double> weighting_factors (num_tracks());
+        for (SIFT::track_t i = 0; i != num_tracks(); ++i)
+          weighting_factors[i] = (coefficients[i] > min_coeff) ? std::exp (coefficients[i]) : 0.0;
+        // Fixels, rather than streamlines, are distributed across threads, such
+        //   that each thread processes a similar number of streamline-fixel entries
+        vector<size_t> fixel_costs (fixels.size());
+        for (size_t i = 0; i != fixels.size(); ++i)
+          fixel_costs[i] = 1 + fixel_tracks[i].size();
+        SIFT::run_blocks (SIFT::TrackIndexBlocks (fixel_costs), FixelUpdater (*this, weighting_factors), "SIFT2 fixel update");
+      }
+
+
+
+
       void TckFactor::output_factors (const std::string& path) const
       {
         if (size_t(coefficients.size()) != contributions.size())
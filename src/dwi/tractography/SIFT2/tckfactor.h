@@ -19,7 +19,6 @@
 
 #include <fstream>
 #include <limits>
-#include <mutex>
 
 #include "image.h"
 #include "types.h"
@@ -127,11 +126,12 @@ namespace MR {
           friend class RegularisationCalculator;
 
 
-          // For when multiple threads are trying to write their final information back
-          std::mutex mutex;
-
           void indicate_progress() { if (App::log_level) fprintf (stderr, "."); }
 
+          // Multi-threaded calculation of the streamline density, and mean weighting
+          //   coefficient, in each fixel (after these have been cleared)
+          void update_fixels();
+
       };
 
 
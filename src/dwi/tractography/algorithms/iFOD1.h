@@ -101,7 +101,7 @@ namespace MR
 
         size_t lmax, max_trials;
         float sin_max_angle;
-        Math::SH::PrecomputedAL<float> precomputer;
+        Math::SH::PrecomputedBasis<float> precomputer;
 
         private:
         mutable double mean_samples, mean_truncations, max_max_truncation;
@@ -34,7 +34,13 @@ namespace MR
           + Argument ("number").type_integer (2, 100)
 
         + Option ("power", "raise the FOD to the power specified (default is 1/nsamples).")
-          + Argument ("value").type_float (0.0);
+          + Argument ("value").type_float (0.0)
+
+        + Option ("batch", "evaluate the FOD amplitudes along up to this number of candidate paths at once, "
+                           "using vectorised matrix operations; this typically increases throughput, "
+                           "but alters the sequence of random numbers used relative to the default "
+                           "(Default: " + str(TCKGEN_DEFAULT_IFOD2_BATCH) + ", i.e. each candidate path is evaluated individually).")
+          + Argument ("number").type_integer (1, 1000);
 
 
         void load_iFOD2_options (Tractography::Properties& properties)
@@ -44,6 +50,9 @@ namespace MR
 
           opt = get_options ("power");
           if (opt.size()) properties["fod_power"] = str<float> (opt[0][0]);
+
+          opt = get_options ("batch");
+          if (opt.size()) properties["path_batch_size"] = str<unsigned int> (opt[0][0]);
         }
 
       }
@@ -29,6 +29,7 @@
 
 
 #define TCKGEN_DEFAULT_IFOD2_NSAMPLES 4
+#define TCKGEN_DEFAULT_IFOD2_BATCH 1
 
 
 
@@ -56,6 +57,7 @@ namespace MR
                   lmax (Math::SH::LforN (source.size(3))),
                   num_samples (TCKGEN_DEFAULT_IFOD2_NSAMPLES),
                   max_trials (TCKGEN_DEFAULT_MAX_TRIALS_PER_STEP),
+                  batch_size (TCKGEN_DEFAULT_IFOD2_BATCH),
                   sin_max_angle (std::sin (max_angle)),
                   mean_samples (0.0),
                   mean_truncations (0.0),
@@ -81,6 +83,9 @@ namespace MR
                 properties.set (lmax, "lmax");
                 properties.set (num_samples, "samples_per_step");
                 properties.set (max_trials, "max_trials");
+                properties.set (batch_size, "path_batch_size");
+                if (batch_size < 1)
+                  throw Exception ("iFOD2 path batch size must be at least 1");
                 fod_power = 1.0/num_samples;
                 properties.set (fod_power, "fod_power");
                 bool precomputed = true;
@@ -133,9 +138,9 @@ namespace MR
 
                 float internal_step_size() const override { return step_size / float(num_samples); }
 
-                size_t lmax, num_samples, max_trials;
+                size_t lmax, num_samples, max_trials, batch_size;
                 float sin_max_angle, fod_power;
-                Math::SH::PrecomputedAL<float> precomputer;
+                Math::SH::PrecomputedBasis<float> precomputer;
 
               private:
                 mutable double mean_samples, mean_truncations, max_max_truncation;
@@ -241,6 +246,9 @@ end_init:
                 return CONTINUE;
               }
 
+              if (S.batch_size > 1)
+                return next_batched();
+
               Eigen::Vector3f next_pos, next_dir;
 
               float max_val = 0.0;
@@ -352,6 +360,17 @@ end_init:
             //   in the arc - more dense structural image sampling
             size_t sample_idx;
 
+            // Candidate paths, the FOD amplitudes along which are evaluated together
+            class Batch { MEMALIGN(Batch)
+              public:
+                vector<Eigen::Vector3f> end_dirs, positions, tangents;
+                vector<bool> evaluate;
+                vector<float> probs, last_half_log_probN;
+                Eigen::MatrixXf coefs, basis;
+                Eigen::RowVectorXf amplitudes;
+                Eigen::VectorXf delta;
+            } batch;
+
 
 
             FORCE_INLINE float FOD (const Eigen::Vector3f& direction) const
@@ -380,6 +399,151 @@ end_init:
 
 
 
+            // As next(), but with the candidate paths for calibration and for
+            //   rejection sampling evaluated in batches via batch_path_probs()
+            term_t next_batched ()
+            {
+              batch.end_dirs.clear();
+              for (const auto& d : calibrate_list)
+                batch.end_dirs.push_back (rotate_direction (dir, d));
+              batch_path_probs();
+
+              float max_val = 0.0;
+              for (const auto val : batch.probs) {
+                if (std::isnan (val))
+                  return EXIT_IMAGE;
+                else if (val > max_val)
+                  max_val = val;
+              }
+
+              if (max_val <= 0.0)
+                return CALIBRATOR;
+
+              max_val *= calibrate_ratio;
+
+              num_sample_runs++;
+
+              // Any paths generated beyond the one accepted are wasted; the first
+              //   batch is therefore sized according to the mean number of trials
+              //   required so far, with subsequent batches growing in size
+              size_t num_paths = std::min (S.batch_size, size_t (std::ceil (float(mean_sample_num) / float(num_sample_runs))) + 1);
+
+              for (size_t n = 0; n < S.max_trials; num_paths = std::min (2 * num_paths, S.batch_size)) {
+                batch.end_dirs.resize (std::min (num_paths, S.max_trials - n));
+                for (auto& d : batch.end_dirs)
+                  d = rand_dir (dir);
+                batch_path_probs();
+
+                for (size_t i = 0; i != batch.end_dirs.size(); ++i, ++n) {
+                  const float val = batch.probs[i];
+
+                  if (val > max_val) {
+                    DEBUG ("max_val exceeded!!! (val = " + str(val) + ", max_val = " + str (max_val) + ")");
+                    ++num_truncations;
+                    if (val/max_val > max_truncation)
+                      max_truncation = val/max_val;
+                  }
+
+                  if (uniform(*rng) < val/max_val) {
+                    mean_sample_num += n;
+                    half_log_prob0 = batch.last_half_log_probN[i];
+                    std::copy_n (batch.positions.begin() + i*S.num_samples, S.num_samples, positions.begin());
+                    std::copy_n (batch.tangents.begin() + i*S.num_samples, S.num_samples, tangents.begin());
+                    pos = positions[0];
+                    dir = tangents [0];
+                    sample_idx = 0;
+                    return CONTINUE;
+                  }
+                }
+              }
+
+              return BAD_SIGNAL;
+            }
+
+
+
+            // Compute the probabilities of all paths ending in batch.end_dirs;
+            //   the interpolated FOD coefficients and the SH basis at all points
+            //   along all paths are gathered into matrices, such that all FOD
+            //   amplitudes are obtained in a single vectorised operation
+            void batch_path_probs ()
+            {
+              const size_t num_paths = batch.end_dirs.size();
+              const size_t num_points = num_paths * S.num_samples;
+              batch.positions.resize (num_points);
+              batch.tangents.resize (num_points);
+              batch.evaluate.assign (num_paths, true);
+              batch.probs.resize (num_paths);
+              batch.last_half_log_probN.resize (num_paths);
+              batch.coefs.resize (values.size(), num_points);
+              batch.basis.resize (values.size(), num_points);
+
+              for (size_t p = 0; p != num_paths; ++p) {
+                get_path (calib_positions, calib_tangents, batch.end_dirs[p]);
+                const size_t first = p * S.num_samples;
+                std::copy (calib_positions.begin(), calib_positions.end(), batch.positions.begin() + first);
+                std::copy (calib_tangents.begin(), calib_tangents.end(), batch.tangents.begin() + first);
+
+                // Early exit for ACT when path is not sensible
+                if (S.is_act()) {
+                  if (!act().fetch_tissue_data (calib_positions[S.num_samples - 1])) {
+                    batch.probs[p] = NaN;
+                    batch.evaluate[p] = false;
+                  } else if (act().tissues().get_csf() >= 0.5) {
+                    batch.probs[p] = 0.0;
+                    batch.evaluate[p] = false;
+                  }
+                }
+
+                for (size_t i = first; i != first + S.num_samples; ++i) {
+                  if (batch.evaluate[p] && source.scanner (batch.positions[i])) {
+                    source.row (3, batch.coefs.col (i));
+                    if (S.precomputer) {
+                      S.precomputer.basis (batch.basis.col (i), batch.tangents[i]);
+                    } else {
+                      Math::SH::delta (batch.delta, batch.tangents[i], S.lmax);
+                      batch.basis.col (i) = batch.delta;
+                    }
+                  } else {
+                    batch.coefs.col (i).setConstant (NaN);
+                    batch.basis.col (i).setOnes();
+                  }
+                }
+              }
+
+              batch.amplitudes = (batch.basis.array() * batch.coefs.array()).colwise().sum();
+
+              for (size_t p = 0; p != num_paths; ++p) {
+                if (batch.evaluate[p])
+                  batch.probs[p] = batch_path_prob (p);
+              }
+            }
+
+
+            float batch_path_prob (const size_t p)
+            {
+              float log_prob = half_log_prob0;
+              for (size_t i = 0; i < S.num_samples; ++i) {
+
+                float fod_amp = batch.amplitudes[p*S.num_samples + i];
+                if (std::isnan (fod_amp))
+                  return NaN;
+                if (fod_amp < S.threshold)
+                  return 0.0;
+                fod_amp = std::log (fod_amp);
+                if (i < S.num_samples-1) {
+                  log_prob += fod_amp;
+                } else {
+                  batch.last_half_log_probN[p] = 0.5*fod_amp;
+                  log_prob += batch.last_half_log_probN[p];
+                }
+              }
+
+              return std::exp (S.fod_power * log_prob);
+            }
+
+
+
             float path_prob (vector<Eigen::Vector3f>& positions, vector<Eigen::Vector3f>& tangents)
             {
 
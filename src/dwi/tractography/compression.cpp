@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "dwi/tractography/compression.h"
+
+#include <cstring>
+#include <zlib.h>
+
+#include "raw.h"
+#include "file/config.h"
+
+
+namespace MR {
+  namespace DWI {
+    namespace Tractography {
+      namespace Compression {
+
+
+
+        namespace {
+
+          inline uint32_t float_bits (const float value) {
+            uint32_t bits;
+            memcpy (&bits, &value, sizeof (bits));
+            return bits;
+          }
+
+          inline float bits_float (const uint32_t bits) {
+            float value;
+            memcpy (&value, &bits, sizeof (value));
+            return value;
+          }
+
+          inline uint64_t zigzag_encode (const int64_t value) { return (uint64_t(value) << 1) ^ uint64_t(value >> 63); }
+          inline int64_t zigzag_decode (const uint64_t value) { return int64_t(value >> 1) ^ -int64_t(value & 1); }
+
+        }
+
+
+
+        //CONF option: TrackCompressionEncoding
+        //CONF default: float32
+        //CONF The encoding of vertex positions to use when writing compressed
+        //CONF track files (.tckz). Options are: float32 (lossless for
+        //CONF single-precision data); float16 (half-precision displacements
+        //CONF between successive vertices); and quantised (positions rounded
+        //CONF to a grid with spacing set by TrackCompressionStep).
+
+        //CONF option: TrackCompressionStep
+        //CONF default: 0.001
+        //CONF The grid spacing (in mm) to which vertex positions are rounded
+        //CONF when writing compressed track files (.tckz) with the quantised
+        //CONF encoding.
+        Settings Settings::from_config ()
+        {
+          const std::string encoding = lowercase (File::Config::get ("TrackCompressionEncoding", "float32"));
+          if (encoding == "quantised")
+            return parse ("quantised " + File::Config::get ("TrackCompressionStep", "0.001"));
+          return parse (encoding);
+        }
+
+
+
+        Settings Settings::parse (const std::string& specifier)
+        {
+          const auto fields = split (lowercase (specifier), " \t", true);
+          if (fields.size() == 1 && fields[0] == "float32")
+            return Settings (encoding_t::FLOAT32);
+          if (fields.size() == 1 && fields[0] == "float16")
+            return Settings (encoding_t::FLOAT16);
+          if (fields.size() == 2 && fields[0] == "quantised") {
+            const double step = to<double> (fields[1]);
+            if (!(step > 0.0))
+              throw Exception ("invalid grid spacing for quantised track compression: " + fields[1]);
+            return Settings (encoding_t::QUANTISED, step);
+          }
+          throw Exception ("unsupported track compression \"" + specifier + "\"");
+        }
+
+
+
+        std::string Settings::specifier () const
+        {
+          switch (encoding) {
+            case encoding_t::FLOAT32: return "float32";
+            case encoding_t::FLOAT16: return "float16";
+            case encoding_t::QUANTISED: return "quantised " + str(step, 10);
+            default: assert (0); return "";
+          }
+        }
+
+
+
+
+        uint16_t float_to_half (const float value)
+        {
+          const uint32_t bits = float_bits (value);
+          const uint16_t sign = (bits >> 16) & 0x8000;
+          const uint32_t float_exponent = (bits >> 23) & 0xFF;
+          uint32_t mantissa = bits & 0x7FFFFF;
+          if (float_exponent == 0xFF)
+            return sign | 0x7C00 | (mantissa ? 0x0200 : 0);
+          const int32_t exponent = int32_t(float_exponent) - 127 + 15;
+          if (exponent >= 31)
+            return sign | 0x7C00;
+          if (exponent <= 0) {
+            // Sub-normal half-precision value
+            if (exponent < -10)
+              return sign;
+            mantissa |= 0x800000;
+            const uint32_t shift = 14 - exponent;
+            uint32_t half = mantissa >> shift;
+            const uint32_t remainder = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half & 1)))
+              ++half;
+            return sign | half;
+          }
+          // Round to nearest even; overflow of the mantissa correctly
+          //   increments the exponent
+          uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+          const uint32_t remainder = mantissa & 0x1FFF;
+          if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+            ++half;
+          return sign | half;
+        }
+
+
+
+        float half_to_float (const uint16_t value)
+        {
+          const uint32_t sign = uint32_t(value & 0x8000) << 16;
+          int32_t exponent = (value >> 10) & 0x1F;
+          uint32_t mantissa = value & 0x03FF;
+          if (exponent == 0x1F)
+            return bits_float (sign | 0x7F800000 | (mantissa << 13));
+          if (!exponent) {
+            if (!mantissa)
+              return bits_float (sign);
+            // Sub-normal half-precision value: normalise
+            exponent = 1;
+            while (!(mantissa & 0x0400)) {
+              mantissa <<= 1;
+              --exponent;
+            }
+            mantissa &= 0x03FF;
+          }
+          return bits_float (sign | (uint32_t(exponent + 127 - 15) << 23) | (mantissa << 13));
+        }
+
+
+
+
+
+        void BlockEncoder::finalise (vector<uint8_t>& data)
+        {
+          if (empty())
+            return;
+          uLongf stored_size = compressBound (payload.size());
+          const size_t offset = data.size();
+          data.resize (offset + block_header_size + stored_size);
+          if (compress2 (data.data() + offset + block_header_size, &stored_size, payload.data(), payload.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+            throw Exception ("error compressing streamline data");
+          data.resize (offset + block_header_size + stored_size);
+          Raw::store_LE<uint32_t> (num_streamlines, data.data() + offset, 0);
+          Raw::store_LE<uint32_t> (stored_size, data.data() + offset, 1);
+          Raw::store_LE<uint32_t> (payload.size(), data.data() + offset, 2);
+          num_streamlines = 0;
+          payload.clear();
+        }
+
+
+
+        void BlockEncoder::add_point (const double x, const double y, const double z)
+        {
+          const double p[3] = { x, y, z };
+          switch (settings.encoding) {
+
+            case encoding_t::FLOAT32:
+              for (size_t i = 0; i != 3; ++i) {
+                const uint32_t bits = float_bits (float (p[i]));
+                put_varint (first_point ? bits : (bits ^ prev_bits[i]));
+                prev_bits[i] = bits;
+              }
+              break;
+
+            case encoding_t::FLOAT16:
+              for (size_t i = 0; i != 3; ++i) {
+                if (first_point) {
+                  prev_decoded[i] = float (p[i]);
+                  const uint32_t bits = ByteOrder::LE (float_bits (prev_decoded[i]));
+                  put_bytes (&bits, sizeof (bits));
+                } else {
+                  const uint16_t half = float_to_half (float (p[i]) - prev_decoded[i]);
+                  if ((half & 0x7C00) == 0x7C00)
+                    throw Exception ("streamline vertex displacement too large for float16 track compression");
+                  prev_decoded[i] += half_to_float (half);
+                  const uint16_t stored = ByteOrder::LE (half);
+                  put_bytes (&stored, sizeof (stored));
+                }
+              }
+              break;
+
+            case encoding_t::QUANTISED:
+              for (size_t i = 0; i != 3; ++i) {
+                const int64_t grid = std::llround (p[i] / settings.step);
+                put_varint (zigzag_encode (first_point ? grid : grid - prev_grid[i]));
+                prev_grid[i] = grid;
+              }
+              break;
+
+            default:
+              assert (0);
+          }
+          first_point = false;
+        }
+
+
+
+        void BlockEncoder::put_varint (uint64_t value)
+        {
+          while (value >= 0x80) {
+            payload.push_back (uint8_t (value | 0x80));
+            value >>= 7;
+          }
+          payload.push_back (uint8_t (value));
+        }
+
+
+
+        void BlockEncoder::put_bytes (const void* data, const size_t size)
+        {
+          const uint8_t* p = reinterpret_cast<const uint8_t*> (data);
+          payload.insert (payload.end(), p, p + size);
+        }
+
+
+
+
+
+
+        bool BlockDecoder::read_header (const uint8_t* data, uint32_t& num_streamlines, uint32_t& stored_size, uint32_t& payload_size)
+        {
+          num_streamlines = Raw::fetch_LE<uint32_t> (data, 0);
+          stored_size = Raw::fetch_LE<uint32_t> (data, 1);
+          payload_size = Raw::fetch_LE<uint32_t> (data, 2);
+          return num_streamlines;
+        }
+
+
+
+        void BlockDecoder::load (const uint8_t* data, const uint32_t num_streamlines, const uint32_t stored_size, const uint32_t payload_size)
+        {
+          payload.resize (payload_size);
+          uLongf size = payload_size;
+          if (uncompress (payload.data(), &size, data, stored_size) != Z_OK || size != payload_size)
+            throw Exception ("error decompressing streamline data");
+          remaining = num_streamlines;
+          position = 0;
+        }
+
+
+
+        void BlockDecoder::get_point (double* p)
+        {
+          switch (settings.encoding) {
+
+            case encoding_t::FLOAT32:
+              for (size_t i = 0; i != 3; ++i) {
+                const uint32_t value = get_varint();
+                prev_bits[i] = first_point ? value : (value ^ prev_bits[i]);
+                p[i] = bits_float (prev_bits[i]);
+              }
+              break;
+
+            case encoding_t::FLOAT16:
+              for (size_t i = 0; i != 3; ++i) {
+                if (first_point) {
+                  uint32_t bits;
+                  get_bytes (&bits, sizeof (bits));
+                  prev_decoded[i] = bits_float (ByteOrder::LE (bits));
+                } else {
+                  uint16_t half;
+                  get_bytes (&half, sizeof (half));
+                  prev_decoded[i] += half_to_float (ByteOrder::LE (half));
+                }
+                p[i] = prev_decoded[i];
+              }
+              break;
+
+            case encoding_t::QUANTISED:
+              for (size_t i = 0; i != 3; ++i) {
+                const int64_t value = zigzag_decode (get_varint());
+                prev_grid[i] = first_point ? value : prev_grid[i] + value;
+                p[i] = prev_grid[i] * settings.step;
+              }
+              break;
+
+            default:
+              assert (0);
+          }
+          first_point = false;
+        }
+
+
+
+        uint64_t BlockDecoder::get_varint ()
+        {
+          uint64_t value = 0;
+          for (size_t shift = 0; shift < 64; shift += 7) {
+            if (position >= payload.size())
+              throw Exception ("malformed compressed streamline data");
+            const uint8_t byte = payload[position++];
+            value |= uint64_t (byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+              return value;
+          }
+          throw Exception ("malformed compressed streamline data");
+          return value;
+        }
+
+
+
+        void BlockDecoder::get_bytes (void* data, const size_t size)
+        {
+          if (position + size > payload.size())
+            throw Exception ("malformed compressed streamline data");
+          memcpy (data, payload.data() + position, size);
+          position += size;
+        }
+
+
+
+      }
+    }
+  }
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __dwi_tractography_compression_h__
+#define __dwi_tractography_compression_h__
+
+#include "exception.h"
+#include "types.h"
+#include "dwi/tractography/streamline.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Compression
+      {
+
+
+        /** \defgroup track_compression Compressed track files
+         * \brief Encoding & decoding of compressed (.tckz) track files
+         *
+         * A compressed track file has the same header as a .tck file, with an
+         * additional "compression" entry describing how vertex positions are
+         * encoded. The data that follow consist of a series of blocks, each
+         * of which can be decoded independently of all others; this permits
+         * both streaming and parallel reading of the file.
+         *
+         * Each block begins with three little-endian 32-bit unsigned
+         * integers: the number of streamlines in the block, the size of the
+         * block payload in bytes as stored in the file, and the size of the
+         * payload once decompressed. A block header containing zeroes marks
+         * the end of the data (analogous to the barrier in .tck files). The
+         * payload itself is compressed using zlib.
+         *
+         * Within the decompressed payload, each streamline is stored as the
+         * number of vertices (as a variable-length integer), followed by the
+         * first vertex, followed by the difference between each subsequent
+         * vertex and the previous one. Positions can be encoded as:
+         * - \c float32: the bit patterns of single-precision coordinates,
+         *   each XOR'ed with that of the previous vertex; this is lossless
+         *   for single-precision data.
+         * - \c float16: half-precision displacements between vertices. To
+         *   prevent the accumulation of rounding errors along the streamline,
+         *   each displacement is computed relative to the previously
+         *   \e decoded vertex position.
+         * - \c quantised: positions are rounded to a fixed grid (with the
+         *   spacing in mm provided in the header), and the integer
+         *   displacements stored as variable-length integers.
+         * @{ */
+
+
+        enum class encoding_t { NONE, FLOAT32, FLOAT16, QUANTISED };
+
+
+        //! the size in bytes of the header of each block
+        constexpr size_t block_header_size = 12;
+        //! the size of decompressed payload at which a new block is started when writing
+        constexpr size_t block_size = 1048576;
+
+
+        //! The encoding used within a compressed track file
+        class Settings
+        { NOMEMALIGN
+          public:
+            Settings () : encoding (encoding_t::NONE), step (0.0) { }
+            Settings (const encoding_t encoding, const double step = 0.0) : encoding (encoding), step (step) { }
+
+            //! encoding for new files, as specified in the MRtrix config file
+            static Settings from_config ();
+            //! encoding as specified in the "compression" entry of a track file header
+            static Settings parse (const std::string& specifier);
+            //! the "compression" entry to be written to the track file header
+            std::string specifier () const;
+
+            operator bool () const { return encoding != encoding_t::NONE; }
+
+            encoding_t encoding;
+            double step;
+        };
+
+
+
+        //! convert a single-precision floating-point value to half-precision
+        uint16_t float_to_half (const float value);
+        //! convert a half-precision floating-point value to single-precision
+        float half_to_float (const uint16_t value);
+
+
+
+        //! Accumulates streamlines into a compressed block
+        class BlockEncoder
+        { NOMEMALIGN
+          public:
+            BlockEncoder (const Settings& settings) :
+                settings (settings),
+                num_streamlines (0) { }
+
+            template <class ValueType>
+            void add (const Streamline<ValueType>& tck) {
+              put_varint (tck.size());
+              begin_streamline();
+              for (const auto& p : tck)
+                add_point (double(p[0]), double(p[1]), double(p[2]));
+              ++num_streamlines;
+            }
+
+            size_t size () const { return num_streamlines; }
+            size_t payload_size () const { return payload.size(); }
+            bool empty () const { return !num_streamlines; }
+
+            //! append the compressed block (including header) to \a data, and reset
+            void finalise (vector<uint8_t>& data);
+
+          protected:
+            const Settings settings;
+            size_t num_streamlines;
+            vector<uint8_t> payload;
+            // State of the previous vertex along the current streamline
+            bool first_point;
+            uint32_t prev_bits[3];
+            float prev_decoded[3];
+            int64_t prev_grid[3];
+
+            void begin_streamline () { first_point = true; }
+            void add_point (const double x, const double y, const double z);
+            void put_varint (uint64_t value);
+            void put_bytes (const void* data, const size_t size);
+        };
+
+
+
+        //! Decodes the streamlines within a compressed block
+        class BlockDecoder
+        { NOMEMALIGN
+          public:
+            BlockDecoder (const Settings& settings) :
+                settings (settings),
+                remaining (0),
+                position (0) { }
+
+            //! read the header of a block
+            /*! \returns \c false if this is the end-of-data marker */
+            static bool read_header (const uint8_t* data, uint32_t& num_streamlines, uint32_t& stored_size, uint32_t& payload_size);
+
+            //! decompress a block (excluding the header) in preparation for decoding
+            void load (const uint8_t* data, const uint32_t num_streamlines, const uint32_t stored_size, const uint32_t payload_size);
+
+            //! the number of streamlines not yet decoded from the current block
+            size_t size () const { return remaining; }
+
+            //! decode the next streamline in the block
+            /*! \returns \c false if all streamlines in the block have already been decoded */
+            template <class ValueType>
+            bool operator() (Streamline<ValueType>& tck) {
+              tck.clear();
+              if (!remaining)
+                return false;
+              const uint64_t num_points = get_varint();
+              // Each vertex occupies at least three bytes
+              if (num_points > (payload.size() - position) / 3)
+                throw Exception ("malformed compressed streamline data");
+              tck.resize (num_points);
+              begin_streamline();
+              double p[3];
+              for (auto& vertex : tck) {
+                get_point (p);
+                vertex = { ValueType(p[0]), ValueType(p[1]), ValueType(p[2]) };
+              }
+              --remaining;
+              return true;
+            }
+
+          protected:
+            const Settings settings;
+            size_t remaining, position;
+            vector<uint8_t> payload;
+            bool first_point;
+            uint32_t prev_bits[3];
+            float prev_decoded[3];
+            int64_t prev_grid[3];
+
+            void begin_streamline () { first_point = true; }
+            void get_point (double* p);
+            uint64_t get_varint ();
+            void get_bytes (void* data, const size_t size);
+        };
+
+
+        //! @}
+
+      }
+    }
+  }
+}
+
+
+#endif
+
@@ -106,6 +106,23 @@ const OptionGroup MetricOptions = OptionGroup ("Structural connectome metric opt
 
 
 
+namespace {
+  void setup_metric_file (Metric& metric)
+  {
+    auto opt = get_options ("scale_file");
+    if (opt.size()) {
+      try {
+        metric.set_scale_file (opt[0][0]);
+      } catch (Exception& e) {
+        throw Exception (e, "-scale_file option expects a file containing a list of numbers (one for each streamline); "
+                            "file \"" + std::string(opt[0][0]) + "\" does not appear to contain this");
+      }
+    }
+  }
+}
+
+
+
 void setup_metric (Metric& metric, Image<node_t>& nodes_data)
 {
   if (get_options ("scale_length").size()) {
@@ -117,15 +134,36 @@ void setup_metric (Metric& metric, Image<node_t>& nodes_data)
   }
   if (get_options ("scale_invnodevol").size())
     metric.set_scale_invnodevol (nodes_data);
-  auto opt = get_options ("scale_file");
-  if (opt.size()) {
-    try {
-      metric.set_scale_file (opt[0][0]);
-    } catch (Exception& e) {
-      throw Exception (e, "-scale_file option expects a file containing a list of numbers (one for each streamline); "
-                          "file \"" + std::string(opt[0][0]) + "\" does not appear to contain this");
-    }
+  setup_metric_file (metric);
+}
+
+
+
+// Set up a metric from a comma-separated list of scaling factors rather than
+//   the command-line options; option -scale_file nevertheless applies
+void setup_metric (Metric& metric, Image<node_t>& nodes_data, const std::string& spec)
+{
+  bool length = false, invlength = false, invnodevol = false;
+  for (const auto& entry : split (lowercase (spec), ",", true)) {
+    const std::string name = strip (entry);
+    if (name == "length")
+      length = true;
+    else if (name == "invlength")
+      invlength = true;
+    else if (name == "invnodevol")
+      invnodevol = true;
+    else if (name != "none")
+      throw Exception ("Unknown connectome metric \"" + name + "\" in \"" + spec + "\" (options are: none, length, invlength, invnodevol)");
   }
+  if (length && invlength)
+    throw Exception ("Connectome metric cannot be scaled by both length and inverse length (\"" + spec + "\")");
+  if (length)
+    metric.set_scale_length();
+  else if (invlength)
+    metric.set_scale_invlength();
+  if (invnodevol)
+    metric.set_scale_invnodevol (nodes_data);
+  setup_metric_file (metric);
 }
 
 
@@ -50,6 +50,7 @@ Tck2nodes_base* load_assignment_mode (Image<node_t>&);
 
 extern const App::OptionGroup MetricOptions;
 void setup_metric (Metric&, Image<node_t>&);
+void setup_metric (Metric&, Image<node_t>&, const std::string&);
 
 
 
@@ -41,38 +41,12 @@ const App::Option EdgeStatisticOption
 template <typename T>
 bool Matrix<T>::operator() (const Mapped_track_nodepair& in)
 {
-  assert (in.get_first_node()  < mat2vec->mat_size());
-  assert (in.get_second_node() < mat2vec->mat_size());
-  assert (assignments_lists.empty());
-  if (is_vector()) {
-    assert (assignments_pairs.empty());
-    apply_data (in.get_second_node(), in.get_factor(), in.get_weight());
-    inc_count (in.get_second_node(), in.get_weight());
-    if (track_assignments) {
-      if (in.get_track_index() == assignments_single.size()) {
-        assignments_single.push_back (in.get_second_node());
-      } else if (in.get_track_index() < assignments_single.size()) {
-        assignments_single[in.get_track_index()] = in.get_second_node();
-      } else {
-        assignments_single.resize (in.get_track_index() + 1, 0);
-        assignments_single[in.get_track_index()] = in.get_second_node();
-      }
-    }
-  } else {
-    assert (assignments_single.empty());
-    apply_data (in.get_first_node(), in.get_second_node(), in.get_factor(), in.get_weight());
-    inc_count (in.get_first_node(), in.get_second_node(), in.get_weight());
-    if (track_assignments) {
-      if (in.get_track_index() == assignments_pairs.size()) {
-        assignments_pairs.push_back (in.get_nodes());
-      } else if (in.get_track_index() < assignments_pairs.size()) {
-        assignments_pairs[in.get_track_index()] = in.get_nodes();
-      } else {
-        assignments_pairs.resize (in.get_track_index() + 1, std::make_pair<size_t, size_t> (0, 0));
-        assignments_pairs[in.get_track_index()] = in.get_nodes();
-      }
-    }
-  }
+  assert (in.get_first_node()  < node_count);
+  assert (in.get_second_node() < node_count);
+  if (is_vector())
+    apply (uint64_t (in.get_second_node()), in.get_factor(), in.get_weight());
+  else
+    apply (in.get_first_node(), in.get_second_node(), in.get_factor(), in.get_weight());
   return true;
 }
 
@@ -81,52 +55,53 @@ bool Matrix<T>::operator() (const Mapped_track_nodepair& in)
 template <typename T>
 bool Matrix<T>::operator() (const Mapped_track_nodelist& in)
 {
-  assert (assignments_single.empty());
-  assert (assignments_pairs.empty());
-  vector<node_t> list (in.get_nodes());
+  const vector<node_t>& list (in.get_nodes());
   for (vector<node_t>::const_iterator i = list.begin(); i != list.end(); ++i) {
-    assert (*i < data.rows());
+    assert (*i < node_count);
   }
   if (is_vector()) {
     if (list.empty()) {
-      apply_data (0, in.get_factor(), in.get_weight());
-      inc_count (0, in.get_weight());
-      list.push_back (0);
+      apply (uint64_t (0), in.get_factor(), in.get_weight());
     } else {
-      for (vector<node_t>::const_iterator n = list.begin(); n != list.end(); ++n) {
-        apply_data (*n, in.get_factor(), in.get_weight());
-        inc_count (*n, in.get_weight());
-      }
+      for (vector<node_t>::const_iterator n = list.begin(); n != list.end(); ++n)
+        apply (uint64_t (*n), in.get_factor(), in.get_weight());
     }
   } else { // Matrix output
     if (list.empty()) {
-      apply_data (0, 0, in.get_factor(), in.get_weight());
-      inc_count (0, 0, in.get_weight());
-      list.push_back (0);
+      apply (0, 0, in.get_factor(), in.get_weight());
     } else if (list.size() == 1) {
-      apply_data (0, list.front(), in.get_factor(), in.get_weight());
-      inc_count (0, list.front(), in.get_weight());
+      apply (0, list.front(), in.get_factor(), in.get_weight());
     } else {
       for (size_t i = 0; i != list.size(); ++i) {
-        for (size_t j = i; j != list.size(); ++j) {
-          apply_data (list[i], list[j], in.get_factor(), in.get_weight());
-          inc_count (list[i], list[j], in.get_weight());
-        }
+        for (size_t j = i; j != list.size(); ++j)
+          apply (list[i], list[j], in.get_factor(), in.get_weight());
       }
     }
   }
-  if (track_assignments) {
-    std::sort (list.begin(), list.end());
-    if (in.get_track_index() == assignments_lists.size()) {
-      assignments_lists.push_back (std::move (list));
-    } else if (in.get_track_index() < assignments_lists.size()) {
-      assignments_lists[in.get_track_index()] = std::move (list);
-    } else {
-      assignments_lists.resize (in.get_track_index() + 1, vector<node_t>());
-      assignments_lists[in.get_track_index()] = std::move (list);
+  return true;
+}
+
+
+
+template <typename T>
+void Matrix<T>::merge (const Matrix& that)
+{
+  assert (!sparse);
+  assert (that.statistic == statistic);
+  assert (that.vector_output == vector_output);
+  assert (that.node_count == node_count);
+  if (that.sparse) {
+    for (const auto& i : that.sparse_data) {
+      combine (data[i.first], i.second.first);
+      if (statistic == stat_edge::MEAN)
+        counts[i.first] += i.second.second;
     }
+  } else {
+    for (ssize_t i = 0; i != data.size(); ++i)
+      combine (data[i], that.data[i]);
+    if (statistic == stat_edge::MEAN)
+      counts += that.counts;
   }
-  return true;
 }
 
 
@@ -190,27 +165,6 @@ void Matrix<T>::error_check (const std::set<node_t>& missing_nodes)
 
 
 
-template <typename T>
-void Matrix<T>::write_assignments (const std::string& path) const
-{
-  if (!track_assignments)
-    throw Exception ("Cannot write streamline assignments to file as they were not stored during processing");
-  File::OFStream stream (path);
-  for (auto i = assignments_single.begin(); i != assignments_single.end(); ++i)
-    stream << str(*i) << "\n";
-  for (auto i = assignments_pairs.begin(); i != assignments_pairs.end(); ++i)
-    stream << str(i->first) << " " << str(i->second) << "\n";
-  for (auto i = assignments_lists.begin(); i != assignments_lists.end(); ++i) {
-    assert (i->size());
-    stream << str((*i)[0]);
-    for (size_t j = 1; j != i->size(); ++j)
-      stream << " " << str((*i)[j]);
-    stream << "\n";
-  }
-}
-
-
-
 template <typename T>
 void Matrix<T>::save (const std::string& path,
                       const bool keep_unassigned,
@@ -256,22 +210,30 @@ void Matrix<T>::save (const std::string& path,
 
 
 template <typename T>
-void Matrix<T>::apply_data (const size_t index, const T value, const T weight)
+void Matrix<T>::apply (const uint64_t index, const T value, const T weight)
 {
-  T& target = data[index];
-  apply_data (target, value, weight);
+  if (sparse) {
+    std::pair<T, T>& target (sparse_data.insert (std::make_pair (index, std::make_pair (initial_value(), T(0)))).first->second);
+    apply (target.first, value, weight);
+    target.second += weight;
+    return;
+  }
+  apply (data[index], value, weight);
+  if (statistic == stat_edge::MEAN) {
+    assert (counts.size());
+    counts[index] += weight;
+  }
 }
 
 template <typename T>
-void Matrix<T>::apply_data (const size_t node_one, const size_t node_two, const T value, const T weight)
+void Matrix<T>::apply (const node_t node_one, const node_t node_two, const T value, const T weight)
 {
   assert (mat2vec);
-  T& target = data[(*mat2vec) (node_one, node_two)];
-  apply_data (target, value, weight);
+  apply ((*mat2vec) (node_one, node_two), value, weight);
 }
 
 template <typename T>
-void Matrix<T>::apply_data (T& target, const T value, const T weight)
+void Matrix<T>::apply (T& target, const T value, const T weight) const
 {
   switch (statistic) {
     case stat_edge::SUM:
@@ -288,22 +250,20 @@ void Matrix<T>::apply_data (T& target, const T value, const T weight)
 }
 
 template <typename T>
-void Matrix<T>::inc_count (const size_t index, const T weight)
+void Matrix<T>::combine (T& target, const T value) const
 {
-  if (statistic != stat_edge::MEAN)
-    return;
-  assert (counts.size());
-  counts[index] += weight;
-}
-
-template <typename T>
-void Matrix<T>::inc_count (const size_t node_one, const size_t node_two, const T weight)
-{
-  if (statistic != stat_edge::MEAN)
-    return;
-  assert (counts.size());
-  assert (mat2vec);
-  counts[(*mat2vec) (node_one, node_two)] += weight;
+  switch (statistic) {
+    case stat_edge::SUM:
+    case stat_edge::MEAN:
+      target += value;
+      return;
+    case stat_edge::MIN:
+      target = std::min (target, value);
+      break;
+    case stat_edge::MAX:
+      target = std::max (target, value);
+      break;
+  }
 }
 
 
@@ -313,6 +273,32 @@ template class Matrix<double>;
 
 
 
+bool WriteAssignments::operator() (const Mapped_track_nodepair& in)
+{
+  if (vector_output)
+    out << str(in.get_second_node()) << "\n";
+  else
+    out << str(in.get_first_node()) << " " << str(in.get_second_node()) << "\n";
+  return true;
+}
+
+bool WriteAssignments::operator() (const Mapped_track_nodelist& in)
+{
+  vector<node_t> list (in.get_nodes());
+  if (list.empty()) {
+    out << "0\n";
+    return true;
+  }
+  std::sort (list.begin(), list.end());
+  out << str(list[0]);
+  for (size_t i = 1; i != list.size(); ++i)
+    out << " " << str(list[i]);
+  out << "\n";
+  return true;
+}
+
+
+
 }
 }
 }
@@ -16,16 +16,21 @@
 #ifndef __dwi_tractography_connectome_matrix_h__
 #define __dwi_tractography_connectome_matrix_h__
 
+#include <mutex>
 #include <set>
+#include <unordered_map>
 
 #include "types.h"
 
 #include "connectome/connectome.h"
 #include "connectome/mat2vec.h"
 #include "math/math.h"
+#include "file/ofstream.h"
 
 #include "dwi/tractography/connectome/connectome.h"
 #include "dwi/tractography/connectome/mapped_track.h"
+#include "dwi/tractography/connectome/metric.h"
+#include "dwi/tractography/connectome/tck2nodes.h"
 
 
 namespace MR {
@@ -52,38 +57,43 @@ class Matrix
   public:
     using vector_type = Eigen::Matrix<T, Eigen::Dynamic, 1>;
 
-    Matrix (const node_t max_node_index, const stat_edge stat, const bool vector_output, const bool track_assignments) :
+    // If partial is set, the matrix is intended to accumulate the contributions
+    //   of only a subset of streamlines (e.g. those processed by a single thread),
+    //   to be subsequently merged into a complete matrix; for very large numbers
+    //   of nodes, only those edges to which streamlines are assigned are then stored
+    Matrix (const node_t max_node_index, const stat_edge stat, const bool vector_output, const bool partial = false) :
         statistic (stat),
         vector_output (vector_output),
-        track_assignments (track_assignments),
+        node_count (max_node_index + 1),
         mat2vec (vector_output ?
                  nullptr :
-                 new MR::Connectome::Mat2Vec (max_node_index+1)),
-        data   (vector_type::Zero (vector_output ?
-                                   (max_node_index + 1) :
-                                   mat2vec->vec_size())),
-        counts (stat == stat_edge::MEAN ?
+                 new MR::Connectome::Mat2Vec (node_count)),
+        sparse (partial && !vector_output && node_count > node_count_ram_limit),
+        data   (sparse ?
+                vector_type() :
+                vector_type::Constant (vector_output ?
+                                       node_count :
+                                       mat2vec->vec_size(),
+                                       initial_value())),
+        counts (stat == stat_edge::MEAN && !sparse ?
                 vector_type::Zero (vector_output ?
-                                   (max_node_index + 1) :
+                                   node_count :
                                    mat2vec->vec_size()) :
-                vector_type())
-    {
-      if (statistic == stat_edge::MIN)
-        data = vector_type::Constant (vector_output ? (max_node_index + 1) : mat2vec->vec_size(), std::numeric_limits<T>::infinity());
-      else if (statistic == stat_edge::MAX)
-        data = vector_type::Constant (vector_output ? (max_node_index + 1) : mat2vec->vec_size(), -std::numeric_limits<T>::infinity());
-    }
+                vector_type()) { }
 
     bool operator() (const Mapped_track_nodepair&);
     bool operator() (const Mapped_track_nodelist&);
 
+    // Add the data accumulated within another instance to this one
+    void merge (const Matrix&);
+
     void finalize();
 
     void error_check (const std::set<node_t>&);
 
-    void write_assignments (const std::string&) const;
-
     bool is_vector() const { return (vector_output); }
+    stat_edge get_statistic() const { return statistic; }
+    node_t max_node_index() const { return node_count - 1; }
 
     void save (const std::string&, const bool, const bool, const bool) const;
 
@@ -91,25 +101,172 @@ class Matrix
   private:
     const stat_edge statistic;
     const bool vector_output;
-    const bool track_assignments;
+    const node_t node_count;
 
     const std::unique_ptr<MR::Connectome::Mat2Vec> mat2vec;
 
+    const bool sparse;
     vector_type data, counts;
-    vector<node_t> assignments_single;
-    vector<NodePair> assignments_pairs;
-    vector< vector<node_t> > assignments_lists;
+    std::unordered_map<uint64_t, std::pair<T, T>> sparse_data;
+
+    T initial_value() const
+    {
+      return statistic == stat_edge::MIN ?
+             std::numeric_limits<T>::infinity() :
+             (statistic == stat_edge::MAX ? -std::numeric_limits<T>::infinity() : T(0));
+    }
 
-    FORCE_INLINE void apply_data (const size_t, const T, const T);
-    FORCE_INLINE void apply_data (const size_t, const size_t, const T, const T);
-    FORCE_INLINE void apply_data (T&, const T, const T);
-    FORCE_INLINE void inc_count (const size_t, const T);
-    FORCE_INLINE void inc_count (const size_t, const size_t, const T);
+    FORCE_INLINE void apply (const uint64_t, const T, const T);
+    FORCE_INLINE void apply (const node_t, const node_t, const T, const T);
+    FORCE_INLINE void apply (T&, const T, const T) const;
+    FORCE_INLINE void combine (T&, const T) const;
 
 };
 
 
 
+// Functor for multi-threaded connectome construction: each thread maps
+//   streamlines to nodes and accumulates their contributions into its own
+//   local matrix, which is merged into the master matrix when the functor
+//   is destroyed. If streamline assignments are to be written, the mapped
+//   streamlines are also passed to the next stage of the pipeline.
+//
+// Additional connectomes (e.g. for different parcellation images and / or
+//   metrics) can be generated from the same streamlines using add(); the
+//   assignment of streamlines to nodes is performed only once for each
+//   distinct Tck2nodes_base instance. The assignments passed to the next
+//   stage of the pipeline are always those of the first connectome.
+template <typename T>
+class MatrixWorker
+{ MEMALIGN(MatrixWorker)
+
+  public:
+    MatrixWorker (Matrix<T>& master, const Tck2nodes_base& tck2nodes, const Metric& metric) :
+        mutex (new std::mutex)
+    {
+      add (master, tck2nodes, metric);
+    }
+
+    MatrixWorker (const MatrixWorker& that) :
+        tck2nodes (that.tck2nodes),
+        targets (that.targets),
+        mutex (that.mutex) { }
+
+    ~MatrixWorker()
+    {
+      std::lock_guard<std::mutex> lock (*mutex);
+      for (const auto& t : targets)
+        t.master->merge (*t.local);
+    }
+
+    // Must only be used prior to commencing processing
+    void add (Matrix<T>& master, const Tck2nodes_base& assignment, const Metric& metric)
+    {
+      assert (tck2nodes.empty() || assignment.provides_pair() == tck2nodes.front()->provides_pair());
+      size_t index = 0;
+      while (index != tck2nodes.size() && tck2nodes[index] != &assignment)
+        ++index;
+      if (index == tck2nodes.size())
+        tck2nodes.push_back (&assignment);
+      targets.push_back (Target (master, index, metric));
+    }
+
+    bool operator() (const Tractography::Streamline<float>& in)
+    {
+      if (tck2nodes.front()->provides_pair()) {
+        Mapped_track_nodepair out;
+        return (*this) (in, out);
+      }
+      Mapped_track_nodelist out;
+      return (*this) (in, out);
+    }
+
+    template <class MappedTrack>
+    bool operator() (const Tractography::Streamline<float>& in, MappedTrack& out)
+    {
+      MappedTrack temp;
+      for (size_t i = 0; i != tck2nodes.size(); ++i) {
+        MappedTrack& mapped (i ? temp : out);
+        assign (*tck2nodes[i], in, mapped);
+        for (auto& t : targets) {
+          if (t.assignment == i) {
+            mapped.set_factor ((*t.metric) (in, mapped.get_nodes()));
+            (*t.local) (mapped);
+          }
+        }
+      }
+      return true;
+    }
+
+  private:
+    // Copy-construction of a Target provides a new (empty) local matrix
+    class Target
+    { MEMALIGN(Target)
+      public:
+        Target (Matrix<T>& master, const size_t assignment, const Metric& metric) :
+            master (&master),
+            assignment (assignment),
+            metric (&metric) { reset_local(); }
+        Target (const Target& that) :
+            master (that.master),
+            assignment (that.assignment),
+            metric (that.metric) { reset_local(); }
+        void reset_local() { local.reset (new Matrix<T> (master->max_node_index(), master->get_statistic(), master->is_vector(), true)); }
+        Matrix<T>* master;
+        size_t assignment;
+        const Metric* metric;
+        std::unique_ptr<Matrix<T>> local;
+    };
+
+    vector<const Tck2nodes_base*> tck2nodes;
+    vector<Target> targets;
+    std::shared_ptr<std::mutex> mutex;
+
+    void assign (const Tck2nodes_base& assignment, const Tractography::Streamline<float>& in, Mapped_track_nodepair& out) const
+    {
+      out.set_track_index (in.index);
+      out.set_nodes (assignment (in));
+      out.set_weight (in.weight);
+    }
+
+    void assign (const Tck2nodes_base& assignment, const Tractography::Streamline<float>& in, Mapped_track_nodelist& out) const
+    {
+      out.set_track_index (in.index);
+      vector<node_t> nodes;
+      assignment (in, nodes);
+      out.set_nodes (std::move (nodes));
+      out.set_weight (in.weight);
+    }
+
+};
+
+
+
+// Write the node assignments of each streamline to file as they are generated;
+//   streamlines must be provided in order of index (see Mapping::Ordered)
+class WriteAssignments
+{ MEMALIGN(WriteAssignments)
+
+  public:
+    WriteAssignments (const std::string& path, const bool vector_output) :
+        out (path),
+        vector_output (vector_output) { }
+
+    bool operator() (const Mapped_track_nodepair&);
+    bool operator() (const Mapped_track_nodelist&);
+
+  private:
+    File::OFStream out;
+    const bool vector_output;
+
+};
+
+// Permit use of Mapping::Ordered with mapped streamlines
+inline size_t __index_of (const Mapped_track_nodepair& in) { return in.get_track_index(); }
+inline size_t __index_of (const Mapped_track_nodelist& in) { return in.get_track_index(); }
+
+
+
 extern template class Matrix<float>;
 extern template class Matrix<double>;
 
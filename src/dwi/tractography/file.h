@@ -73,6 +73,8 @@ namespace MR
           Reader (const std::string& file, Properties& properties) :
             current_index (0) {
               open (file, "tracks", properties);
+              if (compression)
+                decoder.reset (new Compression::BlockDecoder (compression));
               auto opt = App::get_options ("tck_weights_in");
               if (opt.size()) {
                 weights_file.reset (new std::ifstream (str(opt[0][0]).c_str(), std::ios_base::in));
@@ -89,6 +91,17 @@ namespace MR
               if (!in.is_open())
                 return false;
 
+              if (decoder) {
+                while (!(*decoder) (tck)) {
+                  if (!next_block()) {
+                    in.close();
+                    check_excess_weights();
+                    return false;
+                  }
+                }
+                return set_index_and_weight (tck);
+              }
+
               do {
                 auto p = get_next_point();
                 if (std::isinf (p[0])) {
@@ -102,25 +115,8 @@ namespace MR
                   return false;
                 }
 
-                if (std::isnan (p[0])) {
-                  tck.index = current_index++;
-
-                  if (weights_file) {
-
-                    (*weights_file) >> tck.weight;
-                    if (weights_file->fail()) {
-                      WARN ("Streamline weights file contains less entries than .tck file; only read " + str(current_index-1) + " streamlines");
-                      in.close();
-                      tck.clear();
-                      return false;
-                    }
-
-                  } else {
-                    tck.weight = 1.0;
-                  }
-
-                  return true;
-                }
+                if (std::isnan (p[0]))
+                  return set_index_and_weight (tck);
 
                 tck.push_back (p);
               } while (in.good());
@@ -134,9 +130,50 @@ namespace MR
         protected:
           using __ReaderBase__::in;
           using __ReaderBase__::dtype;
+          using __ReaderBase__::compression;
 
           uint64_t current_index;
           std::unique_ptr<std::ifstream> weights_file;
+          std::unique_ptr<Compression::BlockDecoder> decoder;
+          vector<uint8_t> block;
+
+          //! assign the index & weight of a streamline that has been read
+          bool set_index_and_weight (Streamline<ValueType>& tck)
+          {
+            tck.index = current_index++;
+
+            if (weights_file) {
+
+              (*weights_file) >> tck.weight;
+              if (weights_file->fail()) {
+                WARN ("Streamline weights file contains less entries than .tck file; only read " + str(current_index-1) + " streamlines");
+                in.close();
+                tck.clear();
+                return false;
+              }
+
+            } else {
+              tck.weight = 1.0;
+            }
+
+            return true;
+          }
+
+          //! read the next block of a compressed file into the decoder
+          bool next_block ()
+          {
+            uint8_t header[Compression::block_header_size];
+            in.read (reinterpret_cast<char*> (header), sizeof (header));
+            uint32_t num_streamlines, stored_size, payload_size;
+            if (!in.good() || !Compression::BlockDecoder::read_header (header, num_streamlines, stored_size, payload_size))
+              return false;
+            block.resize (stored_size);
+            in.read (reinterpret_cast<char*> (block.data()), stored_size);
+            if (!in.good())
+              return false;
+            decoder->load (block.data(), num_streamlines, stored_size, payload_size);
+            return true;
+          }
 
           //! takes care of byte ordering issues
 
@@ -216,6 +253,7 @@ namespace MR
           using __WriterBase__<ValueType>::total_count;
           using __WriterBase__<ValueType>::name;
           using __WriterBase__<ValueType>::dtype;
+          using __WriterBase__<ValueType>::compression;
           using __WriterBase__<ValueType>::create;
           using __WriterBase__<ValueType>::verify_stream;
           using __WriterBase__<ValueType>::update_counts;
@@ -227,8 +265,8 @@ namespace MR
           WriterUnbuffered (const std::string& file, const Properties& properties) :
               __WriterBase__<ValueType> (file) {
 
-            if (!Path::has_suffix (name, ".tck"))
-              throw Exception ("output track files must use the .tck suffix");
+            if (!Path::has_suffix (name, { ".tck", ".tckz" }))
+              throw Exception ("output track files must use the .tck or .tckz suffix");
 
             File::OFStream out;
             try {
@@ -243,9 +281,14 @@ namespace MR
             create (out, properties, "tracks");
             barrier_addr = out.tellp();
 
-            vector_type x;
-            format_point (barrier(), x);
-            out.write (reinterpret_cast<char*> (&x[0]), sizeof (x));
+            if (compression) {
+              const vector<char> end_marker (Compression::block_header_size, 0);
+              out.write (end_marker.data(), end_marker.size());
+            } else {
+              vector_type x;
+              format_point (barrier(), x);
+              out.write (reinterpret_cast<char*> (&x[0]), sizeof (x));
+            }
             if (!out.good())
               throw Exception ("error writing tracks file \"" + name + "\": " + strerror (errno));
             open_success = true;
@@ -257,15 +300,24 @@ namespace MR
 
           //! append track to file
           bool operator() (const Streamline<ValueType>& tck) {
-            // allocate buffer on the stack for performance:
-            NON_POD_VLA (buffer, vector_type, tck.size()+2);
-            for (size_t n = 0; n < tck.size(); ++n) {
-              assert (tck[n].allFinite());
-              format_point (tck[n], buffer[n]);
-            }
-            format_point (delimiter(), buffer[tck.size()]);
+            if (compression) {
+              // each streamline is written as its own block
+              Compression::BlockEncoder encoder (compression);
+              encoder.add (tck);
+              vector<uint8_t> data;
+              encoder.finalise (data);
+              commit (data);
+            } else {
+              // allocate buffer on the stack for performance:
+              NON_POD_VLA (buffer, vector_type, tck.size()+2);
+              for (size_t n = 0; n < tck.size(); ++n) {
+                assert (tck[n].allFinite());
+                format_point (tck[n], buffer[n]);
+              }
+              format_point (delimiter(), buffer[tck.size()]);
 
-            commit (buffer, tck.size()+1);
+              commit (buffer, tck.size()+1);
+            }
 
             if (weights_name.size())
               write_weights (str(tck.weight) + "\n");
@@ -318,16 +370,32 @@ namespace MR
           void commit (vector_type* data, size_t num_points) {
             if (num_points == 0 || !open_success)
               return;
+            format_point (barrier(), data[num_points]);
+            commit (reinterpret_cast<const char*> (data), sizeof (vector_type) * (num_points+1), sizeof (vector_type));
+          }
+
+          //! write compressed blocks to file
+          /*! The end-of-data marker is appended to \c data by this function. */
+          void commit (vector<uint8_t>& data) {
+            if (data.empty() || !open_success)
+              return;
+            data.resize (data.size() + Compression::block_header_size, 0);
+            commit (reinterpret_cast<const char*> (data.data()), data.size(), Compression::block_header_size);
+          }
 
+          //! write data to file, ending with a new barrier of size \c barrier_size
+          /*! The first \c barrier_size bytes of the data overwrite the previous
+           * barrier, and are written last; this ensures that the file remains
+           * valid for any other process reading it at any point in time. */
+          void commit (const char* data, size_t size, size_t barrier_size) {
             int64_t prev_barrier_addr = barrier_addr;
 
-            format_point (barrier(), data[num_points]);
             File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary | std::ios::ate);
-            out.write (reinterpret_cast<const char* const> (data+1), sizeof (vector_type) * num_points);
+            out.write (data + barrier_size, size - barrier_size);
             verify_stream (out);
-            barrier_addr = int64_t (out.tellp()) - sizeof(vector_type);
+            barrier_addr = int64_t (out.tellp()) - barrier_size;
             out.seekp (prev_barrier_addr, out.beg);
-            out.write (reinterpret_cast<const char* const> (data), sizeof(vector_type));
+            out.write (data, barrier_size);
             verify_stream (out);
             update_counts (out);
           }
@@ -354,6 +422,10 @@ namespace MR
        * to file concurrently. The size of the write-back buffer defaults to
        * 16MB, and can be set in the config file using the
        * TrackWriterBufferSize field (in bytes).
+       *
+       * If the output file has the .tckz suffix, streamlines are instead
+       * accumulated into compressed blocks (see \ref track_compression),
+       * which are committed to file once the same buffer capacity is reached.
        * */
       template <typename ValueType = float>
         class Writer : public WriterUnbuffered<ValueType>
@@ -361,6 +433,7 @@ namespace MR
         public:
           using __WriterBase__<ValueType>::count;
           using __WriterBase__<ValueType>::total_count;
+          using __WriterBase__<ValueType>::compression;
           using WriterUnbuffered<ValueType>::delimiter;
           using WriterUnbuffered<ValueType>::format_point;
           using WriterUnbuffered<ValueType>::weights_name;
@@ -381,8 +454,9 @@ namespace MR
           Writer (const std::string& file, const Properties& properties, size_t default_buffer_capacity = 16777216) :
             WriterUnbuffered<ValueType> (file, properties),
             buffer_capacity (File::Config::get_int ("TrackWriterBufferSize", default_buffer_capacity) / sizeof (vector_type)),
-            buffer (new vector_type [buffer_capacity]),
-            buffer_size (0) { }
+            buffer (compression ? nullptr : new vector_type [buffer_capacity]),
+            buffer_size (0),
+            encoder (compression ? new Compression::BlockEncoder (compression) : nullptr) { }
 
           Writer (const Writer& W) = delete;
 
@@ -393,14 +467,23 @@ namespace MR
 
           //! append track to file
           bool operator() (const Streamline<ValueType>& tck) {
-            if (buffer_size + tck.size() + 2 > buffer_capacity)
-              commit ();
+            if (encoder) {
+              encoder->add (tck);
+              if (encoder->payload_size() >= Compression::block_size) {
+                encoder->finalise (blocks);
+                if (blocks.size() >= buffer_capacity * sizeof (vector_type))
+                  commit ();
+              }
+            } else {
+              if (buffer_size + tck.size() + 2 > buffer_capacity)
+                commit ();
 
-            for (const auto& i : tck) {
-              assert (i.allFinite());
-              add_point (i);
+              for (const auto& i : tck) {
+                assert (i.allFinite());
+                add_point (i);
+              }
+              add_point (delimiter());
             }
-            add_point (delimiter());
 
             if (weights_name.size())
               weights_buffer += str (tck.weight) + ' ';
@@ -416,6 +499,10 @@ namespace MR
           std::unique_ptr<vector_type[]> buffer;
           size_t buffer_size;
           std::string weights_buffer;
+          // for compressed output: the block currently being encoded, and
+          //   those completed but not yet written to file
+          std::unique_ptr<Compression::BlockEncoder> encoder;
+          vector<uint8_t> blocks;
 
           //! add point to buffer and increment buffer_size accordingly
           void add_point (const vector_type& p) {
@@ -423,8 +510,14 @@ namespace MR
           }
 
           void commit () {
-            WriterUnbuffered<ValueType>::commit (buffer.get(), buffer_size);
-            buffer_size = 0;
+            if (encoder) {
+              encoder->finalise (blocks);
+              WriterUnbuffered<ValueType>::commit (blocks);
+              blocks.clear();
+            } else {
+              WriterUnbuffered<ValueType>::commit (buffer.get(), buffer_size);
+              buffer_size = 0;
+            }
 
             if (weights_name.size()) {
               write_weights (weights_buffer);
@@ -22,9 +22,22 @@ namespace MR {
 
 
       void __ReaderBase__::open (const std::string& file, const std::string& type, Properties& properties)
+      {
+        const File::Entry entry = parse (file, type, properties, dtype, compression);
+        in.open (entry.name.c_str(), std::ios::in | std::ios::binary);
+        if (!in)
+          throw Exception ("error opening " + type  + " data file \"" + entry.name + "\": " + strerror(errno));
+        in.seekg (entry.start);
+      }
+
+
+
+      File::Entry __ReaderBase__::parse (const std::string& file, const std::string& type, Properties& properties,
+                                         DataType& dtype, Compression::Settings& compression)
       {
         properties.clear();
         dtype = DataType::Undefined;
+        compression = Compression::Settings();
 
         const std::string firstline ("mrtrix " + type);
         File::KeyValue kv (file, firstline.c_str());
@@ -44,6 +57,7 @@ namespace MR {
           else if (key == "comment") properties.comments.push_back (kv.value());
           else if (key == "file") data_file = kv.value();
           else if (key == "datatype") dtype = DataType::parse (kv.value());
+          else if (key == "compression") compression = Compression::Settings::parse (kv.value());
           else properties[kv.key()] = kv.value();
         }
 
@@ -74,10 +88,7 @@ namespace MR {
         else
           fname = file;
 
-        in.open (fname.c_str(), std::ios::in | std::ios::binary);
-        if (!in)
-          throw Exception ("error opening " + type  + " data file \"" + fname + "\": " + strerror(errno));
-        in.seekg (offset);
+        return File::Entry (fname, offset);
       }
 
     }
@@ -20,9 +20,11 @@
 #include <map>
 
 #include "types.h"
+#include "file/entry.h"
 #include "file/key_value.h"
 #include "file/ofstream.h"
 #include "file/path.h"
+#include "dwi/tractography/compression.h"
 #include "dwi/tractography/properties.h"
 
 
@@ -46,12 +48,18 @@ namespace MR
 
           void open (const std::string& file, const std::string& firstline, Properties& properties);
 
+          //! parse the header of \c file into \c properties, \c dtype &
+          //! \c compression, and return the location of the associated data
+          static File::Entry parse (const std::string& file, const std::string& type, Properties& properties,
+                                    DataType& dtype, Compression::Settings& compression);
+
           void close () { in.close(); }
 
         protected:
 
           std::ifstream  in;
           DataType  dtype;
+          Compression::Settings compression;
       };
 
 
@@ -74,6 +82,8 @@ namespace MR
                 dtype != DataType::Float64LE && dtype != DataType::Float64BE)
               throw Exception ("only supported datatype for tracks file are "
                   "Float32LE, Float32BE, Float64LE & Float64BE");
+            if (Path::has_suffix (name, ".tckz"))
+              compression = Compression::Settings::from_config();
             App::check_overwrite (name);
           }
 
@@ -108,6 +118,8 @@ namespace MR
               for (const auto& it : properties.roi)
                 out << "roi: " << it.first << " " << it.second << "\n";
 
+              if (compression)
+                out << "compression: " << compression.specifier() << "\n";
               out << "datatype: " << dtype.specifier() << "\n";
               int64_t data_offset = int64_t(out.tellp()) + 65;
               data_offset += (4 - (data_offset % 4)) % 4;
@@ -130,6 +142,7 @@ namespace MR
           protected:
             std::string name;
             DataType dtype;
+            Compression::Settings compression;
             int64_t count_offset;
             bool open_success;
 
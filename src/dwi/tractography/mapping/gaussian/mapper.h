@@ -80,6 +80,7 @@ namespace MR {
                     voxelise_ends (temp, out);
                   else
                     voxelise (temp, out);
+                  out.finalise();
                   postprocess (temp, out);
                 }
                 return true;
@@ -141,6 +142,7 @@ namespace MR {
                 add_to_set (output, vox, dir, 1.0f, factor);
               }
 
+              output.finalise();
               for (auto& i : output)
                 i.normalize();
 
@@ -166,7 +166,7 @@ namespace MR {
 
 
 
-          class SetVoxel : public std::set<Voxel>, public Mapping::SetVoxelExtras
+          class SetVoxel : public FlatSet<Voxel>, public Mapping::SetVoxelExtras
           { MEMALIGN(SetVoxel)
             public:
 
@@ -175,16 +175,16 @@ namespace MR {
               inline void insert (const Eigen::Vector3i& v, const default_type l, const default_type f)
               {
                 const Voxel temp (v, l, f);
-                iterator existing = std::set<Voxel>::find (temp);
-                if (existing == std::set<Voxel>::end())
-                  std::set<Voxel>::insert (temp);
-                else
-                  (*existing).add (l, f);
+                append (temp);
+              }
+              void finalise ()
+              {
+                sort_and_merge ([] (const Voxel& existing, const Voxel& v) { existing.add (v.get_length(), v.get_factor()); });
               }
           };
 
 
-          class SetVoxelDEC : public std::set<VoxelDEC>, public Mapping::SetVoxelExtras
+          class SetVoxelDEC : public FlatSet<VoxelDEC>, public Mapping::SetVoxelExtras
           { MEMALIGN(SetVoxelDEC)
             public:
 
@@ -193,16 +193,16 @@ namespace MR {
               inline void insert (const Eigen::Vector3i& v, const Eigen::Vector3& d, const default_type l, const default_type f)
               {
                 const VoxelDEC temp (v, d, l, f);
-                iterator existing = std::set<VoxelDEC>::find (temp);
-                if (existing == std::set<VoxelDEC>::end())
-                  std::set<VoxelDEC>::insert (temp);
-                else
-                  (*existing).add (d, l, f);
+                append (temp);
+              }
+              void finalise ()
+              {
+                sort_and_merge ([] (const VoxelDEC& existing, const VoxelDEC& v) { existing.add (v.get_colour(), v.get_length(), v.get_factor()); });
               }
           };
 
 
-          class SetDixel : public std::set<Dixel>, public Mapping::SetVoxelExtras
+          class SetDixel : public FlatSet<Dixel>, public Mapping::SetVoxelExtras
           { MEMALIGN(SetDixel)
             public:
 
@@ -212,16 +212,16 @@ namespace MR {
               inline void insert (const Eigen::Vector3i& v, const dir_index_type d, const default_type l, const default_type f)
               {
                 const Dixel temp (v, d, l, f);
-                iterator existing = std::set<Dixel>::find (temp);
-                if (existing == std::set<Dixel>::end())
-                  std::set<Dixel>::insert (temp);
-                else
-                  (*existing).add (l, f);
+                append (temp);
+              }
+              void finalise ()
+              {
+                sort_and_merge ([] (const Dixel& existing, const Dixel& v) { existing.add (v.get_length(), v.get_factor()); });
               }
           };
 
 
-          class SetVoxelTOD : public std::set<VoxelTOD>, public Mapping::SetVoxelExtras
+          class SetVoxelTOD : public FlatSet<VoxelTOD>, public Mapping::SetVoxelExtras
           { MEMALIGN(SetVoxelTOD)
             public:
 
@@ -231,11 +231,11 @@ namespace MR {
               inline void insert (const Eigen::Vector3i& v, const vector_type& t, const default_type l, const default_type f)
               {
                 const VoxelTOD temp (v, t, l, f);
-                iterator existing = std::set<VoxelTOD>::find (temp);
-                if (existing == std::set<VoxelTOD>::end())
-                  std::set<VoxelTOD>::insert (temp);
-                else
-                  (*existing).add (t, l, f);
+                append (temp);
+              }
+              void finalise ()
+              {
+                sort_and_merge ([] (const VoxelTOD& existing, const VoxelTOD& v) { existing.add (v.get_tod(), v.get_length(), v.get_factor()); });
               }
           };
 
@@ -17,10 +17,14 @@
 #define __dwi_tractography_mapping_loader_h__
 
 
+#include <map>
+#include <mutex>
+
 #include "memory.h"
 #include "progressbar.h"
 #include "thread_queue.h"
 #include "dwi/tractography/file.h"
+#include "dwi/tractography/mmap_reader.h"
 #include "dwi/tractography/streamline.h"
 
 
@@ -65,6 +69,157 @@ namespace MR {
         };
 
 
+
+        //! A source of streamlines for Thread::run_queue() that can itself be multi-threaded
+        /*! Each copy of this class (i.e. each thread when wrapped in
+         * Thread::multi()) claims successive chunks of contiguous streamlines
+         * (i.e. contiguous byte ranges within the track file), and decodes them
+         * via the memory-mapped reader independently of all other threads.
+         *
+         * Streamlines will therefore not be delivered in file order; each
+         * retains its index within the file, such that a consumer requiring
+         * ordered input can restore the original ordering (see Ordered).
+         *
+         * Alternatively, a list of the indices of those streamlines to be
+         * loaded can be provided (e.g. those intersecting a tile of the output
+         * image; see TileGrid); chunks then consist of successive entries in
+         * this list. The list must remain valid while loading. */
+        class ParallelTrackLoader
+        { MEMALIGN(ParallelTrackLoader)
+
+          public:
+            ParallelTrackLoader (const MMapReader<>& file, const size_t to_load = 0, const std::string& msg = "mapping tracks to image", const size_t chunk_size = 256) :
+              shared (new Shared (file, to_load, msg, chunk_size)),
+              current (0),
+              end (0) { }
+
+            ParallelTrackLoader (const MMapReader<>& file, const vector<uint32_t>& indices, const std::string& msg = "", const size_t chunk_size = 256) :
+              shared (new Shared (file, indices, msg, chunk_size)),
+              current (0),
+              end (0) { }
+
+            ParallelTrackLoader (const ParallelTrackLoader& that) :
+              shared (that.shared),
+              current (0),
+              end (0) { }
+
+            bool operator() (Streamline<>& out)
+            {
+              if (current == end && !shared->next_chunk (current, end)) {
+                out.clear();
+                return false;
+              }
+              return shared->reader.load (shared->index (current++), out);
+            }
+
+          protected:
+            class Shared
+            { NOMEMALIGN
+              public:
+                Shared (const MMapReader<>& file, const size_t to_load, const std::string& msg, const size_t chunk_size) :
+                  reader (file),
+                  indices (nullptr),
+                  tracks_to_load (to_load ? std::min (to_load, file.size()) : file.size()),
+                  chunk_size (chunk_size),
+                  next (0),
+                  progress (msg.size() ? new ProgressBar (msg, tracks_to_load) : nullptr) { }
+
+                Shared (const MMapReader<>& file, const vector<uint32_t>& indices, const std::string& msg, const size_t chunk_size) :
+                  reader (file),
+                  indices (&indices),
+                  tracks_to_load (indices.size()),
+                  chunk_size (chunk_size),
+                  next (0),
+                  progress (msg.size() ? new ProgressBar (msg, tracks_to_load) : nullptr) { }
+
+                bool next_chunk (size_t& first, size_t& last)
+                {
+                  std::lock_guard<std::mutex> lock (mutex);
+                  if (next >= tracks_to_load) {
+                    progress.reset();
+                    return false;
+                  }
+                  first = next;
+                  if (indices)
+                    last = next = std::min (next + chunk_size, tracks_to_load);
+                  else
+                    last = next = std::min (reader.chunk_end (next, chunk_size), tracks_to_load);
+                  if (progress) {
+                    for (size_t i = first; i != last; ++i)
+                      ++(*progress);
+                  }
+                  return true;
+                }
+
+                size_t index (const size_t position) const { return indices ? (*indices)[position] : position; }
+
+                const MMapReader<>& reader;
+
+              private:
+                const vector<uint32_t>* const indices;
+                const size_t tracks_to_load, chunk_size;
+                size_t next;
+                std::unique_ptr<ProgressBar> progress;
+                std::mutex mutex;
+            };
+
+            std::shared_ptr<Shared> shared;
+            size_t current, end;
+
+        };
+
+
+
+        //! \cond skip
+        template <class Item>
+          inline size_t __index_of (const Item& item) { return item.index; }
+        template <class T>
+          inline size_t __index_of (const std::pair<size_t, T>& item) { return item.first; }
+        //! \endcond
+
+        //! Wrap a sink functor such that it receives items in order of their streamline index
+        /*! Items that arrive ahead of their turn (e.g. as a result of using
+         * ParallelTrackLoader or multi-threaded processing) are held in a
+         * buffer until all preceding items have been passed on. */
+        template <class Item, class Functor>
+        class Ordered
+        { MEMALIGN(Ordered<Item,Functor>)
+
+          public:
+            Ordered (Functor& functor, const size_t first_index = 0) :
+              functor (functor),
+              next (first_index) { }
+
+            bool operator() (Item& item)
+            {
+              if (__index_of (item) != next) {
+                assert (__index_of (item) > next);
+                buffer.insert (std::make_pair (__index_of (item), std::move (item)));
+                return true;
+              }
+              if (!functor (item))
+                return false;
+              ++next;
+              while (buffer.size() && buffer.begin()->first == next) {
+                if (!functor (buffer.begin()->second))
+                  return false;
+                buffer.erase (buffer.begin());
+                ++next;
+              }
+              return true;
+            }
+
+            //! the number of items held awaiting their turn
+            size_t pending () const { return buffer.size(); }
+
+          protected:
+            Functor& functor;
+            size_t next;
+            std::map<size_t, Item> buffer;
+
+        };
+
+
       }
     }
   }
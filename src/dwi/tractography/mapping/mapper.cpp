@@ -30,8 +30,12 @@ void TrackMapperBase::voxelise (const Streamline<>& tck, SetVoxel& voxels) const
   for (const auto& i : tck) {
     vox = round (scanner2voxel * i);
     if (check (vox, info))
-      voxels.std::set<Voxel>::insert (vox);
+      voxels.insert (vox, 1.0);
   }
+  // Each voxel traversed contributes unity, regardless of the number of vertices within it
+  voxels.finalise();
+  for (auto& i : voxels)
+    i.normalize();
 }
 
 
@@ -124,6 +124,7 @@ namespace MR {
                     voxelise_ends (temp, out);
                   else
                     voxelise (temp, out);
+                  out.finalise();
                   postprocess (temp, out);
                 }
                 return true;
@@ -196,6 +197,7 @@ namespace MR {
                 add_to_set (output, vox, dir, 1.0);
             }
 
+            output.finalise();
             for (auto& i : output)
               i.normalize();
 
@@ -152,7 +152,7 @@ namespace MR {
             TWIFODImagePlugin (const std::string& input_image, const tck_stat_t track_statistic) :
                 TWIImagePluginBase (input_image, track_statistic),
                 sh_coeffs (interp.size(3)),
-                precomputer (new Math::SH::PrecomputedAL<default_type> ())
+                precomputer (new Math::SH::PrecomputedBasis<default_type> ())
             {
               if (track_statistic == ENDS_CORR)
                 throw Exception ("Cannot use ends_corr track statistic with an FOD image");
@@ -171,7 +171,7 @@ namespace MR {
 
           private:
             mutable Eigen::Matrix<default_type, Eigen::Dynamic, 1> sh_coeffs;
-            std::shared_ptr<Math::SH::PrecomputedAL<default_type>> precomputer;
+            std::shared_ptr<Math::SH::PrecomputedBasis<default_type>> precomputer;
         };
 
 
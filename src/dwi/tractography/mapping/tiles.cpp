@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "dwi/tractography/mapping/tiles.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "thread_queue.h"
+#include "transform.h"
+
+#include "dwi/tractography/mapping/loader.h"
+
+
+namespace MR {
+  namespace DWI {
+    namespace Tractography {
+      namespace Mapping {
+
+
+
+        // Each thread accumulates its own lists of streamlines per tile, which
+        //   are appended to those of the TileGrid once all streamlines have been read
+        class TileGrid::Binner
+        { NOMEMALIGN
+          public:
+            Binner (TileGrid& master) :
+                master (master),
+                mutex (new std::mutex) { }
+
+            Binner (const Binner& that) :
+                master (that.master),
+                mutex (that.mutex) { }
+
+            ~Binner ()
+            {
+              if (local.size()) {
+                std::lock_guard<std::mutex> lock (*mutex);
+                for (size_t n = 0; n != local.size(); ++n)
+                  master.lists[n].insert (master.lists[n].end(), local[n].begin(), local[n].end());
+              }
+            }
+
+            bool operator() (const Streamline<>& tck)
+            {
+              if (tck.empty())
+                return true;
+              if (local.empty())
+                local.resize (master.size());
+
+              vector<Eigen::Vector3f> voxels;
+              voxels.reserve (tck.size());
+              float max_step = 0.0f;
+              for (size_t i = 0; i != tck.size(); ++i) {
+                voxels.push_back (master.scanner2voxel * tck[i]);
+                if (!voxels.back().allFinite())
+                  return true;
+                if (i)
+                  max_step = std::max (max_step, (voxels[i] - voxels[i-1]).norm());
+              }
+
+              // Positions are rounded to the nearest voxel during mapping, and the
+              //   upsampled streamline may deviate from the vertices by a fraction
+              //   of the step size; each vertex is therefore expanded to a box
+              //   that is guaranteed to contain all voxels mapped in its vicinity
+              const float pad = 1.0f + max_step;
+              tiles.clear();
+              for (const auto& p : voxels) {
+                Eigen::Vector3i first, last;
+                bool inside = true;
+                for (size_t axis = 0; axis != 3; ++axis) {
+                  const int lo = std::max (int (std::floor (p[axis] - pad)), 0);
+                  const int hi = std::min (int (std::ceil (p[axis] + pad)), master.dim[axis] - 1);
+                  if (lo > hi) {
+                    inside = false;
+                    break;
+                  }
+                  first[axis] = lo / master.tile_size;
+                  last[axis] = hi / master.tile_size;
+                }
+                if (!inside)
+                  continue;
+                for (int z = first[2]; z <= last[2]; ++z)
+                  for (int y = first[1]; y <= last[1]; ++y)
+                    for (int x = first[0]; x <= last[0]; ++x)
+                      tiles.push_back (master.tile_index (x, y, z));
+              }
+
+              std::sort (tiles.begin(), tiles.end());
+              tiles.erase (std::unique (tiles.begin(), tiles.end()), tiles.end());
+              for (auto n : tiles)
+                local[n].push_back (tck.index);
+              return true;
+            }
+
+          private:
+            TileGrid& master;
+            std::shared_ptr<std::mutex> mutex;
+            vector<vector<uint32_t>> local;
+            vector<size_t> tiles;
+        };
+
+
+
+
+
+        TileGrid::TileGrid (const Header& header, const size_t tile_size) :
+            dim (header.size (0), header.size (1), header.size (2)),
+            scanner2voxel (Transform (header).scanner2voxel.cast<float>()),
+            tile_size (tile_size),
+            num_tiles ((dim[0] + tile_size - 1) / tile_size,
+                       (dim[1] + tile_size - 1) / tile_size,
+                       (dim[2] + tile_size - 1) / tile_size),
+            lists (num_tiles[0] * num_tiles[1] * num_tiles[2])
+        {
+          assert (tile_size);
+          INFO ("image of " + str(dim[0]) + " x " + str(dim[1]) + " x " + str(dim[2]) + " voxels will be mapped as "
+                + str(num_tiles[0]) + " x " + str(num_tiles[1]) + " x " + str(num_tiles[2]) + " tiles");
+        }
+
+
+
+        Eigen::Vector3i TileGrid::from (const size_t index) const
+        {
+          assert (index < size());
+          return Eigen::Vector3i (index % num_tiles[0],
+                                  (index / num_tiles[0]) % num_tiles[1],
+                                  index / (num_tiles[0] * num_tiles[1])) * tile_size;
+        }
+
+
+
+        Eigen::Vector3i TileGrid::extent (const size_t index) const
+        {
+          const Eigen::Vector3i first = from (index);
+          return Eigen::Vector3i (std::min (tile_size, dim[0] - first[0]),
+                                  std::min (tile_size, dim[1] - first[1]),
+                                  std::min (tile_size, dim[2] - first[2]));
+        }
+
+
+
+        void TileGrid::bin (const MMapReader<>& file, const size_t to_load)
+        {
+          if (file.size() > std::numeric_limits<uint32_t>::max())
+            throw Exception ("too many streamlines in track file for tiled mapping");
+          {
+            ParallelTrackLoader loader (file, to_load, "assigning streamlines to image tiles");
+            Binner binner (*this);
+            Thread::run_queue (Thread::multi (loader), Thread::batch (Streamline<>()), Thread::multi (binner));
+          }
+          // Streamlines are read from the file in order within each tile
+          size_t total = 0;
+          for (auto& i : lists) {
+            std::sort (i.begin(), i.end());
+            total += i.size();
+          }
+          DEBUG (str(total) + " streamline-tile assignments across " + str(size()) + " tiles");
+        }
+
+
+
+      }
+    }
+  }
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __dwi_tractography_mapping_tiles_h__
+#define __dwi_tractography_mapping_tiles_h__
+
+
+#include "header.h"
+#include "types.h"
+
+#include "dwi/tractography/mmap_reader.h"
+
+
+namespace MR {
+  namespace DWI {
+    namespace Tractography {
+      namespace Mapping {
+
+
+
+        //! Partitions an image into tiles, and determines the streamlines that may contribute to each
+        /*! This permits streamlines to be mapped into an image one tile at a
+         * time (see MapWriterBase::set_tile()), such that the memory required
+         * depends on the tile size rather than the dimensions of the image.
+         *
+         * Streamlines are assigned to every tile within the vicinity of any of
+         * their vertices in voxel space. This neighbourhood accounts for both
+         * the rounding of positions to voxels and the deviation of upsampled
+         * (Hermite interpolated) streamlines from the stored vertices, so a
+         * streamline may be assigned to a tile that it does not actually
+         * traverse. Any streamline spanning multiple tiles is mapped once per
+         * tile. */
+        class TileGrid
+        { NOMEMALIGN
+          public:
+            TileGrid (const Header& header, const size_t tile_size);
+
+            //! the number of tiles
+            size_t size () const { return lists.size(); }
+
+            //! the first voxel of tile \a index
+            Eigen::Vector3i from (const size_t index) const;
+            //! the number of voxels spanned by tile \a index along each spatial axis
+            Eigen::Vector3i extent (const size_t index) const;
+
+            //! the indices of the streamlines that may intersect tile \a index, in ascending order
+            const vector<uint32_t>& streamlines (const size_t index) const { assert (index < size()); return lists[index]; }
+            //! release the list of streamlines for tile \a index
+            void clear (const size_t index) { assert (index < size()); vector<uint32_t>().swap (lists[index]); }
+
+            //! assign (up to \a to_load) streamlines from \a file to tiles, using multiple threads
+            void bin (const MMapReader<>& file, const size_t to_load = 0);
+
+          private:
+            const Eigen::Vector3i dim;
+            const Eigen::Transform<float,3,Eigen::AffineCompact> scanner2voxel;
+            const int tile_size;
+            const Eigen::Vector3i num_tiles;
+            vector<vector<uint32_t>> lists;
+
+            size_t tile_index (const int x, const int y, const int z) const { return x + num_tiles[0] * (y + num_tiles[1] * z); }
+
+            class Binner;
+        };
+
+
+
+      }
+    }
+  }
+}
+
+#endif
+
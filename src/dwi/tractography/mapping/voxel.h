@@ -18,9 +18,10 @@
 
 
 
-#include <set>
+#include <algorithm>
 
 #include "image.h"
+#include "types.h"
 
 #include "dwi/directions/set.h"
 
@@ -279,43 +280,94 @@ namespace MR {
 
 
 
+        // Flat container for the elements (voxels / dixels) traversed by a streamline
+        // Rather than a node-based std::set (requiring one heap allocation per
+        //   element visited), elements are appended to contiguous storage in the
+        //   order in which they are visited; finalise() then sorts them and merges
+        //   any duplicates, using the merge() function of the derived set class.
+        // Since sets are re-used as items in the Thread::Queue, the storage
+        //   acquired for previous streamlines is retained, and mapping of
+        //   subsequent streamlines typically involves no memory allocation.
+        // Sorting is stable, such that duplicates are merged in the order in
+        //   which they were inserted (as was the case with std::set); the
+        //   contents must not be accessed before finalise() has been called.
+        template <class VoxType>
+        class FlatSet
+        { NOMEMALIGN
+          public:
+            using value_type = VoxType;
+            using iterator = typename vector<VoxType>::iterator;
+            using const_iterator = typename vector<VoxType>::const_iterator;
+
+            FlatSet () : sorted (true) { }
+
+            iterator       begin ()       { assert (sorted); return elements.begin(); }
+            iterator       end   ()       { return elements.end(); }
+            const_iterator begin () const { assert (sorted); return elements.begin(); }
+            const_iterator end   () const { return elements.end(); }
+
+            size_t size () const { assert (sorted); return elements.size(); }
+            bool empty () const { return elements.empty(); }
+            void clear () { elements.clear(); sorted = true; }
+            void reserve (const size_t n) { elements.reserve (n); }
+
+          protected:
+            vector<VoxType> elements;
+            bool sorted;
+
+            void append (const VoxType& v) { elements.push_back (v); sorted = false; }
+
+            template <class MergeFunctor>
+            void sort_and_merge (MergeFunctor&& merge)
+            {
+              if (sorted)
+                return;
+              std::stable_sort (elements.begin(), elements.end());
+              auto out = elements.begin();
+              for (auto in = elements.begin() + 1; in < elements.end(); ++in) {
+                if (*out < *in) {
+                  if (++out != in)
+                    *out = *in;
+                } else {
+                  merge (*out, *in);
+                }
+              }
+              elements.erase (out + 1, elements.end());
+              sorted = true;
+            }
+        };
+
+
+
+
+
         // Set classes that give sensible behaviour to the insert() function depending on the base voxel class
 
-        class SetVoxel : public std::set<Voxel>, public SetVoxelExtras
+        class SetVoxel : public FlatSet<Voxel>, public SetVoxelExtras
         { NOMEMALIGN
           public:
             using VoxType = Voxel;
-            inline void insert (const Voxel& v)
-            {
-              iterator existing = std::set<Voxel>::find (v);
-              if (existing == std::set<Voxel>::end())
-                std::set<Voxel>::insert (v);
-              else
-                (*existing) += v.get_length();
-            }
+            inline void insert (const Voxel& v) { append (v); }
             inline void insert (const Eigen::Vector3i& v, const default_type l)
             {
               const Voxel temp (v, l);
               insert (temp);
             }
+            void finalise ()
+            {
+              sort_and_merge ([] (const Voxel& existing, const Voxel& v) { existing += v.get_length(); });
+            }
         };
 
 
 
 
 
-        class SetVoxelDEC : public std::set<VoxelDEC>, public SetVoxelExtras
+        class SetVoxelDEC : public FlatSet<VoxelDEC>, public SetVoxelExtras
         { NOMEMALIGN
           public:
             using VoxType = VoxelDEC;
-            inline void insert (const VoxelDEC& v)
-            {
-              iterator existing = std::set<VoxelDEC>::find (v);
-              if (existing == std::set<VoxelDEC>::end())
-                std::set<VoxelDEC>::insert (v);
-              else
-                existing->add (v.get_colour(), v.get_length());
-            }
+            inline void insert (const VoxelDEC& v) { append (v); }
             inline void insert (const Eigen::Vector3i& v, const Eigen::Vector3& d)
             {
               const VoxelDEC temp (v, d);
@@ -326,23 +378,20 @@ namespace MR {
               const VoxelDEC temp (v, d, l);
               insert (temp);
             }
+            void finalise ()
+            {
+              sort_and_merge ([] (const VoxelDEC& existing, const VoxelDEC& v) { existing.add (v.get_colour(), v.get_length()); });
+            }
         };
 
 
 
 
-        class SetVoxelDir : public std::set<VoxelDir>, public SetVoxelExtras
+        class SetVoxelDir : public FlatSet<VoxelDir>, public SetVoxelExtras
         { NOMEMALIGN
           public:
             using VoxType = VoxelDir;
-            inline void insert (const VoxelDir& v)
-            {
-              iterator existing = std::set<VoxelDir>::find (v);
-              if (existing == std::set<VoxelDir>::end())
-                std::set<VoxelDir>::insert (v);
-              else
-                existing->add (v.get_dir(), v.get_length());
-            }
+            inline void insert (const VoxelDir& v) { append (v); }
             inline void insert (const Eigen::Vector3i& v, const Eigen::Vector3& d)
             {
               const VoxelDir temp (v, d);
@@ -353,24 +402,21 @@ namespace MR {
               const VoxelDir temp (v, d, l);
               insert (temp);
             }
+            void finalise ()
+            {
+              sort_and_merge ([] (const VoxelDir& existing, const VoxelDir& v) { existing.add (v.get_dir(), v.get_length()); });
+            }
         };
 
 
-        class SetDixel : public std::set<Dixel>, public SetVoxelExtras
+        class SetDixel : public FlatSet<Dixel>, public SetVoxelExtras
         { NOMEMALIGN
           public:
 
             using VoxType = Dixel;
             using dir_index_type = Dixel::dir_index_type;
 
-            inline void insert (const Dixel& v)
-            {
-              iterator existing = std::set<Dixel>::find (v);
-              if (existing == std::set<Dixel>::end())
-                std::set<Dixel>::insert (v);
-              else
-                (*existing) += v.get_length();
-            }
+            inline void insert (const Dixel& v) { append (v); }
             inline void insert (const Eigen::Vector3i& v, const dir_index_type d)
             {
               const Dixel temp (v, d);
@@ -381,27 +427,24 @@ namespace MR {
               const Dixel temp (v, d, l);
               insert (temp);
             }
+            void finalise ()
+            {
+              sort_and_merge ([] (const Dixel& existing, const Dixel& v) { existing += v.get_length(); });
+            }
         };
 
 
 
 
 
-        class SetVoxelTOD : public std::set<VoxelTOD>, public SetVoxelExtras
+        class SetVoxelTOD : public FlatSet<VoxelTOD>, public SetVoxelExtras
         { NOMEMALIGN
           public:
 
             using VoxType = VoxelTOD;
             using vector_type = VoxelTOD::vector_type;
 
-            inline void insert (const VoxelTOD& v)
-            {
-              iterator existing = std::set<VoxelTOD>::find (v);
-              if (existing == std::set<VoxelTOD>::end())
-                std::set<VoxelTOD>::insert (v);
-              else
-                (*existing) += v.get_tod();
-            }
+            inline void insert (const VoxelTOD& v) { append (v); }
             inline void insert (const Eigen::Vector3i& v, const vector_type& t)
             {
               const VoxelTOD temp (v, t);
@@ -412,6 +455,10 @@ namespace MR {
               const VoxelTOD temp (v, t, l);
               insert (temp);
             }
+            void finalise ()
+            {
+              sort_and_merge ([] (const VoxelTOD& existing, const VoxelTOD& v) { existing += v.get_tod(); });
+            }
         };
 
 
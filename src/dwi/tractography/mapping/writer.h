@@ -16,6 +16,8 @@
 #ifndef __dwi_tractography_mapping_writer_h__
 #define __dwi_tractography_mapping_writer_h__
 
+#include <mutex>
+
 #include "memory.h"
 #include "file/path.h"
 #include "file/utils.h"
@@ -52,7 +54,8 @@ namespace MR {
               H (header),
               output_image_name (name),
               voxel_statistic (s),
-              type (t) {
+              type (t),
+              offset (0, 0, 0) {
                 assert (type != UNDEFINED);
               }
 
@@ -77,6 +80,23 @@ namespace MR {
             virtual bool operator() (const Gaussian::SetDixel&)    { return false; }
             virtual bool operator() (const Gaussian::SetVoxelTOD&) { return false; }
 
+            //! a new (empty) writer of the same type, into which a subset of streamlines can be mapped
+            virtual MapWriterBase* partial () const = 0;
+            //! merge the contents of a partial writer into this one
+            virtual void merge (MapWriterBase&) = 0;
+
+            //! restrict mapping to a tile of the output image (see TileGrid)
+            /*! The buffer is re-allocated to span only the \a size voxels
+             * beginning at voxel \a from; any mapped elements outside of this
+             * region are ignored. Each subsequent call to finalise() then
+             * writes the tile into the output image (which is created on the
+             * first call to this function), rather than saving the buffer as
+             * the output image. */
+            virtual void set_tile (const Eigen::Vector3i& from, const Eigen::Vector3i& size) = 0;
+
+            // Used by MapAccumulator to serialise merging of partial writers
+            std::mutex mutex;
+
 
           protected:
             const Header& H;
@@ -84,6 +104,10 @@ namespace MR {
             const vox_stat_t voxel_statistic;
             const writer_dim type;
 
+            // The position of the buffer within the output image, if mapping
+            //   is restricted to a tile
+            Eigen::Vector3i offset;
+
             // This gets used with mean voxel statistic for some (but not all) writers,
             //   or if the output is a voxel_summed DEC image.
             // counts needs to be floating-point to cover possibility of weighted streamlines
@@ -102,53 +126,24 @@ namespace MR {
         { MEMALIGN(MapWriter<value_type>)
 
           public:
-          MapWriter (const Header& header, const std::string& name, const vox_stat_t voxel_statistic = V_SUM, const writer_dim type = GREYSCALE) :
-              MapWriterBase (header, name, voxel_statistic, type),
-              buffer (Image<value_type>::scratch (header, "TWI " + str(writer_dims[type]) + " buffer"))
+          // If tiled, no buffer is allocated until set_tile() is called
+          MapWriter (const Header& header, const std::string& name, const vox_stat_t voxel_statistic = V_SUM, const writer_dim type = GREYSCALE, const bool tiled = false) :
+              MapWriterBase (header, name, voxel_statistic, type)
           {
-            auto loop = Loop (buffer);
-            if (type == DEC || type == TOD) {
-
-              if (voxel_statistic == V_MIN) {
-                for (auto l = loop (buffer); l; ++l )
-                  buffer.value() = std::numeric_limits<value_type>::max();
-              }
-/* shouldn't be needed: scratch IO class memset to zero already:
-              else {
-                buffer.zero();
-              } */
-
-            } else { // Greyscale and dixel
-
-              if (voxel_statistic == V_MIN) {
-                for (auto l = loop (buffer); l; ++l )
-                  buffer.value() = std::numeric_limits<value_type>::max();
-              } else if (voxel_statistic == V_MAX) {
-                for (auto l = loop (buffer); l; ++l )
-                  buffer.value() = std::numeric_limits<value_type>::lowest();
-              }
-/* shouldn't be needed: scratch IO class memset to zero already:
-              else {
-                buffer.zero();
-              }*/
-
-            }
-
-            // With TOD, hijack the counts buffer in voxel statistic min/max mode
-            //   (use to store maximum / minimum factors and hence decide when to update the TOD)
-            if ((type != DEC && voxel_statistic == V_MEAN) ||
-                (type == TOD && (voxel_statistic == V_MIN || voxel_statistic == V_MAX)) ||
-                (type == DEC && voxel_statistic == V_SUM))
-            {
-              Header H_counts (header);
-              if (type == DEC || type == TOD)
-                H_counts.ndim() = 3;
-              counts.reset (new Image<float> (Image<float>::scratch (H_counts, "TWI streamline count buffer")));
-            }
+            if (!tiled)
+              allocate (header);
           }
 
           MapWriter (const MapWriter&) = delete;
 
+          MapWriterBase* partial () const override {
+            auto result = new MapWriter<value_type> (output.valid() ? tile_header : H, output_image_name, voxel_statistic, type);
+            result->offset = offset;
+            return result;
+          }
+          void merge (MapWriterBase&) override;
+          void set_tile (const Eigen::Vector3i& from, const Eigen::Vector3i& size) override;
+
           void finalise () {
 
             auto loop = Loop (buffer, 0, 3);
@@ -232,7 +227,10 @@ namespace MR {
 
             }
 
-            save (buffer, output_image_name);
+            if (output.valid())
+              write_tile();
+            else
+              save (buffer, output_image_name);
           }
 
 
@@ -250,6 +248,29 @@ namespace MR {
           private:
           Image<value_type> buffer;
 
+          // For tiled mapping: the header of the current tile, and the output
+          //   image into which each tile is written once finalised
+          Header tile_header;
+          Image<value_type> output;
+
+          void allocate (const Header&);
+          void write_tile ();
+
+          // Set the position of an image to that of a mapped element, accounting
+          //   for the offset of the current tile; returns false if the element
+          //   lies outside of the buffer
+          template <class ImageType>
+          bool locate (const Voxel& element, ImageType& image) const
+          {
+            for (size_t axis = 0; axis != 3; ++axis) {
+              const ssize_t pos = element[axis] - offset[axis];
+              if (pos < 0 || pos >= image.size (axis))
+                return false;
+              image.index (axis) = pos;
+            }
+            return true;
+          }
+
           // Template functions used so that the functors don't have to be written twice
           //   (once for standard TWI and one for Gaussian track-wise statistic)
           template <class Cont> void receive_greyscale (const Cont&);
@@ -260,6 +281,7 @@ namespace MR {
           // Partially specialized template function to shut up modern compilers
           //   regarding using multiplication in a boolean context
           inline void add (const default_type, const default_type);
+          inline void combine (const value_type);
 
           // These acquire the TWI factor at any point along the streamline;
           //   For the standard SetVoxel classes, this is a single value 'factor' for the set as
@@ -291,13 +313,98 @@ namespace MR {
 
 
 
+        template <typename value_type>
+          void MapWriter<value_type>::allocate (const Header& header)
+          {
+            buffer = Image<value_type>::scratch (header, "TWI " + str(writer_dims[type]) + " buffer");
+            auto loop = Loop (buffer);
+            if (type == DEC || type == TOD) {
+
+              if (voxel_statistic == V_MIN) {
+                for (auto l = loop (buffer); l; ++l )
+                  buffer.value() = std::numeric_limits<value_type>::max();
+              }
+/* shouldn't be needed: scratch IO class memset to zero already:
+              else {
+                buffer.zero();
+              } */
+
+            } else { // Greyscale and dixel
+
+              if (voxel_statistic == V_MIN) {
+                for (auto l = loop (buffer); l; ++l )
+                  buffer.value() = std::numeric_limits<value_type>::max();
+              } else if (voxel_statistic == V_MAX) {
+                for (auto l = loop (buffer); l; ++l )
+                  buffer.value() = std::numeric_limits<value_type>::lowest();
+              }
+/* shouldn't be needed: scratch IO class memset to zero already:
+              else {
+                buffer.zero();
+              }*/
+
+            }
+
+            // With TOD, hijack the counts buffer in voxel statistic min/max mode
+            //   (use to store maximum / minimum factors and hence decide when to update the TOD)
+            if ((type != DEC && voxel_statistic == V_MEAN) ||
+                (type == TOD && (voxel_statistic == V_MIN || voxel_statistic == V_MAX)) ||
+                (type == DEC && voxel_statistic == V_SUM))
+            {
+              Header H_counts (header);
+              if (type == DEC || type == TOD)
+                H_counts.ndim() = 3;
+              counts.reset (new Image<float> (Image<float>::scratch (H_counts, "TWI streamline count buffer")));
+            }
+          }
+
+
+
+        template <typename value_type>
+          void MapWriter<value_type>::set_tile (const Eigen::Vector3i& from, const Eigen::Vector3i& size)
+          {
+            if (!output.valid())
+              output = Image<value_type>::create (output_image_name, H);
+            // Release the buffers for the previous tile before allocating the next
+            buffer = Image<value_type>();
+            counts.reset();
+            offset = from;
+            tile_header = H;
+            for (size_t axis = 0; axis != 3; ++axis) {
+              assert (from[axis] >= 0 && size[axis] > 0 && from[axis] + size[axis] <= H.size (axis));
+              tile_header.size (axis) = size[axis];
+            }
+            tile_header.transform().translation() = H.transform() * Eigen::Vector3 (from[0] * H.spacing (0),
+                                                                                   from[1] * H.spacing (1),
+                                                                                   from[2] * H.spacing (2));
+            allocate (tile_header);
+          }
+
+
+
+        template <typename value_type>
+          void MapWriter<value_type>::write_tile ()
+          {
+            assert (output.valid());
+            for (auto l = Loop (buffer) (buffer); l; ++l) {
+              for (size_t axis = 0; axis != 3; ++axis)
+                output.index (axis) = buffer.index (axis) + offset[axis];
+              if (buffer.ndim() > 3)
+                output.index (3) = buffer.index (3);
+              output.value() = buffer.value();
+            }
+          }
+
+
+
         template <typename value_type>
           template <class Cont>
           void MapWriter<value_type>::receive_greyscale (const Cont& in)
           {
             assert (MapWriterBase::type == GREYSCALE);
             for (const auto& i : in) {
-              assign_pos_of (i).to (buffer);
+              if (!locate (i, buffer))
+                continue;
               const default_type factor = get_factor (i, in);
               const default_type weight = in.weight * i.get_length();
               switch (voxel_statistic) {
@@ -307,7 +414,7 @@ namespace MR {
                 case V_MEAN:
                              add (weight, factor);
                              assert (counts);
-                             assign_pos_of (i).to (*counts);
+                             locate (i, *counts);
                              counts->value() += weight;
                              break;
                 default:
@@ -324,7 +431,8 @@ namespace MR {
           {
             assert (type == DEC);
             for (const auto& i : in) {
-              assign_pos_of (i).to (buffer);
+              if (!locate (i, buffer))
+                continue;
               const default_type factor = get_factor (i, in);
               const default_type weight = in.weight * i.get_length();
               auto scaled_colour = i.get_colour();
@@ -334,7 +442,7 @@ namespace MR {
                 case V_SUM:
                   set_dec (current_value + (scaled_colour * weight));
                   assert (counts);
-                  assign_pos_of (i).to (*counts);
+                  locate (i, *counts);
                   counts->value() += weight;
                   break;
                 case V_MIN:
@@ -362,7 +470,8 @@ namespace MR {
           {
             assert (type == DIXEL);
             for (const auto& i : in) {
-              assign_pos_of (i, 0, 3).to (buffer);
+              if (!locate (i, buffer))
+                continue;
               buffer.index(3) = i.get_dir();
               const default_type factor = get_factor (i, in);
               const default_type weight = in.weight * i.get_length();
@@ -373,7 +482,7 @@ namespace MR {
                 case V_MEAN:
                              add (weight, factor);
                              assert (counts);
-                             assign_pos_of (i, 0, 3).to (*counts);
+                             locate (i, *counts);
                              counts->index(3) = i.get_dir();
                              counts->value() += weight;
                              break;
@@ -392,12 +501,13 @@ namespace MR {
             assert (type == TOD);
             VoxelTOD::vector_type sh_coefs;
             for (const auto& i : in) {
-              assign_pos_of (i, 0, 3).to (buffer);
+              if (!locate (i, buffer))
+                continue;
               const default_type factor = get_factor (i, in);
               const default_type weight = in.weight * i.get_length();
               get_tod (sh_coefs);
               if (counts)
-                assign_pos_of (i, 0, 3).to (*counts);
+                locate (i, *counts);
               switch (voxel_statistic) {
                 case V_SUM:
                   for (ssize_t index = 0; index != sh_coefs.size(); ++index)
@@ -439,6 +549,69 @@ namespace MR {
 
 
 
+        template <typename value_type>
+          void MapWriter<value_type>::merge (MapWriterBase& base)
+          {
+            auto& that = dynamic_cast<MapWriter<value_type>&> (base);
+            assert (that.type == type && that.voxel_statistic == voxel_statistic);
+            if ((type == DEC || type == TOD) && (voxel_statistic == V_MIN || voxel_statistic == V_MAX)) {
+              // These must be compared per voxel rather than per volume
+              for (auto l = Loop (buffer, 0, 3) (buffer, that.buffer); l; ++l) {
+                if (type == DEC) {
+                  const auto value = get_dec();
+                  const auto other = that.get_dec();
+                  if (voxel_statistic == V_MIN ?
+                      (other.squaredNorm() < value.squaredNorm()) :
+                      (other.squaredNorm() > value.squaredNorm()))
+                    set_dec (other);
+                } else {
+                  // For TOD, the counts buffer holds the min / max factors
+                  assert (counts && that.counts);
+                  assign_pos_of (buffer, 0, 3).to (*counts, *that.counts);
+                  if (voxel_statistic == V_MIN ?
+                      (that.counts->value() < counts->value()) :
+                      (that.counts->value() > counts->value())) {
+                    counts->value() = that.counts->value();
+                    VoxelTOD::vector_type tod;
+                    that.get_tod (tod);
+                    set_tod (tod);
+                  }
+                }
+              }
+            } else {
+              for (auto l = Loop (buffer) (buffer, that.buffer); l; ++l)
+                combine (that.buffer.value());
+              if (counts) {
+                assert (that.counts);
+                for (auto l = Loop (*counts) (*counts, *that.counts); l; ++l)
+                  counts->value() += that.counts->value();
+              }
+            }
+          }
+
+
+
+        template <>
+        inline void MapWriter<bool>::combine (const bool value)
+        {
+          if (voxel_statistic == V_MIN)
+            buffer.value() = buffer.value() && value;
+          else
+            buffer.value() = buffer.value() || value;
+        }
+
+        template <typename value_type>
+        inline void MapWriter<value_type>::combine (const value_type value)
+        {
+          switch (voxel_statistic) {
+            case V_MIN: buffer.value() = std::min (value_type (buffer.value()), value); break;
+            case V_MAX: buffer.value() = std::max (value_type (buffer.value()), value); break;
+            default:    buffer.value() += value; break;
+          }
+        }
+
+
+
         template <>
         inline void MapWriter<bool>::add (const default_type weight, const default_type factor)
         {
@@ -502,6 +675,54 @@ namespace MR {
 
 
 
+        //! Functor for mapping streamlines into a MapWriter using multiple threads
+        /*! Rather than a single thread receiving the mapped streamlines and
+         * writing them to the output buffer, this class can be used as a
+         * multi-threaded sink in Thread::run_queue(): each copy accumulates
+         * streamlines into its own partial map, which is merged into the
+         * master writer when the copy is destroyed (i.e. once all streamlines
+         * have been mapped). Note that this requires a full copy of the output
+         * buffer per thread. The instance constructed from the writer itself
+         * (which is only invoked directly if the queue is run without
+         * multi-threading) writes directly into the master writer. */
+        class MapAccumulator
+        { MEMALIGN(MapAccumulator)
+          public:
+            MapAccumulator (MapWriterBase& master) :
+                master (master),
+                is_copy (false) { }
+
+            MapAccumulator (const MapAccumulator& that) :
+                master (that.master),
+                is_copy (true) { }
+
+            ~MapAccumulator ()
+            {
+              if (local) {
+                std::lock_guard<std::mutex> lock (master.mutex);
+                master.merge (*local);
+              }
+            }
+
+            template <class Cont>
+            bool operator() (const Cont& in)
+            {
+              if (!is_copy)
+                return master (in);
+              // Only those copies that actually receive data need a buffer
+              if (!local)
+                local.reset (master.partial());
+              return (*local) (in);
+            }
+
+          private:
+            MapWriterBase& master;
+            const bool is_copy;
+            std::unique_ptr<MapWriterBase> local;
+        };
+
+
+
       }
     }
   }
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#include "dwi/tractography/mmap_reader.h"
+
+#include <atomic>
+#include <sys/stat.h>
+
+#include "app.h"
+#include "raw.h"
+#include "thread.h"
+#include "file/config.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+
+
+namespace MR {
+  namespace DWI {
+    namespace Tractography {
+
+
+
+      namespace {
+
+        const char* index_magic = "mrtrix track index\n";
+
+        std::atomic<uint64_t> reader_count (0);
+
+        // Time of last modification of a file, used to detect a stale index
+        int64_t modification_time (const std::string& path)
+        {
+          struct stat buf;
+          if (stat (path.c_str(), &buf))
+            throw Exception ("cannot stat file \"" + path + "\": " + strerror (errno));
+          return buf.st_mtime;
+        }
+
+
+
+        // Locate the delimiters within a range of vertices; run using
+        //   multiple threads, each processing successive chunks
+        class DelimiterScanner
+        { NOMEMALIGN
+          public:
+            static constexpr size_t chunk_size = 1 << 20;
+
+            DelimiterScanner (const uint8_t* data, const DataType dtype, const uint64_t num_points,
+                              vector<vector<uint64_t>>& delimiters, vector<uint64_t>& barriers,
+                              std::atomic<size_t>& next_chunk) :
+                data (data),
+                dtype (dtype),
+                num_points (num_points),
+                delimiters (delimiters),
+                barriers (barriers),
+                next_chunk (next_chunk) { }
+
+            void execute () {
+              size_t chunk;
+              while ((chunk = next_chunk++) < delimiters.size()) {
+                const uint64_t first = chunk * chunk_size;
+                const uint64_t last = std::min (first + chunk_size, num_points);
+                switch (dtype()) {
+                  case DataType::Float32LE: scan<float,  true>  (chunk, first, last); break;
+                  case DataType::Float32BE: scan<float,  false> (chunk, first, last); break;
+                  case DataType::Float64LE: scan<double, true>  (chunk, first, last); break;
+                  case DataType::Float64BE: scan<double, false> (chunk, first, last); break;
+                  default: assert (0); break;
+                }
+              }
+            }
+
+          private:
+            const uint8_t* data;
+            const DataType dtype;
+            const uint64_t num_points;
+            vector<vector<uint64_t>>& delimiters;
+            vector<uint64_t>& barriers;
+            std::atomic<size_t>& next_chunk;
+
+            template <typename T, bool little_endian>
+            void scan (const size_t chunk, const uint64_t first, const uint64_t last) {
+              // Only the first coordinate of each vertex needs to be tested,
+              //   as in Reader::operator()
+              for (uint64_t n = first; n != last; ++n) {
+                const T x = little_endian ? Raw::fetch_LE<T> (data, 3*n) : Raw::fetch_BE<T> (data, 3*n);
+                if (std::isnan (x)) {
+                  delimiters[chunk].push_back (n);
+                } else if (std::isinf (x)) {
+                  barriers[chunk] = n;
+                  return;
+                }
+              }
+            }
+        };
+
+      }
+
+
+
+
+      __MMapReaderBase__::__MMapReaderBase__ (const std::string& file, Properties& properties) :
+          name (file),
+          id (++reader_count),
+          data (nullptr),
+          data_offset (0),
+          data_size (0),
+          num_tracks (0)
+      {
+        const File::Entry entry = __ReaderBase__::parse (file, "tracks", properties, dtype, compression);
+        data_offset = entry.start;
+
+        struct stat buf;
+        if (stat (entry.name.c_str(), &buf))
+          throw Exception ("error opening tracks data file \"" + entry.name + "\": " + strerror (errno));
+        const int64_t file_size = buf.st_size;
+        // Only complete vertices are considered
+        if (file_size > int64_t(data_offset))
+          data_size = compression ? (file_size - data_offset) : ((file_size - data_offset) / point_size()) * point_size();
+        if (data_size) {
+          mmap.reset (new File::MMap (entry, false, true, data_size));
+          data = mmap->address();
+        }
+
+        if (compression) {
+          build_block_index();
+        } else if (!load_index()) {
+          build_index();
+          if (File::Config::get_bool ("TrackIndexSave", false)) {
+            try {
+              save_index();
+            } catch (Exception& e) {
+              e.display (2);
+              WARN ("unable to save streamline index for track file \"" + name + "\"");
+            }
+          }
+        }
+
+        auto opt = App::get_options ("tck_weights_in");
+        if (opt.size())
+          load_weights (opt[0][0]);
+      }
+
+
+
+      //CONF option: TrackIndexSave
+      //CONF default: 0 (false)
+      //CONF When memory-mapping a track file for random or parallel access,
+      //CONF the location of each streamline within the file must first be
+      //CONF determined. If this option is set, this information is saved to
+      //CONF a sidecar file alongside the track file (with the suffix .idx),
+      //CONF such that it can be re-used in subsequent commands.
+      void __MMapReaderBase__::save_index () const
+      {
+        const std::string path = index_path (name);
+        File::OFStream out (path, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write (index_magic, strlen (index_magic));
+        const uint64_t header[4] = { ByteOrder::LE (uint64_t (data_offset)),
+                                     ByteOrder::LE (uint64_t (data_size)),
+                                     ByteOrder::LE (uint64_t (modification_time (name))),
+                                     ByteOrder::LE (uint64_t (size())) };
+        out.write (reinterpret_cast<const char*> (header), sizeof (header));
+        for (auto i : starts) {
+          const uint64_t value = ByteOrder::LE (i);
+          out.write (reinterpret_cast<const char*> (&value), sizeof (value));
+        }
+        if (!out.good())
+          throw Exception ("error writing streamline index file \"" + path + "\": " + strerror (errno));
+        DEBUG ("streamline index for track file \"" + name + "\" saved to \"" + path + "\"");
+      }
+
+
+
+      bool __MMapReaderBase__::load_index ()
+      {
+        const std::string path = index_path (name);
+        if (!Path::is_file (path))
+          return false;
+        std::ifstream in (path, std::ios::in | std::ios::binary);
+        if (!in)
+          return false;
+        std::string magic (strlen (index_magic), '\0');
+        uint64_t header[4];
+        in.read (&magic[0], magic.size());
+        in.read (reinterpret_cast<char*> (header), sizeof (header));
+        for (auto& i : header)
+          i = ByteOrder::LE (i);
+        if (!in.good() || magic != index_magic ||
+            header[0] != data_offset || header[1] != data_size ||
+            int64_t(header[2]) != modification_time (name) ||
+            header[3] > data_size / point_size()) {
+          DEBUG ("ignoring stale or invalid streamline index file \"" + path + "\"");
+          return false;
+        }
+        starts.resize (header[3] + 1);
+        in.read (reinterpret_cast<char*> (starts.data()), starts.size() * sizeof (uint64_t));
+        if (!in.good()) {
+          starts.clear();
+          DEBUG ("ignoring truncated streamline index file \"" + path + "\"");
+          return false;
+        }
+        for (auto& i : starts)
+          i = ByteOrder::LE (i);
+        if (starts.front() != 0 || starts.back() > data_size / point_size()) {
+          starts.clear();
+          DEBUG ("ignoring invalid streamline index file \"" + path + "\"");
+          return false;
+        }
+        num_tracks = starts.size() - 1;
+        DEBUG ("streamline index for track file \"" + name + "\" loaded from \"" + path + "\"");
+        return true;
+      }
+
+
+
+      void __MMapReaderBase__::build_index ()
+      {
+        const uint64_t num_points = data_size / point_size();
+        const size_t num_chunks = (num_points + DelimiterScanner::chunk_size - 1) / DelimiterScanner::chunk_size;
+        vector<vector<uint64_t>> delimiters (num_chunks);
+        vector<uint64_t> barriers (num_chunks, num_points);
+        {
+          std::atomic<size_t> next_chunk (0);
+          DelimiterScanner scanner (data, dtype, num_points, delimiters, barriers, next_chunk);
+          auto threads = Thread::run (Thread::multi (scanner), "streamline index threads");
+          threads.wait();
+        }
+
+        // Data following the first barrier are ignored, as are any vertices
+        //   following the last delimiter (i.e. an incomplete streamline)
+        const uint64_t end = barriers.size() ? *std::min_element (barriers.begin(), barriers.end()) : 0;
+        starts.assign (1, 0);
+        for (auto& chunk : delimiters) {
+          for (auto n : chunk) {
+            if (n >= end)
+              break;
+            starts.push_back (n+1);
+          }
+          vector<uint64_t>().swap (chunk);
+        }
+        num_tracks = starts.size() - 1;
+        DEBUG ("streamline index for track file \"" + name + "\" generated: " + str(size()) + " streamlines");
+      }
+
+
+
+      void __MMapReaderBase__::build_block_index ()
+      {
+        // Only the block headers need to be read; as with uncompressed
+        //   data, an incomplete final block is ignored
+        uint64_t offset = 0;
+        block_first.assign (1, 0);
+        while (offset + Compression::block_header_size <= data_size) {
+          uint32_t num_streamlines, stored_size, payload_size;
+          if (!Compression::BlockDecoder::read_header (data + offset, num_streamlines, stored_size, payload_size))
+            break;
+          if (offset + Compression::block_header_size + stored_size > data_size)
+            break;
+          block_offsets.push_back (offset);
+          block_first.push_back (block_first.back() + num_streamlines);
+          offset += Compression::block_header_size + stored_size;
+        }
+        num_tracks = block_first.back();
+        DEBUG ("block index for compressed track file \"" + name + "\" generated: " + str(block_offsets.size()) + " blocks, " + str(size()) + " streamlines");
+      }
+
+
+
+      void __MMapReaderBase__::load_block (const size_t block, Compression::BlockDecoder& decoder) const
+      {
+        assert (block < block_offsets.size());
+        const uint8_t* header = data + block_offsets[block];
+        uint32_t num_streamlines, stored_size, payload_size;
+        Compression::BlockDecoder::read_header (header, num_streamlines, stored_size, payload_size);
+        decoder.load (header + Compression::block_header_size, num_streamlines, stored_size, payload_size);
+      }
+
+
+
+      void __MMapReaderBase__::load_weights (const std::string& path)
+      {
+        std::ifstream in (path.c_str(), std::ios_base::in);
+        if (!in.good())
+          throw Exception ("Unable to open streamlines weights file " + path);
+        weights.reserve (size());
+        float value;
+        while (weights.size() < size() && in >> value)
+          weights.push_back (value);
+        if (weights.size() < size())
+          throw Exception ("Streamline weights file contains less entries (" + str(weights.size()) + ") than .tck file (" + str(size()) + ")");
+        if (in >> value)
+          WARN ("Streamline weights file contains more entries than .tck file");
+      }
+
+
+
+    }
+  }
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2008-2018 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/
+ *
+ * MRtrix3 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/
+ */
+
+
+#ifndef __dwi_tractography_mmap_reader_h__
+#define __dwi_tractography_mmap_reader_h__
+
+#include "memory.h"
+#include "raw.h"
+#include "file/mmap.h"
+#include "dwi/tractography/file.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+      //! \cond skip
+      class __MMapReaderBase__
+      { NOMEMALIGN
+        public:
+          __MMapReaderBase__ (const std::string& file, Properties& properties);
+
+          //! the number of streamlines in the file
+          size_t size () const { return num_tracks; }
+          //! the weight of streamline \a index (1.0 unless -tck_weights_in is used)
+          float weight (const size_t index) const {
+            assert (index < size());
+            return weights.size() ? weights[index] : 1.0f;
+          }
+
+          //! the end of a chunk of streamlines beginning at \a first, for parallel processing
+          /*! For compressed files, chunks correspond to the blocks within the
+           * file, since each block must be decoded in its entirety; otherwise
+           * the chunk contains (up to) \a chunk_size streamlines. */
+          size_t chunk_end (const size_t first, const size_t chunk_size) const {
+            assert (first < size());
+            if (compression)
+              return *std::upper_bound (block_first.begin(), block_first.end(), uint64_t (first));
+            return std::min (first + chunk_size, size());
+          }
+
+          //! write the streamline offset index to its sidecar file
+          void save_index () const;
+          //! the location of the sidecar file holding the streamline offset index
+          static std::string index_path (const std::string& file) { return file + ".idx"; }
+
+        protected:
+          const std::string name;
+          // Unique identifier, used to tag decoded data held in per-thread caches
+          const uint64_t id;
+          DataType dtype;
+          Compression::Settings compression;
+          std::unique_ptr<File::MMap> mmap;
+          const uint8_t* data;
+          uint64_t data_offset, data_size;
+          size_t num_tracks;
+          // Vertex index of the first vertex of each streamline; the final
+          //   entry is one past the delimiter of the last streamline
+          vector<uint64_t> starts;
+          // For compressed files: the byte offset of each block, and the index
+          //   of the first streamline in each block (plus the total number)
+          vector<uint64_t> block_offsets, block_first;
+          vector<float> weights;
+
+          size_t point_size () const { return 3 * dtype.bytes(); }
+          const uint8_t* point_address (const uint64_t vertex) const { return data + vertex * point_size(); }
+          size_t num_points (const size_t index) const {
+            assert (index < size());
+            return starts[index+1] - starts[index] - 1;
+          }
+
+          size_t block_containing (const size_t index) const {
+            return std::upper_bound (block_first.begin(), block_first.end(), uint64_t (index)) - block_first.begin() - 1;
+          }
+          void load_block (const size_t block, Compression::BlockDecoder& decoder) const;
+
+          bool load_index ();
+          void build_index ();
+          void build_block_index ();
+          void load_weights (const std::string& path);
+      };
+      //! \endcond
+
+
+
+      //! A class to read streamlines data via a memory-mapping of the track file
+      /*! Rather than parsing the file sequentially, the locations of all
+       * streamlines within the file are first determined (using multiple
+       * threads), or loaded from a sidecar index file (see save_index()) if
+       * one exists and is up to date. This permits:
+       * - random access to any streamline via load();
+       * - concurrent reading of different streamlines by multiple threads,
+       *   since load() and view() are const and do not modify any state;
+       * - direct access to the vertices of a streamline as stored in the
+       *   file via view(), without any copy, provided the data are stored in
+       *   the native byte order and precision (see has_views()).
+       *
+       * The class can also be used as a drop-in replacement for Reader, via
+       * its sequential operator().
+       *
+       * Compressed (.tckz) files are also supported, with the exception of
+       * view(); in this case, the block containing each requested streamline
+       * is decoded in its entirety, and retained in a per-thread cache for
+       * subsequent requests.
+       *
+       * If the TrackIndexSave config file option is set, the index is written
+       * to the sidecar file whenever it has to be generated. */
+      template <class ValueType = float>
+      class MMapReader : public __MMapReaderBase__, public ReaderInterface<ValueType>
+      { NOMEMALIGN
+        public:
+          using point_type = typename Streamline<ValueType>::point_type;
+
+          //! a view onto the vertices of a streamline, as stored in the file
+          class View
+          { NOMEMALIGN
+            public:
+              View (const point_type* data, const size_t size, const size_t index, const float weight) :
+                  data (data), num_points (size), index (index), weight (weight) { }
+              size_t size () const { return num_points; }
+              bool empty () const { return !num_points; }
+              const point_type& operator[] (const size_t n) const { assert (n < num_points); return data[n]; }
+              const point_type* begin () const { return data; }
+              const point_type* end () const { return data + num_points; }
+            private:
+              const point_type* data;
+              size_t num_points;
+            public:
+              const size_t index;
+              const float weight;
+          };
+
+          MMapReader (const std::string& file, Properties& properties) :
+              __MMapReaderBase__ (file, properties),
+              current_index (0) { }
+
+          //! whether the data can be accessed without conversion using view()
+          bool has_views () const {
+            return !compression &&
+                   dtype == DataType::from<ValueType>() &&
+                   !(reinterpret_cast<size_t> (data) % alignof (point_type));
+          }
+
+          //! access the vertices of streamline \a index without any copy
+          /*! \note this is only possible if has_views() is \c true */
+          View view (const size_t index) const {
+            assert (has_views());
+            assert (index < size());
+            return View (reinterpret_cast<const point_type*> (point_address (starts[index])),
+                         num_points (index), index, weight (index));
+          }
+
+          //! read streamline \a index into \a tck
+          bool load (const size_t index, Streamline<ValueType>& tck) const {
+            tck.clear();
+            if (index >= size())
+              return false;
+            if (compression) {
+              const size_t block = block_containing (index);
+              tck = decoded_block (block)[index - block_first[block]];
+              tck.index = index;
+              tck.weight = weight (index);
+              return true;
+            }
+            tck.resize (num_points (index));
+            const uint8_t* p = point_address (starts[index]);
+            for (auto& vertex : tck) {
+              vertex = get_point (p);
+              p += point_size();
+            }
+            tck.index = index;
+            tck.weight = weight (index);
+            return true;
+          }
+
+          //! fetch next track from file
+          bool operator() (Streamline<ValueType>& tck) override {
+            return load (current_index++, tck);
+          }
+
+          //! reset sequential reading to start from streamline \a index
+          void seek (const size_t index) { current_index = index; }
+
+        protected:
+          size_t current_index;
+
+          class BlockCache
+          { NOMEMALIGN
+            public:
+              BlockCache () : reader (0), block (0) { }
+              uint64_t reader;
+              size_t block;
+              vector<Streamline<ValueType>> streamlines;
+          };
+
+          //! the streamlines of a compressed block, decoded on first request by each thread
+          const vector<Streamline<ValueType>>& decoded_block (const size_t block) const {
+            thread_local BlockCache cache;
+            if (cache.reader != id || cache.block != block) {
+              Compression::BlockDecoder decoder (compression);
+              load_block (block, decoder);
+              cache.reader = 0;
+              cache.streamlines.resize (decoder.size());
+              for (auto& tck : cache.streamlines)
+                decoder (tck);
+              cache.reader = id;
+              cache.block = block;
+            }
+            return cache.streamlines;
+          }
+
+          point_type get_point (const uint8_t* p) const {
+            switch (dtype()) {
+              case DataType::Float32LE: return point_type (ValueType (Raw::fetch_LE<float> (p, 0)), ValueType (Raw::fetch_LE<float> (p, 1)), ValueType (Raw::fetch_LE<float> (p, 2)));
+              case DataType::Float32BE: return point_type (ValueType (Raw::fetch_BE<float> (p, 0)), ValueType (Raw::fetch_BE<float> (p, 1)), ValueType (Raw::fetch_BE<float> (p, 2)));
+              case DataType::Float64LE: return point_type (ValueType (Raw::fetch_LE<double> (p, 0)), ValueType (Raw::fetch_LE<double> (p, 1)), ValueType (Raw::fetch_LE<double> (p, 2)));
+              case DataType::Float64BE: return point_type (ValueType (Raw::fetch_BE<double> (p, 0)), ValueType (Raw::fetch_BE<double> (p, 1)), ValueType (Raw::fetch_BE<double> (p, 2)));
+              default: assert (0); break;
+            }
+            return point_type (NaN, NaN, NaN);
+          }
+
+          MMapReader (const MMapReader&) = delete;
+      };
+
+
+
+    }
+  }
+}
+
+
+#endif
+
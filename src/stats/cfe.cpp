@@ -15,6 +15,11 @@
 
 #include "stats/cfe.h"
 
+#include "file/path.h"
+#include "file/utils.h"
+#include "progressbar.h"
+#include "thread.h"
+
 namespace MR
 {
   namespace Stats
@@ -24,25 +29,228 @@ namespace MR
 
 
 
+      InitMatrix::InitMatrix (const size_t num_fixels) :
+          num_fixels (num_fixels)
+      {
+        // Use more shards than threads, such that concurrent contributions
+        //   are unlikely to require the same shard
+        const size_t num_shards = std::max (size_t(1), std::min (num_fixels, 16 * Thread::number_of_threads()));
+        rows_per_shard = std::max (size_t(1), (num_fixels + num_shards - 1) / num_shards);
+        for (size_t i = 0; i * rows_per_shard < num_fixels || !i; ++i)
+          shards.push_back (std::unique_ptr<Shard> (new Shard));
+      }
+
+
+
+      void InitMatrix::add (const vector<element_type>& elements)
+      {
+        auto begin = elements.begin();
+        while (begin != elements.end()) {
+          const size_t index = shard (row (begin->first));
+          const key_type end_key = key (index_type (std::min ((index+1) * rows_per_shard, num_fixels)), 0);
+          const auto end = std::lower_bound (begin, elements.end(), end_key,
+                                             [] (const element_type& a, const key_type b) { return a.first < b; });
+          Shard& target (*shards[index]);
+          std::lock_guard<std::mutex> lock (target.mutex);
+          target.pending.insert (target.pending.end(), begin, end);
+          // Merge once the pending list is comparable in size to the sorted
+          //   data, so that the cost of merging is amortised
+          if (target.pending.size() > std::max (target.data.size(), size_t(65536)))
+            target.merge();
+          begin = end;
+        }
+      }
+
+
+
+      const vector<InitMatrix::element_type>& InitMatrix::get_shard (const size_t index)
+      {
+        assert (index < shards.size());
+        Shard& target (*shards[index]);
+        std::lock_guard<std::mutex> lock (target.mutex);
+        target.merge();
+        return target.data;
+      }
+
+
+
+      void InitMatrix::clear_shard (const size_t index)
+      {
+        assert (index < shards.size());
+        vector<element_type>().swap (shards[index]->data);
+        vector<element_type>().swap (shards[index]->pending);
+      }
+
+
+
+      void InitMatrix::Shard::merge()
+      {
+        if (pending.empty())
+          return;
+        std::sort (pending.begin(), pending.end(),
+                   [] (const element_type& a, const element_type& b) { return a.first < b.first; });
+        vector<element_type> merged;
+        merged.reserve (data.size() + pending.size());
+        auto a = data.begin(), b = pending.begin();
+        while (a != data.end() || b != pending.end()) {
+          const bool from_data = (b == pending.end() || (a != data.end() && a->first <= b->first));
+          const element_type& next (from_data ? *a++ : *b++);
+          if (merged.size() && merged.back().first == next.first)
+            merged.back().second += next.second;
+          else
+            merged.push_back (next);
+        }
+        std::swap (data, merged);
+        vector<element_type>().swap (pending);
+      }
+
+
+
+      ConnectivityMatrix::ConnectivityMatrix (InitMatrix& init_matrix,
+                                              const vector<uint32_t>& fixel_TDI,
+                                              const connectivity_value_type threshold) :
+          num_fixels (init_matrix.size())
+      {
+        offsets.reserve (num_fixels + 1);
+        offsets.push_back (0);
+        {
+          ProgressBar progress ("thresholding fixel-fixel connectivity matrix", init_matrix.num_shards());
+          size_t fixel = 0;
+          for (size_t shard = 0; shard != init_matrix.num_shards(); ++shard) {
+            for (const auto& it : init_matrix.get_shard (shard)) {
+              const index_type row = InitMatrix::row (it.first);
+              while (fixel < row) {
+                offsets.push_back (indices.size());
+                ++fixel;
+              }
+              const connectivity_value_type connectivity = it.second / connectivity_value_type (fixel_TDI[row]);
+              if (connectivity >= threshold) {
+                indices.push_back (InitMatrix::column (it.first));
+                values.push_back (connectivity);
+              }
+            }
+            // Force deallocation of memory used for this shard in the original matrix
+            init_matrix.clear_shard (shard);
+            ++progress;
+          }
+          while (fixel < num_fixels) {
+            offsets.push_back (indices.size());
+            ++fixel;
+          }
+        }
+        keyval["connectivity threshold"] = str(threshold);
+        offsets_ptr = offsets.data();
+        indices_ptr = indices.data();
+        values_ptr = values.data();
+      }
+
+
+
+      ConnectivityMatrix::ConnectivityMatrix (const std::string& directory)
+      {
+        if (!Path::is_dir (directory))
+          throw Exception ("fixel-fixel connectivity matrix location \"" + directory + "\" is not a directory");
+        offsets_image = Image<uint64_t>::open (Path::join (directory, "offsets.mif")).with_direct_io();
+        indices_image = Image<index_type>::open (Path::join (directory, "fixels.mif")).with_direct_io();
+        values_image = Image<connectivity_value_type>::open (Path::join (directory, "values.mif")).with_direct_io();
+        if (offsets_image.size(0) < 1)
+          throw Exception ("malformed fixel-fixel connectivity matrix in directory \"" + directory + "\"");
+        num_fixels = offsets_image.size(0) - 1;
+        offsets_ptr = offsets_image.address();
+        indices_ptr = indices_image.address();
+        values_ptr = values_image.address();
+        if (indices_image.size(0) != values_image.size(0) || ssize_t(nonzeros()) > indices_image.size(0))
+          throw Exception ("malformed fixel-fixel connectivity matrix in directory \"" + directory + "\"");
+        keyval = offsets_image.keyval();
+        DEBUG ("fixel-fixel connectivity matrix with " + str(num_fixels) + " fixels and " + str(nonzeros()) + " connections memory-mapped from directory \"" + directory + "\"");
+      }
+
+
+
+      void ConnectivityMatrix::save (const std::string& directory, const Header& template_header) const
+      {
+        if (!Path::exists (directory))
+          File::mkdir (directory);
+        else if (!Path::is_dir (directory))
+          throw Exception ("output location \"" + directory + "\" for fixel-fixel connectivity matrix is not a directory");
+
+        Header header (template_header);
+        header.reset_intensity_scaling();
+        header.ndim() = 3;
+        header.size(1) = header.size(2) = 1;
+        header.stride(0) = 1; header.stride(1) = 2; header.stride(2) = 3;
+        header.keyval() = keyval;
+
+        // Image dimensions cannot be zero, even if there are no connections
+        const size_t num_elements = std::max (nonzeros(), size_t(1));
+
+        ProgressBar progress ("saving fixel-fixel connectivity matrix", 3);
+        header.size(0) = num_fixels + 1;
+        header.datatype() = DataType::from<uint64_t>();
+        auto out_offsets = Image<uint64_t>::create (Path::join (directory, "offsets.mif"), header).with_direct_io();
+        std::copy (offsets_ptr, offsets_ptr + num_fixels + 1, out_offsets.address());
+        ++progress;
+
+        header.size(0) = num_elements;
+        header.datatype() = DataType::from<index_type>();
+        auto out_indices = Image<index_type>::create (Path::join (directory, "fixels.mif"), header).with_direct_io();
+        std::copy (indices_ptr, indices_ptr + nonzeros(), out_indices.address());
+        ++progress;
+
+        header.datatype() = DataType::from<connectivity_value_type>();
+        auto out_values = Image<connectivity_value_type>::create (Path::join (directory, "values.mif"), header).with_direct_io();
+        std::copy (values_ptr, values_ptr + nonzeros(), out_values.address());
+      }
+
+
+
+      // Maximum number of elements held in each thread's hash table before
+      //   they are transferred to the shared connectivity matrix
+      constexpr size_t track_processor_buffer_size = 1 << 20;
+
       TrackProcessor::TrackProcessor (Image<index_type>& fixel_indexer,
                                       const vector<direction_type>& fixel_directions,
                                       Image<bool>& fixel_mask,
-                                      vector<uint16_t>& fixel_TDI,
-                                      init_connectivity_matrix_type& connectivity_matrix,
+                                      vector<uint32_t>& fixel_TDI,
+                                      InitMatrix& connectivity_matrix,
                                       const value_type angular_threshold) :
                                         fixel_indexer        (fixel_indexer) ,
                                         fixel_directions     (fixel_directions),
                                         fixel_mask           (fixel_mask),
                                         fixel_TDI            (fixel_TDI),
                                         connectivity_matrix  (connectivity_matrix),
-                                        angular_threshold_dp (std::cos (angular_threshold * (Math::pi/180.0))) { }
+                                        angular_threshold_dp (std::cos (angular_threshold * (Math::pi/180.0))),
+                                        mutex                (new std::mutex),
+                                        local_TDI            (fixel_TDI.size(), 0) { }
+
+
+
+      TrackProcessor::TrackProcessor (const TrackProcessor& that) :
+                                        fixel_indexer        (that.fixel_indexer),
+                                        fixel_directions     (that.fixel_directions),
+                                        fixel_mask           (that.fixel_mask),
+                                        fixel_TDI            (that.fixel_TDI),
+                                        connectivity_matrix  (that.connectivity_matrix),
+                                        angular_threshold_dp (that.angular_threshold_dp),
+                                        mutex                (that.mutex),
+                                        local_TDI            (fixel_TDI.size(), 0) { }
+
+
+
+      TrackProcessor::~TrackProcessor()
+      {
+        flush();
+        std::lock_guard<std::mutex> lock (*mutex);
+        for (size_t i = 0; i != fixel_TDI.size(); ++i)
+          fixel_TDI[i] += local_TDI[i];
+      }
 
 
 
       bool TrackProcessor::operator() (const SetVoxelDir& in)
       {
         // For each voxel tract tangent, assign to a fixel
-        vector<index_type> tract_fixel_indices;
+        tract_fixel_indices.clear();
         for (SetVoxelDir::const_iterator i = in.begin(); i != in.end(); ++i) {
           assign_pos_of (*i).to (fixel_indexer);
           fixel_indexer.index(3) = 0;
@@ -67,7 +275,7 @@ namespace MR
             }
             if (closest_fixel_index != num_fixels && largest_dp > angular_threshold_dp) {
               tract_fixel_indices.push_back (closest_fixel_index);
-              fixel_TDI[closest_fixel_index]++;
+              local_TDI[closest_fixel_index]++;
             }
           }
         }
@@ -75,10 +283,12 @@ namespace MR
         try {
           for (size_t i = 0; i < tract_fixel_indices.size(); i++) {
             for (size_t j = i + 1; j < tract_fixel_indices.size(); j++) {
-              connectivity_matrix[tract_fixel_indices[i]][tract_fixel_indices[j]].value++;
-              connectivity_matrix[tract_fixel_indices[j]][tract_fixel_indices[i]].value++;
+              local_counts[InitMatrix::key (tract_fixel_indices[i], tract_fixel_indices[j])]++;
+              local_counts[InitMatrix::key (tract_fixel_indices[j], tract_fixel_indices[i])]++;
             }
           }
+          if (local_counts.size() >= track_processor_buffer_size)
+            flush();
           return true;
         } catch (...) {
           throw Exception ("Error assigning memory for CFE connectivity matrix");
@@ -88,12 +298,25 @@ namespace MR
 
 
 
+      void TrackProcessor::flush()
+      {
+        if (local_counts.empty())
+          return;
+        vector<InitMatrix::element_type> elements (local_counts.begin(), local_counts.end());
+        decltype(local_counts)().swap (local_counts);
+        std::sort (elements.begin(), elements.end(),
+                   [] (const InitMatrix::element_type& a, const InitMatrix::element_type& b) { return a.first < b.first; });
+        connectivity_matrix.add (elements);
+      }
+
+
+
 
 
 
 
 
-      Enhancer::Enhancer (const norm_connectivity_matrix_type& connectivity_matrix,
+      Enhancer::Enhancer (const NormMatrix& connectivity_matrix,
                           const value_type dh,
                           const value_type E,
                           const value_type H) :
@@ -107,15 +330,46 @@ namespace MR
       value_type Enhancer::operator() (const vector_type& stats, vector_type& enhanced_stats) const
       {
         enhanced_stats = vector_type::Zero (stats.size());
+
+        // Pre-compute the heights at which the integral is evaluated (accumulated
+        //   in the same way as a loop over h += dh), along with their power terms
+        value_type max_stat = 0.0;
+        for (ssize_t fixel = 0; fixel < stats.size(); ++fixel) {
+          if (stats[fixel] > max_stat)
+            max_stat = stats[fixel];
+        }
+        vector<value_type> heights, height_terms;
+        for (value_type h = this->dh; h < max_stat; h += this->dh) {
+          heights.push_back (h);
+          height_terms.push_back (std::pow (h, H));
+        }
+        // The number of integration heights lying below a given statistic value
+        auto num_heights_below = [&] (const value_type value) -> size_t {
+          return std::lower_bound (heights.begin(), heights.end(), value) - heights.begin();
+        };
+
+        // Rather than re-scanning the neighbourhood of a fixel at every height,
+        //   each neighbour is binned according to the number of heights it exceeds;
+        //   the extent at each height is then the cumulative sum over those bins
+        //   from the top down, such that the fixel is processed in a single pass
+        vector<value_type> extent (heights.size());
         value_type max_enhanced_stat = 0.0;
-        vector<NormMatrixElement>::const_iterator connected_fixel;
-        for (size_t fixel = 0; fixel < connectivity_matrix.size(); ++fixel) {
-          for (value_type h = this->dh; h < stats[fixel]; h +=  this->dh) {
-            value_type extent = 0.0;
-            for (connected_fixel = connectivity_matrix[fixel].begin(); connected_fixel != connectivity_matrix[fixel].end(); ++connected_fixel)
-              if (stats[connected_fixel->index()] > h)
-                extent += connected_fixel->value();
-            enhanced_stats[fixel] += std::pow (extent, E) * std::pow (h, H);
+        for (size_t fixel = 0; fixel < connectivity_matrix.rows(); ++fixel) {
+          const size_t num_steps = num_heights_below (stats[fixel]);
+          if (num_steps) {
+            std::fill (extent.begin(), extent.begin() + num_steps, value_type(0.0));
+            const auto row = connectivity_matrix[fixel];
+            for (size_t i = 0; i != row.size(); ++i) {
+              const size_t steps = std::min (num_steps, num_heights_below (stats[row.index (i)]));
+              if (steps)
+                extent[steps-1] += row.value (i);
+            }
+            for (ssize_t step = num_steps - 2; step >= 0; --step)
+              extent[step] += extent[step+1];
+            value_type enhanced = 0.0;
+            for (size_t step = 0; step != num_steps; ++step)
+              enhanced += std::pow (extent[step], E) * height_terms[step];
+            enhanced_stats[fixel] = enhanced;
           }
           if (enhanced_stats[fixel] > max_enhanced_stat)
             max_enhanced_stat = enhanced_stats[fixel];
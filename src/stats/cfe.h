@@ -16,6 +16,9 @@
 #ifndef __stats_cfe_h__
 #define __stats_cfe_h__
 
+#include <mutex>
+#include <unordered_map>
+
 #include "image.h"
 #include "image_helpers.h"
 #include "types.h"
@@ -45,14 +48,6 @@ namespace MR
       @{ */
 
 
-      class connectivity { NOMEMALIGN
-        public:
-          connectivity () : value (0.0) { }
-          connectivity (const connectivity_value_type v) : value (v) { }
-          connectivity_value_type value;
-      };
-
-
       // A class to store fixel index / connectivity value pairs
       //   only after the connectivity matrix has been thresholded / normalised
       class NormMatrixElement
@@ -72,15 +67,166 @@ namespace MR
 
 
 
-      // Different types are used depending on whether the connectivity matrix
-      //   is in the process of being built, or whether it has been normalised
-      using init_connectivity_matrix_type = vector<std::map<index_type, connectivity>>;
       using norm_connectivity_matrix_type = vector<vector<NormMatrixElement>>;
 
 
 
+      // The fixel-fixel connectivity matrix while it is being built from the
+      //   tractogram, i.e. the number of streamlines shared between each pair
+      //   of fixels.
+      // So that multiple threads can contribute concurrently, the rows are
+      //   divided into shards of contiguous fixel ranges, each protected by
+      //   its own mutex. Within each shard, elements are stored as a sorted
+      //   array of (row, column) keys & streamline counts; new contributions
+      //   are appended to an unsorted list, which is periodically sorted and
+      //   merged into the main array.
+      class InitMatrix
+      { NOMEMALIGN
+        public:
+          using key_type = uint64_t;
+          using count_type = uint32_t;
+          using element_type = std::pair<key_type, count_type>;
+
+          InitMatrix (const size_t num_fixels);
+
+          static FORCE_INLINE key_type key (const index_type row, const index_type column) { return (key_type(row) << 32) | key_type(column); }
+          static FORCE_INLINE index_type row (const key_type key) { return index_type (key >> 32); }
+          static FORCE_INLINE index_type column (const key_type key) { return index_type (key & 0xFFFFFFFF); }
+
+          size_t size() const { return num_fixels; }
+          size_t num_shards() const { return shards.size(); }
+          size_t shard (const index_type row) const { return row / rows_per_shard; }
+
+          // Add a set of contributions, which must be sorted by key
+          void add (const vector<element_type>& elements);
+
+          // Access the elements of a shard, sorted by key; only valid once all
+          //   threads have finished contributing
+          const vector<element_type>& get_shard (const size_t index);
+          // Release the memory used by a shard
+          void clear_shard (const size_t index);
+
+        private:
+          class Shard
+          { NOMEMALIGN
+            public:
+              std::mutex mutex;
+              vector<element_type> data, pending;
+              void merge();
+          };
+
+          const size_t num_fixels;
+          size_t rows_per_shard;
+          vector<std::unique_ptr<Shard>> shards;
+      };
+
+
+
+      // The normalised connectivity matrix as used for enhancement, in
+      //   compressed sparse row (CSR) format: the fixel indices & connectivity
+      //   values of all rows are stored in two contiguous arrays, with the
+      //   offset of the start of each row stored in a third.
+      // The matrix must be constructed one row at a time, in order, by calling
+      //   add() for each element of the row followed by finalise_row().
+      class NormMatrix
+      { NOMEMALIGN
+        public:
+
+          class Row
+          { NOMEMALIGN
+            public:
+              Row (const index_type* indices, const connectivity_value_type* values, const size_t size) :
+                  indices (indices),
+                  values (values),
+                  num_elements (size) { }
+              FORCE_INLINE size_t size() const { return num_elements; }
+              FORCE_INLINE index_type index (const size_t i) const { assert (i < num_elements); return indices[i]; }
+              FORCE_INLINE connectivity_value_type value (const size_t i) const { assert (i < num_elements); return values[i]; }
+            private:
+              const index_type* const indices;
+              const connectivity_value_type* const values;
+              const size_t num_elements;
+          };
+
+          NormMatrix () : offsets (1, 0) { }
+
+          void add (const index_type index, const connectivity_value_type value) {
+            indices.push_back (index);
+            values.push_back (value);
+          }
+          void finalise_row () { offsets.push_back (indices.size()); }
+
+          size_t rows() const { return offsets.size() - 1; }
+          size_t nonzeros() const { return indices.size(); }
+
+          Row operator[] (const size_t row) const {
+            assert (row < rows());
+            return Row (indices.data() + offsets[row], values.data() + offsets[row], offsets[row+1] - offsets[row]);
+          }
+
+        private:
+          vector<size_t> offsets;
+          vector<index_type> indices;
+          vector<connectivity_value_type> values;
+      };
+
+
+
+      // The thresholded fixel-fixel connectivity fractions (i.e. the number of
+      //   streamlines shared between two fixels, divided by the track density of
+      //   the first), indexed by template fixel, in CSR format.
+      // This is the point at which the matrix is independent of the particular
+      //   statistical analysis being performed; it can therefore be written to
+      //   a directory of images, which can then be memory-mapped in subsequent
+      //   runs rather than re-processing the tractogram.
+      class ConnectivityMatrix
+      { MEMALIGN(ConnectivityMatrix)
+        public:
+          // Convert from the initial connectivity matrix; the memory used by
+          //   the initial matrix is freed as the conversion progresses
+          ConnectivityMatrix (InitMatrix& init_matrix,
+                              const vector<uint32_t>& fixel_TDI,
+                              const connectivity_value_type threshold);
+          // Memory-map a matrix previously written using save()
+          ConnectivityMatrix (const std::string& directory);
+          ConnectivityMatrix (const ConnectivityMatrix&) = delete;
+
+          void save (const std::string& directory, const Header& template_header) const;
+
+          size_t size() const { return num_fixels; }
+          size_t nonzeros() const { return offsets_ptr[num_fixels]; }
+          NormMatrix::Row operator[] (const size_t fixel) const {
+            assert (fixel < num_fixels);
+            return NormMatrix::Row (indices_ptr + offsets_ptr[fixel], values_ptr + offsets_ptr[fixel], offsets_ptr[fixel+1] - offsets_ptr[fixel]);
+          }
+
+          //! properties of the matrix (e.g. thresholds used during its construction)
+          std::map<std::string, std::string> keyval;
+
+        private:
+          size_t num_fixels;
+          // Data are either held in RAM...
+          vector<uint64_t> offsets;
+          vector<index_type> indices;
+          vector<connectivity_value_type> values;
+          // ... or memory-mapped from file
+          Image<uint64_t> offsets_image;
+          Image<index_type> indices_image;
+          Image<connectivity_value_type> values_image;
+
+          const uint64_t* offsets_ptr;
+          const index_type* indices_ptr;
+          const connectivity_value_type* values_ptr;
+      };
+
+
+
       /**
        * Process each track by converting each streamline to a set of dixels, and map these to fixels.
+       * Each copy of this class (i.e. each thread) accumulates contributions in
+       *   its own hash table, which is periodically sorted and added to the
+       *   shared matrix; the track density of each fixel is similarly
+       *   accumulated per thread, and added to the shared vector on destruction.
        */
       class TrackProcessor { MEMALIGN(TrackProcessor)
 
@@ -88,9 +234,11 @@ namespace MR
           TrackProcessor (Image<index_type>& fixel_indexer,
                           const vector<direction_type>& fixel_directions,
                           Image<bool>& fixel_mask,
-                          vector<uint16_t>& fixel_TDI,
-                          init_connectivity_matrix_type& connectivity_matrix,
+                          vector<uint32_t>& fixel_TDI,
+                          InitMatrix& connectivity_matrix,
                           const value_type angular_threshold);
+          TrackProcessor (const TrackProcessor& that);
+          ~TrackProcessor();
 
           bool operator () (const SetVoxelDir& in);
 
@@ -98,17 +246,26 @@ namespace MR
           Image<index_type> fixel_indexer;
           const vector<direction_type>& fixel_directions;
           Image<bool> fixel_mask;
-          vector<uint16_t>& fixel_TDI;
-          init_connectivity_matrix_type& connectivity_matrix;
+          vector<uint32_t>& fixel_TDI;
+          InitMatrix& connectivity_matrix;
           const value_type angular_threshold_dp;
+          std::shared_ptr<std::mutex> mutex;
+
+          vector<uint32_t> local_TDI;
+          std::unordered_map<InitMatrix::key_type, InitMatrix::count_type> local_counts;
+          vector<index_type> tract_fixel_indices;
+
+          void flush();
       };
 
 
 
 
+      // Note that the enhancer is not multi-threaded internally: it is
+      //   invoked concurrently from the permutation testing threads.
       class Enhancer : public Stats::EnhancerBase { MEMALIGN (Enhancer)
         public:
-          Enhancer (const norm_connectivity_matrix_type& connectivity_matrix,
+          Enhancer (const NormMatrix& connectivity_matrix,
                     const value_type dh, const value_type E, const value_type H);
           virtual ~Enhancer() { }
 
@@ -117,7 +274,7 @@ namespace MR
 
 
         protected:
-          const norm_connectivity_matrix_type& connectivity_matrix;
+          const NormMatrix& connectivity_matrix;
           const value_type dh, E, H;
       };
 